@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+
+#include "dispatcher.h"
+#include "sender.h"
+
+namespace messaging {
+    class scheduler;
+    class machine_actor;
+
+    /**
+     * A receiver that doesn't need a thread of its own. Derive from actor, put the message loop body in receive(), and
+     * hand the actor to a scheduler: whenever its mailbox goes from empty to non-empty the actor becomes runnable, and a
+     * worker of the scheduler calls receive() once per message, for up to a batch of messages, before moving on to the
+     * next runnable actor. Inside receive(), current() plays the part of receiver::wait(): it returns a dispatcher for
+     * the message being processed, and handlers are chained on it in exactly the same way,
+     *
+     *     void receive() override {
+     *         current()
+     *             .handle<digit_pressed>([&](digit_pressed const& msg) { ... })
+     *             .handle<cancel_pressed>([&](cancel_pressed const&) { state = &atm::done_processing; });
+     *     }
+     *
+     * except that a message none of the handlers match is dropped instead of waited past. A state machine that swaps
+     * the handler set for the next message, as the ATM example does, keeps working unchanged: the next call of
+     * receive() sees the new state. An actor whose receive() lets close_queue through is closed, without any exception
+     * being thrown: it is not run again, and messages sent to it afterwards stay queued until it is destroyed.
+     *
+     * An actor is only ever run by one worker at a time, so its members need no locking. It must outlive the
+     * scheduler's workers; destroying the scheduler first is the simplest way to ensure that.
+     */
+    class actor : private mailbox_owner {
+        friend class scheduler;
+        friend class machine_actor;
+
+        queue q;    // An actor owns its mailbox, like a receiver.
+        scheduler* sched = nullptr;
+        message_ptr current_message;    // Taken over by receive() when it keeps the message, as a machine does.
+        actor* next_runnable = nullptr;     // Link in the scheduler's run queue.
+
+        void mailbox_ready() noexcept override;     // Defined in scheduler.h.
+
+        // Called by scheduler::start() just before the actor can first be run, on the starting thread.
+        virtual void started() {}
+
+        // Runs receive() for up to `batch` messages. Returns true when the actor has more messages and should be
+        // queued again, false once it is parked or closed.
+        bool activate(std::size_t batch) {
+            for (std::size_t n = 0; n < batch; ++n) {
+                current_message = q.try_pop();
+                if (!current_message) {
+                    break;
+                }
+                receive();
+                current_message.reset();
+                if (q.closed()) {
+                    return false;   // Never parked again, so no sender will make it runnable.
+                }
+            }
+            return !q.park();
+        }
+
+    protected:
+        actor() = default;
+
+        explicit actor(std::size_t capacity) : q(capacity) {}   // A bounded mailbox, as for receiver.
+
+        // The message loop body, called once per message by a worker thread.
+        virtual void receive() = 0;
+
+        dispatcher current() {  // The dispatcher for the message receive() was called for.
+            return dispatcher(&q, *current_message);
+        }
+
+    public:
+        actor(actor const&) = delete;
+        actor& operator=(actor const&) = delete;
+        virtual ~actor() = default;
+
+        operator sender() {     // Allow implicit conversion to a sender that references the mailbox.
+            return sender(&q);
+        }
+
+        bool is_closed() const { return q.closed(); }   // Only meaningful once the scheduler is done with the actor.
+
+        void enable_stats() { q.enable_stats(); }   // As receiver::enable_stats(); call it before start().
+        mailbox_snapshot snapshot() const { return q.snapshot(); }
+
+        std::size_t capacity() const { return q.max_depth(); }
+        std::size_t depth() const { return q.size(); }
+        std::size_t high_water_mark() const { return q.high_water_mark(); }
+    };
+}
+
+#include "scheduler.h"
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "message_queue.h"
+
+namespace messaging {
+    /**
+     * A publish/subscribe bus. A publisher posts a message once; it is wrapped in a single node, and every
+     * subscription reads that same node in place, so fanning out to many receivers costs one allocation from the bus's
+     * pool and a couple of atomics per subscriber, whatever the size of the message.
+     *
+     *     messaging::bus displays;
+     *     messaging::bus::subscription screen(displays);     // Before the receiver, which it must outlive.
+     *     messaging::receiver incoming(screen);
+     *     ...
+     *     displays.publish(display_balance(42));             // Any thread.
+     *     incoming.wait().handle<display_balance>([&](display_balance const& msg) { ... });
+     *
+     * Messages are kept in a ring of slots, Disruptor-style: publishers claim consecutive positions, and each
+     * subscription walks the ring with a cursor of its own. A slot holds its message until every subscription that
+     * was there when it was published has dispatched it; the last one frees the node and hands the slot to the next
+     * lap. A publisher that catches up with the slowest subscription waits for it (or fails, with try_publish). A
+     * published message is shared and must be treated as immutable by the handlers that see it.
+     *
+     * The bus is one stream: every subscription sees the messages published after it subscribed, in the order they
+     * were claimed, and a close_queue published on the bus closes every subscriber after the messages before it.
+     */
+    class bus {
+    public:
+        class subscription;
+
+        // `slot_count`, a power of two, is how far the fastest publisher may get ahead of the slowest subscription.
+        explicit bus(std::size_t slot_count = 1024) : mask(slot_count - 1U), slots(new slot[slot_count]) {
+            if (slot_count == 0 || (slot_count & mask) != 0) {
+                std::fprintf(stderr, "messaging: bus slot_count %zu is not a power of two\n", slot_count);
+                std::abort();
+            }
+            for (std::size_t i = 0; i < slot_count; ++i) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bus(bus const&) = delete;
+        bus& operator=(bus const&) = delete;
+
+        ~bus() {    // Every subscription is gone by now, so whatever is left in a slot is unread.
+            for (std::size_t i = 0; i <= mask; ++i) {
+                if (slots[i].msg != nullptr) {
+                    message_deleter{}(slots[i].msg);
+                }
+            }
+        }
+
+        // The node is built before a position is claimed, so a position once claimed is always filled.
+        template<typename Msg>
+        void publish(Msg&& msg) {   // Waits while the slowest subscription is a whole ring behind.
+            message_ptr node = make_message(pool, std::forward<Msg>(msg));
+            std::uint64_t pos;
+            std::uint32_t readers;
+            while (!claim(pos, readers)) {
+                wait_for_space();
+            }
+            fill<std::remove_cvref_t<Msg>>(pos, readers, std::move(node));
+        }
+
+        template<typename Msg>
+        bool try_publish(Msg&& msg) {   // Fails at once instead.
+            message_ptr node = make_message(pool, std::forward<Msg>(msg));
+            std::uint64_t pos;
+            std::uint32_t readers;
+            if (!claim(pos, readers)) {
+                return false;
+            }
+            fill<std::remove_cvref_t<Msg>>(pos, readers, std::move(node));
+            return true;
+        }
+
+        std::size_t subscribers() const {
+            return static_cast<std::size_t>(claimed.load(std::memory_order_relaxed) >> count_shift);
+        }
+
+        std::size_t slot_count() const { return mask + 1U; }
+
+    private:
+        // `claimed` packs the number of subscriptions above the next position to claim, so a publisher learns how
+        // many subscriptions will read its message in the same atomic step that gives it its position, and a new
+        // subscription learns where its cursor starts in the step that counts it in.
+        static constexpr unsigned count_shift = 48;
+        static constexpr std::uint64_t position_mask = (std::uint64_t{1} << count_shift) - 1U;
+        static constexpr std::uint64_t one_subscriber = std::uint64_t{1} << count_shift;
+
+        // `sequence` is pos while the slot is free for the publisher of pos, and pos + 1 once that message is in it.
+        struct alignas(64) slot {
+            std::atomic<std::uint64_t> sequence;
+            std::atomic<std::uint32_t> readers{0};  // Subscriptions that have yet to let go of the message.
+            message_base* msg = nullptr;
+            void* payload = nullptr;    // The contents of `msg`, which the subscriptions' views point at.
+        };
+
+        message_pool pool;  // Declared first: outlives every node left in a slot.
+        std::uint64_t const mask;
+        std::unique_ptr<slot[]> slots;
+
+        alignas(64) std::atomic<std::uint64_t> claimed{0};
+
+        alignas(64) std::atomic<std::uint32_t> parked{0};          // Subscriptions asleep waiting for a message.
+        std::atomic<std::uint32_t> publishers_waiting{0};
+        std::mutex m;
+        std::condition_variable message_cv;
+        std::condition_variable space_cv;
+
+        slot& slot_at(std::uint64_t pos) const { return slots[pos & mask]; }
+
+        bool claim(std::uint64_t& pos, std::uint32_t& readers) {
+            std::uint64_t word = claimed.load(std::memory_order_relaxed);
+            for (; ;) {
+                pos = word & position_mask;
+                const auto diff = static_cast<std::int64_t>(slot_at(pos).sequence.load(std::memory_order_acquire) - pos);
+                if (diff < 0) {
+                    return false;   // Still held from the last lap.
+                }
+                if (diff == 0 && claimed.compare_exchange_weak(word, word + 1U, std::memory_order_relaxed)) {
+                    readers = static_cast<std::uint32_t>(word >> count_shift);
+                    return true;
+                }
+                if (diff > 0) {
+                    word = claimed.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        template<typename Msg>
+        void fill(std::uint64_t pos, std::uint32_t readers, message_ptr node) {
+            slot& s = slot_at(pos);
+            if (readers == 0) {     // Nobody to read it: free the slot for the next lap right away.
+                s.sequence.store(pos + mask + 1U, std::memory_order_release);
+                return;
+            }
+            s.payload = &message_cast<Msg>(*node);
+            s.msg = node.release();
+            s.readers.store(readers, std::memory_order_relaxed);
+            s.sequence.store(pos + 1U, std::memory_order_seq_cst);
+            if (parked.load(std::memory_order_seq_cst) != 0) {
+                { std::lock_guard<std::mutex> lk(m); }
+                message_cv.notify_all();
+            }
+        }
+
+        void wait_for_space() {
+            std::unique_lock<std::mutex> lk(m);
+            publishers_waiting.fetch_add(1, std::memory_order_seq_cst);
+            space_cv.wait(lk, [&] {
+                const std::uint64_t pos = claimed.load(std::memory_order_seq_cst) & position_mask;
+                return slot_at(pos).sequence.load(std::memory_order_seq_cst) == pos;
+            });
+            publishers_waiting.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        bool published(std::uint64_t pos) const {
+            return slot_at(pos).sequence.load(std::memory_order_seq_cst) == pos + 1U;
+        }
+
+        // One subscription is done with the message at `pos`; the last one frees it and the slot.
+        void release(std::uint64_t pos) noexcept {
+            slot& s = slot_at(pos);
+            if (s.readers.fetch_sub(1, std::memory_order_acq_rel) != 1U) {
+                return;
+            }
+            message_deleter{}(std::exchange(s.msg, nullptr));
+            s.sequence.store(pos + mask + 1U, std::memory_order_seq_cst);
+            if (publishers_waiting.load(std::memory_order_seq_cst) != 0) {
+                { std::lock_guard<std::mutex> lk(m); }
+                space_cv.notify_all();
+            }
+        }
+
+    public:
+        /**
+         * A cursor over the bus, and the external mailbox of the receiver made from it: the receiver dispatches each
+         * published message in place, through a view, and lets go of it when the dispatcher is done. Subscribes on
+         * construction and unsubscribes on destruction, letting go of whatever it hasn't read yet; it must outlive its
+         * receiver. The only message that can be sent to its receiver directly is close_queue, which overtakes the bus
+         * as it overtakes data in a queue; anything else is refused.
+         */
+        class subscription final : public external_mailbox {
+            struct bus_view final : message_view {
+                subscription* owner;
+                std::uint64_t pos;
+
+                bus_view(message_type_id type_id_, void* payload_, subscription* owner_, std::uint64_t pos_)
+                    : message_view(type_id_, payload_), owner(owner_), pos(pos_) {}
+
+                void release() noexcept override {
+                    subscription* o = owner;
+                    const std::uint64_t p = pos;
+                    this->~bus_view();
+                    o->source.release(p);
+                }
+            };
+
+            struct close_view final : message_view {
+                close_queue contents;
+
+                close_view() : message_view(type_id_of<close_queue>, &contents) {}
+                void release() noexcept override {}
+            };
+
+            struct alignas(bus_view) view_storage {
+                unsigned char bytes[sizeof(bus_view)];
+            };
+
+            bus& source;
+            std::uint64_t next_pos;     // Consumer only.
+            std::vector<view_storage> views;    // One per slot: a slot can't come round again while its view lives.
+            close_view closer;
+            std::atomic<bool> close_pending{false};
+
+            bool ready() const { return close_pending.load(std::memory_order_seq_cst) || source.published(next_pos); }
+
+            message_ptr take() {
+                if (close_pending.load(std::memory_order_acquire)) {
+                    close_pending.store(false, std::memory_order_relaxed);
+                    return message_ptr(&closer);
+                }
+                if (!source.published(next_pos)) {
+                    return nullptr;
+                }
+                const std::uint64_t pos = next_pos++;
+                slot const& s = source.slot_at(pos);
+                return message_ptr(new (&views[pos & source.mask]) bus_view(s.msg->type_id, s.payload, this, pos));
+            }
+
+        public:
+            explicit subscription(bus& source_) : source(source_), views(source_.slot_count()) {
+                std::uint64_t word = source.claimed.load(std::memory_order_relaxed);
+                while (!source.claimed.compare_exchange_weak(word, word + one_subscriber, std::memory_order_seq_cst,
+                                                             std::memory_order_relaxed)) {
+                }
+                next_pos = word & position_mask;
+            }
+
+            subscription(subscription const&) = delete;
+            subscription& operator=(subscription const&) = delete;
+
+            ~subscription() {
+                std::uint64_t word = source.claimed.load(std::memory_order_relaxed);
+                while (!source.claimed.compare_exchange_weak(word, word - one_subscriber, std::memory_order_seq_cst,
+                                                             std::memory_order_relaxed)) {
+                }
+                // Every position claimed before that counted this subscription in; its publisher is filling it now.
+                for (const std::uint64_t end = word & position_mask; next_pos != end; ++next_pos) {
+                    while (!source.published(next_pos)) {
+                        std::this_thread::yield();
+                    }
+                    source.release(next_pos);
+                }
+            }
+
+            bool try_push_bytes(message_type_id type_id, void const*, std::size_t) override {
+                if (type_id != type_id_of<close_queue>) {
+                    std::fprintf(stderr, "messaging: only close_queue can be sent to a bus subscription\n");
+                    return false;
+                }
+                close_pending.store(true, std::memory_order_seq_cst);
+                if (source.parked.load(std::memory_order_seq_cst) != 0) {
+                    { std::lock_guard<std::mutex> lk(source.m); }
+                    source.message_cv.notify_all();
+                }
+                return true;
+            }
+
+            bool push_bytes(message_type_id type_id, void const* payload, std::size_t size,
+                            std::chrono::steady_clock::time_point const*) override {
+                return try_push_bytes(type_id, payload, size);
+            }
+
+            message_ptr pop(bool wait, std::chrono::steady_clock::time_point const* deadline) override {
+                if (message_ptr msg = take(); msg || !wait) {
+                    return msg;
+                }
+                std::unique_lock<std::mutex> lk(source.m);
+                source.parked.fetch_add(1, std::memory_order_seq_cst);
+                if (deadline == nullptr) {
+                    source.message_cv.wait(lk, [&] { return ready(); });
+                } else {
+                    source.message_cv.wait_until(lk, *deadline, [&] { return ready(); });
+                }
+                source.parked.fetch_sub(1, std::memory_order_relaxed);
+                lk.unlock();
+                return take();  // Null only if the deadline passed with nothing published.
+            }
+        };
+    };
+}
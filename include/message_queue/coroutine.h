@@ -0,0 +1,291 @@
+#pragma once
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "actor.h"
+#include "receiver.h"
+
+namespace messaging {
+    /**
+     * A state machine written as a coroutine: straight-line code that co_awaits its next message from an inbox,
+     *
+     *     messaging::machine atm_flow(messaging::inbox& incoming) {
+     *         for (; ;) {
+     *             auto card = co_await incoming.receive<card_inserted>();
+     *             std::string pin;
+     *             while (pin.size() < 4) {
+     *                 auto key = co_await incoming.receive<digit_pressed, cancel_pressed>();
+     *                 if (key.is<cancel_pressed>()) { ... }
+     *                 pin += key.get<digit_pressed>().digit;
+     *             }
+     *             ...
+     *         }
+     *     }
+     *
+     * The frame is allocated once, when the machine is created, and holds the machine's state between messages; a
+     * suspended machine costs its frame and nothing else. A machine starts when its inbox starts it and runs until
+     * its first co_await.
+     */
+    class machine {
+    public:
+        struct promise_type {
+            machine get_return_object() { return machine(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }     // The owner sees done() and destroys it.
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }    // A machine has nobody to report an exception to.
+        };
+
+        machine() = default;
+        machine(machine&& other) noexcept : frame(std::exchange(other.frame, nullptr)) {}
+        machine& operator=(machine&& other) noexcept {
+            if (this != &other) {
+                reset();
+                frame = std::exchange(other.frame, nullptr);
+            }
+            return *this;
+        }
+        machine(machine const&) = delete;
+        machine& operator=(machine const&) = delete;
+
+        ~machine() { reset(); }
+
+        bool valid() const { return frame != nullptr; }
+        bool done() const { return frame == nullptr || frame.done(); }
+
+    private:
+        friend class inbox;
+
+        std::coroutine_handle<promise_type> frame;
+
+        explicit machine(std::coroutine_handle<promise_type> frame_) : frame(frame_) {}
+
+        void reset() {
+            if (frame) {
+                std::exchange(frame, nullptr).destroy();
+            }
+        }
+    };
+
+    /**
+     * The message a machine received from co_await inbox::receive<Ts...>(): one of Ts, still in its mailbox node, so
+     * it is handed over without a copy. The node goes back to its pool when this is destroyed.
+     */
+    template<typename... Ts>
+    class received {
+        message_ptr msg;
+
+        template<typename T>
+        static constexpr bool is_one_of = (std::is_same_v<T, Ts> || ...);
+
+    public:
+        explicit received(message_ptr msg_) : msg(std::move(msg_)) {}
+
+        template<typename T>
+        bool is() const {
+            static_assert(is_one_of<T>, "not a type this receive() waited for");
+            return msg->type_id == type_id_of<T>;
+        }
+
+        // The message as a T, which it must be; with a single type to wait for, that type.
+        template<typename T = std::tuple_element_t<0, std::tuple<Ts...>>>
+        T& get() {
+            static_assert(is_one_of<T>, "not a type this receive() waited for");
+            return message_cast<T>(*msg);
+        }
+
+        template<typename T>
+        T* get_if() {
+            return is<T>() ? &get<T>() : nullptr;
+        }
+
+        // Calls f with the message as whichever of Ts it is.
+        template<typename Func>
+        void visit(Func&& f) {
+            ((msg->type_id == type_id_of<Ts> ? (void)f(message_cast<Ts>(*msg)) : void()), ...);
+        }
+    };
+
+    template<typename... Ts>
+    class receive_awaiter;
+
+    /**
+     * Where a machine waits for its messages. co_await receive<Ts...>() suspends the machine until a message of one of
+     * Ts comes in and resumes it with that message; the types it waits for are its whole handler set, known at
+     * compile time, so no dispatcher chain is built per message. Messages of other types are dropped, or stashed with
+     * stash_unmatched() and offered first to the next receive() that waits for their type, as for receiver::wait().
+     * A close_queue that the machine isn't waiting for closes the inbox and destroys the machine where it is
+     * suspended, so its locals are cleaned up as if it had returned.
+     *
+     * An inbox is fed in one of two ways: machine_actor runs a machine on a scheduler, so thousands of machines can
+     * wait for messages with no thread each, and run() drives one on the calling thread from a receiver:
+     *
+     *     messaging::receiver atm_queue;
+     *     messaging::inbox incoming(atm_queue);
+     *     incoming.run(atm_flow(incoming));   // Returns once the machine is done or the receiver is closed.
+     */
+    class inbox {
+        queue* q;
+        machine body;
+        std::coroutine_handle<> waiting;
+        message_type_id const* wanted = nullptr;    // The types `waiting` is suspended for.
+        std::size_t wanted_count = 0;
+        message_ptr delivered;  // The message that resumes it.
+
+        template<typename... Ts>
+        friend class receive_awaiter;
+        friend class machine_actor;
+
+        explicit inbox(queue& q_) : q(&q_) {}
+
+        bool wants(message_type_id type_id) const {
+            for (std::size_t i = 0; i < wanted_count; ++i) {
+                if (wanted[i] == type_id) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Resumes the machine with `msg`, which it waits for; it runs until its next co_await or its end.
+        void resume_with(message_ptr msg) {
+            mailbox_stats* stats = q->stats();
+            const std::uint64_t sent_at = msg->sent_at_ns;
+            const message_type_id type_id = msg->type_id;
+            const std::uint64_t start = stats != nullptr ? queue::steady_now_ns() : 0;
+            delivered = std::move(msg);
+            wanted_count = 0;
+            std::exchange(waiting, nullptr).resume();
+            if (stats != nullptr) {
+                stats->record(type_id, dispatch_outcome::handled, start - sent_at, sent_at != 0,
+                              queue::steady_now_ns() - start);
+            }
+        }
+
+        void record_missed(message_base const& msg, dispatch_outcome outcome) {
+            if (mailbox_stats* stats = q->stats()) {
+                const bool timed = msg.sent_at_ns != 0 && outcome == dispatch_outcome::dropped;
+                stats->record(msg.type_id, outcome, timed ? queue::steady_now_ns() - msg.sent_at_ns : 0, timed, 0);
+            }
+        }
+
+        // Hands the machine a message from the mailbox. Returns false once the inbox is closed.
+        bool offer(message_ptr msg) {
+            if (body.done()) {
+                return !q->closed();     // Finished machines drop whatever comes.
+            }
+            if (wants(msg->type_id)) {
+                resume_with(std::move(msg));
+            } else if (msg->type_id == type_id_of<close_queue>) {
+                record_missed(*msg, dispatch_outcome::handled);
+                q->mark_closed();
+                body = machine();
+                waiting = nullptr;
+            } else if (q->stash_unmatched()) {
+                record_missed(*msg, dispatch_outcome::stashed);
+                q->stash().put(std::move(msg));
+            } else {
+                record_missed(*msg, dispatch_outcome::dropped);
+            }
+            return !q->closed();
+        }
+
+    public:
+        explicit inbox(receiver& r) : q(&r.q) {}
+        inbox(inbox const&) = delete;
+        inbox& operator=(inbox const&) = delete;
+
+        template<typename... Ts>
+        receive_awaiter<Ts...> receive() {
+            return receive_awaiter<Ts...>(*this);
+        }
+
+        // Starts `m` and runs it on this thread, one message at a time, until it is done or a close_queue closes it.
+        void run(machine m) {
+            start(std::move(m));
+            while (!body.done() && offer(q->wait_and_pop())) {
+            }
+        }
+
+        void start(machine m) {     // Runs `m` up to its first co_await.
+            body = std::move(m);
+            body.frame.resume();
+        }
+
+        bool done() const { return body.done(); }
+        bool closed() const { return q->closed(); }
+        void stash_unmatched(bool stash) { q->set_stash_unmatched(stash); }
+    };
+
+    template<typename... Ts>
+    class receive_awaiter {
+        static_assert(sizeof...(Ts) != 0, "receive() needs at least one message type");
+
+        static constexpr std::array<message_type_id, sizeof...(Ts)> ids{type_id_of<Ts>...};
+
+        inbox& box;
+        message_ptr taken;  // From the stash, when it had one.
+
+        friend class inbox;
+
+        explicit receive_awaiter(inbox& box_) : box(box_) {}
+
+    public:
+        bool await_ready() {
+            message_stash& stash = box.q->stash();
+            if (!stash.empty() && !box.q->control_pending()) {
+                taken = stash.take_oldest(ids);
+            }
+            return taken != nullptr;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            box.waiting = h;
+            box.wanted = ids.data();
+            box.wanted_count = ids.size();
+        }
+
+        received<Ts...> await_resume() {
+            return received<Ts...>(taken ? std::move(taken) : std::move(box.delivered));
+        }
+    };
+
+    /**
+     * An actor whose message loop is a machine: derive from it and write the machine in run(), awaiting messages from
+     * `incoming`. The scheduler starts the machine when the actor is started, and each message the actor is run for
+     * resumes it if it is waiting for that message's type.
+     *
+     *     class atm : public messaging::machine_actor {
+     *         messaging::machine run() override {
+     *             auto card = co_await incoming.receive<card_inserted>();
+     *             ...
+     *         }
+     *     };
+     */
+    class machine_actor : public actor {
+        void started() override {
+            incoming.start(run());
+        }
+
+        void receive() override {
+            incoming.offer(std::move(current_message));
+        }
+
+    protected:
+        inbox incoming{q};
+
+        machine_actor() = default;
+        explicit machine_actor(std::size_t capacity) : actor(capacity) {}
+
+        virtual machine run() = 0;
+
+    public:
+        bool machine_done() const { return incoming.done(); }
+    };
+}
@@ -1,23 +1,67 @@
 #pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
 #include "message_queue.h"
 
 namespace messaging {
 
-    class close_queue   // The message for closing the queue.
-    {};
+    template<typename PreviousDispatcher, typename Msg, typename Func>
+    class TemplateDispatcher;
+
+    /**
+     * How a dispatch ended: a handler took the message, none matched it, it was a close_queue that no handler claimed,
+     * or the deadline of a wait_for()/wait_until() passed first. A waiting dispatcher never ends unhandled, since it
+     * keeps waiting past unhandled messages.
+     */
+    enum class dispatch_status : std::uint8_t {
+        handled,
+        unhandled,
+        closed,
+        timed_out,
+    };
+
+    /**
+     * What a timed wait hands to the chain when its deadline passes; on_timeout(f) is handle<timeout>() for a handler
+     * that takes no arguments. It never travels through a queue: the handler is found at compile time and called
+     * directly.
+     */
+    struct timeout {};
 
     /**
      * The dispatcher instance that's returned from wait() will be destroyed immediately, because it's a temporary, and
      * as mentioned, the destructor does the work. The destructor calls wait_and_dispatch(), which is a loop that waits
      * for a message and passes it to dispatch(). dispatch() itself is rather simple; it checks whether the message is a
-     * close_queue message and throws an exception if it is; otherwise, it returns false to indicate that the message was
-     * unhandled.This close_queue exception is why the destructor is marked noexcept(false); without this annotation the
-     * default exception specification for destructor would be noexcept(true), indicating that no exceptions can be thrown,
-     * and the close_queue exception would thus terminate the program.
+     * close_queue message and reports dispatch_status::closed if it is; otherwise, it reports the message unhandled.
+     * A closed queue is remembered by the queue (receiver::closed()), and by default it is also reported by throwing
+     * close_queue out of the destructor, which is why the destructor is marked noexcept(false); without this
+     * annotation the default exception specification for destructor would be noexcept(true), indicating that no
+     * exceptions can be thrown, and the close_queue exception would thus terminate the program.
+     *
+     * Throwing makes every shutdown take the unwinding path, and needs exceptions in the first place. receiver's
+     * run_until_closed() switches the throw off for the length of its loop, and result() runs a chain on the spot and
+     * returns its dispatch_status instead of leaving the work to the destructor; neither ever throws. Built without
+     * exceptions, nothing here throws at all, and close_queue is only seen through the status.
+     *
+     * A dispatcher from receiver::wait_for() or wait_until() has a deadline. It waits for a matching message in a
+     * single timed wait on the mailbox (messages nobody handles don't push the deadline back) and, if the deadline
+     * passes first, dispatches a timeout to the chain, where on_timeout() picks it up, and ends timed_out.
+     *
+     * Messages that no handler of the waiting chain matches are dropped, unless the receiver stashes them
+     * (receiver::stash_unmatched()). Stashed messages are offered again to every later chain, oldest first, before it
+     * waits on the mailbox, so a state machine can leave a message for the state that is ready for it.
+     *
+     * An actor's dispatcher does not wait: it is made for the one message the scheduler is running the actor for, and
+     * the destructor dispatches that message and returns, whether a handler matched it or not.
      */
     class dispatcher {
         queue* q;
+        message_base* current;  // The message to dispatch, or nullptr to wait for one.
         bool chained;
+        bool has_deadline = false;
+        std::chrono::steady_clock::time_point deadline;
 
         dispatcher(dispatcher const&) = delete; // Dispatcher instances cannot be copied.
         dispatcher& operator=(dispatcher const&) = delete;
@@ -28,25 +72,105 @@ namespace messaging {
             typename Func>
         friend class TemplateDispatcher;    // Allow TemplateDispatcher instances to access internals.
 
-        [[noreturn]] void wait_and_dispatch() {
+        dispatch_status wait_and_dispatch() {
+            return wait_and_dispatch(*this);
+        }
+
+        // The loop of every waiting chain: waits for messages until the chain handles one, the queue is closed or the
+        // deadline passes. With a stash, the oldest stashed message the chain handles comes before the mailbox, unless
+        // a control message is waiting, and messages the chain doesn't handle go to the stash.
+        template<typename Chain>
+        dispatch_status wait_and_dispatch(Chain& chain) {
             for (; ;) { // Loop waiting for and dispatching messages.
-                auto msg = q->wait_and_pop();
-                dispatch(msg);
+                message_ptr msg;
+                if (!q->stash().empty() && !q->control_pending()) {
+                    msg = q->stash().take_oldest(Chain::handler_ids());
+                }
+                if (!msg) {
+                    msg = has_deadline ? q->wait_and_pop_until(deadline) : q->wait_and_pop();
+                }
+                if (!msg) {
+                    chain.dispatch_timeout();
+                    return dispatch_status::timed_out;
+                }
+                const dispatch_status status = dispatch_counted(chain, *msg);  // msg's node is recycled at scope exit.
+                if (status != dispatch_status::unhandled) {
+                    return status;
+                }
+                if (q->stash_unmatched()) {
+                    q->stash().put(std::move(msg));
+                }
             }
         }
 
-        bool dispatch(std::shared_ptr<message_base> const& msg) {
-            if (dynamic_cast<wrapped_message_base<close_queue>*>(msg.get())) {
-                throw close_queue();
+        // chain.dispatch(msg), recorded in the queue's statistics if it keeps any.
+        template<typename Chain>
+        dispatch_status dispatch_counted(Chain& chain, message_base& msg) {
+            mailbox_stats* stats = q->stats();
+            if (stats == nullptr) {
+                return chain.dispatch(msg);
+            }
+            const std::uint64_t start = queue::steady_now_ns();
+            const dispatch_status status = chain.dispatch(msg);
+            const std::uint64_t end = status != dispatch_status::unhandled ? queue::steady_now_ns() : start;
+            const dispatch_outcome outcome =
+                status != dispatch_status::unhandled               ? dispatch_outcome::handled :
+                current == nullptr && q->stash_unmatched()          ? dispatch_outcome::stashed :
+                                                                      dispatch_outcome::dropped;
+            // A stashed message is timed once, when a later chain handles or drops it.
+            const bool timed = msg.sent_at_ns != 0 && outcome != dispatch_outcome::stashed;
+            stats->record(msg.type_id, outcome, timed ? start - msg.sent_at_ns : 0, timed, end - start);
+            return status;
+        }
+
+        static constexpr std::size_t handler_count = 0;  // The end of every handler chain.
+
+        static constexpr message_type_id handler_id(std::size_t) { return 0; }
+
+        static constexpr std::array<message_type_id, 0> handler_ids() { return {}; }
+
+        template<typename>
+        static constexpr bool only_type_with_id_of() { return true; }
+
+        static constexpr bool ids_name_one_type() { return true; }
+
+        dispatch_status dispatch(message_base& msg) {
+            return msg.type_id == type_id_of<close_queue> ? dispatch_status::closed : dispatch_status::unhandled;
+        }
+
+        void dispatch_timeout() {}  // No on_timeout() handler in the chain.
+
+        // Runs a whole chain ending in this dispatcher: dispatches the actor's message, or waits for one.
+        template<typename Chain>
+        dispatch_status run(Chain& chain) {
+            return current != nullptr ? dispatch_counted(chain, *current) : chain.wait_and_dispatch();
+        }
+
+        // Records the outcome of a chain; `may_throw` when it came from a destructor.
+        dispatch_status finish(dispatch_status status, bool may_throw) {
+            if (status == dispatch_status::closed) {
+                q->mark_closed();
+#if MESSAGING_HAS_EXCEPTIONS
+                if (may_throw && current == nullptr && q->close_throws()) {
+                    throw close_queue();
+                }
+#else
+                (void)may_throw;
+#endif
             }
-            return false;
+            return status;
         }
 
     public:
-        dispatcher(dispatcher&& other) : q(other.q), chained(other.chained) {   // Dispatcher instances can be moved.
+        dispatcher(dispatcher&& other)  // Dispatcher instances can be moved.
+            : q(other.q), current(other.current), chained(other.chained), has_deadline(other.has_deadline),
+              deadline(other.deadline) {
             other.chained = true;   // The source mustn't wait for messages
         }
-        explicit dispatcher(queue* q_) : q(q_), chained(false) {}
+        explicit dispatcher(queue* q_) : q(q_), current(nullptr), chained(false) {}
+        dispatcher(queue* q_, message_base& current_) : q(q_), current(&current_), chained(false) {}
+        dispatcher(queue* q_, std::chrono::steady_clock::time_point deadline_)
+            : q(q_), current(nullptr), chained(false), has_deadline(true), deadline(deadline_) {}
 
         template<typename Message, typename Func>
         TemplateDispatcher<dispatcher, Message, Func>
@@ -54,10 +178,22 @@ namespace messaging {
             return TemplateDispatcher<dispatcher, Message, Func>(q, this,std::forward<Func>(f));
         }
 
+        template<typename Func>
+        auto on_timeout(Func&& f) {     // Called with no arguments when the deadline passes first.
+            return handle<timeout>([f = std::forward<Func>(f)](timeout const&) mutable { f(); });
+        }
+
+        dispatch_status result() {  // Dispatches now rather than in the destructor; never throws.
+            chained = true;
+            return finish(run(*this), false);
+        }
+
         ~dispatcher() noexcept(false) { // The destructor might throw exceptions
             if (!chained) {
-                wait_and_dispatch();
+                finish(run(*this), true);
             }
         }
     };
 }
+
+#include "template_dispatcher.h"
@@ -0,0 +1,50 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+namespace messaging {
+    /**
+     * What a receiver does when it finds its mailbox empty.
+     */
+    enum class wait_strategy : std::uint8_t {
+        park,       // Sleeps on the condition variable at once, as receivers always have.
+        adaptive,   // Spins, then yields, then parks, for as long as messages have lately been taking to come.
+    };
+
+    namespace detail {
+        inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+            asm volatile("yield");
+#endif
+        }
+    }
+
+    /**
+     * The budget of an adaptive wait: how long a consumer that finds its mailbox empty keeps looking before it parks.
+     * It follows a moving average of the recent idle gaps, from finding the mailbox empty to the next message: a
+     * receiver answered within microseconds, as in a request/reply ping-pong, looks for about twice that long and is
+     * never put to sleep, saving a futex sleep and wake-up per message; once the gaps grow past max_budget_ns the
+     * budget drops to nothing and the receiver parks at once, as it would without it. Gaps are capped before they are
+     * averaged, so a single long silence is forgotten after a handful of quick messages. Consumer only.
+     */
+    class idle_tuner {
+        static constexpr std::uint64_t gap_cap_ns = 4 * 50'000;
+
+        std::uint64_t average_ns = 10'000;  // Optimistic, so a new receiver tries spinning first.
+
+    public:
+        static constexpr std::uint64_t max_budget_ns = 50'000;
+
+        std::uint64_t budget_ns() const {
+            return average_ns > max_budget_ns ? 0 : std::min(2 * average_ns, max_budget_ns);
+        }
+
+        void record(std::uint64_t gap_ns) {
+            const std::uint64_t gap = std::min(gap_ns, gap_cap_ns);
+            average_ns = average_ns - average_ns / 8 + gap / 8;
+        }
+    };
+}
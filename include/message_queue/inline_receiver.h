@@ -0,0 +1,306 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "dispatcher.h"
+
+namespace messaging {
+    template<typename... Ts>
+    class inline_sender;
+
+    /**
+     * A receiver for a message set known at compile time, whose messages never become nodes. The mailbox is a bounded
+     * ring of slots, each holding a std::variant of the message types (and close_queue); a sender builds its message
+     * straight into a slot and the receiver hands it to its handlers where it lies, through a visitor the compiler
+     * generates for the variant. A message is a few bytes of slot rather than a pooled node with a vtable, a link and
+     * a header, and sending or receiving one touches no allocator at all.
+     *
+     *     messaging::inline_receiver<digit_pressed, cancel_pressed> keys;
+     *     messaging::inline_sender<digit_pressed, cancel_pressed> out = keys;
+     *     out.send(digit_pressed('1'));
+     *     keys.wait(messaging::overload{
+     *         [&](digit_pressed const& msg) { ... },
+     *         [&](cancel_pressed const&) { ... },
+     *     });
+     *
+     * The handlers are one callable, usually an overload of lambdas. A message type it can't be called with is
+     * dropped, as a dispatcher drops a message none of its handlers match, and wait() carries on waiting; a
+     * close_queue it doesn't take ends the wait as closed. Sending a type outside the set doesn't compile.
+     *
+     * What the inline mode leaves out, to stay this small: the ring is one FIFO (control messages don't overtake),
+     * and there is no stash, no statistics and no batch send. The ring is a bounded multi-producer ring with a
+     * sequence per slot, as in shared_mailbox; senders wait, fail or time out when it is full.
+     */
+    template<typename... Ts>
+    class inline_receiver {
+        static_assert(sizeof...(Ts) != 0, "an inline_receiver needs at least one message type");
+
+        using message = std::variant<std::monostate, Ts..., close_queue>;  // monostate: nothing, or a failed send.
+
+        template<typename Msg>
+        static constexpr bool accepts = (std::is_same_v<Msg, Ts> || ...) || std::is_same_v<Msg, close_queue>;
+
+        struct slot {
+            std::atomic<std::uint64_t> sequence;    // pos while free for the sender of pos, pos + 1 once filled.
+            message msg;
+        };
+
+        std::uint64_t const mask;
+        std::unique_ptr<slot[]> slots;
+        bool close_seen = false;        // Consumer only.
+        std::uint64_t read_pos = 0;     // Consumer only.
+
+        alignas(64) std::atomic<std::uint64_t> write_pos{0};
+
+        alignas(64) std::atomic<bool> parked{false};
+        std::atomic<std::uint32_t> senders_waiting{0};
+        std::mutex m;
+        std::condition_variable cv;
+        std::condition_variable space_cv;
+
+        friend class inline_sender<Ts...>;
+
+        slot& slot_at(std::uint64_t pos) const { return slots[pos & mask]; }
+
+        bool claim(std::uint64_t& pos) {
+            pos = write_pos.load(std::memory_order_relaxed);
+            for (; ;) {
+                const auto diff = static_cast<std::int64_t>(slot_at(pos).sequence.load(std::memory_order_acquire) - pos);
+                if (diff == 0) {
+                    if (write_pos.compare_exchange_weak(pos, pos + 1U, std::memory_order_relaxed)) {
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = write_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        template<typename Msg>
+        void fill(std::uint64_t pos, Msg&& msg) {
+            slot& s = slot_at(pos);
+#if MESSAGING_HAS_EXCEPTIONS
+            try {
+                s.msg.template emplace<std::remove_cvref_t<Msg>>(std::forward<Msg>(msg));
+            } catch (...) {
+                s.msg.template emplace<std::monostate>();   // A throwing emplace leaves the variant valueless.
+                publish(s, pos);    // The slot is left empty, for the receiver to skip.
+                throw;
+            }
+#else
+            s.msg.template emplace<std::remove_cvref_t<Msg>>(std::forward<Msg>(msg));
+#endif
+            publish(s, pos);
+        }
+
+        void publish(slot& s, std::uint64_t pos) {
+            s.sequence.store(pos + 1U, std::memory_order_seq_cst);
+            if (parked.load(std::memory_order_seq_cst)) {
+                { std::lock_guard<std::mutex> lk(m); }
+                cv.notify_one();
+            }
+        }
+
+        // Waits for a free slot; `deadline` nullptr waits as long as it takes.
+        bool wait_for_space(std::chrono::steady_clock::time_point const* deadline) {
+            std::unique_lock<std::mutex> lk(m);
+            senders_waiting.fetch_add(1, std::memory_order_seq_cst);
+            auto free = [&] {
+                const std::uint64_t pos = write_pos.load(std::memory_order_seq_cst);
+                return slot_at(pos).sequence.load(std::memory_order_seq_cst) == pos;
+            };
+            bool woken = true;
+            if (deadline == nullptr) {
+                space_cv.wait(lk, free);
+            } else {
+                woken = space_cv.wait_until(lk, *deadline, free);
+            }
+            senders_waiting.fetch_sub(1, std::memory_order_relaxed);
+            return woken;
+        }
+
+        template<typename Msg>
+        bool push(Msg&& msg, bool wait, std::chrono::steady_clock::time_point const* deadline) {
+            static_assert(accepts<std::remove_cvref_t<Msg>>, "not a message type of this inline_receiver");
+            std::uint64_t pos;
+            while (!claim(pos)) {
+                if (!wait || !wait_for_space(deadline)) {
+                    return false;
+                }
+            }
+            fill(pos, std::forward<Msg>(msg));
+            return true;
+        }
+
+        bool ready() const {
+            return slot_at(read_pos).sequence.load(std::memory_order_seq_cst) == read_pos + 1U;
+        }
+
+        // Dispatches the message at read_pos, which is ready, and frees its slot.
+        template<typename Handlers>
+        dispatch_status dispatch_next(Handlers& handlers) {
+            slot& s = slot_at(read_pos);
+            const dispatch_status status = std::visit([&](auto& msg) {
+                using type = std::remove_cvref_t<decltype(msg)>;
+                if constexpr (std::is_invocable_v<Handlers&, type&>) {
+                    handlers(msg);
+                    return dispatch_status::handled;
+                } else if constexpr (std::is_same_v<type, close_queue>) {
+                    return dispatch_status::closed;
+                } else {
+                    return dispatch_status::unhandled;
+                }
+            }, s.msg);
+            s.msg.template emplace<std::monostate>();
+            s.sequence.store(read_pos + mask + 1U, std::memory_order_seq_cst);
+            ++read_pos;
+            if (senders_waiting.load(std::memory_order_seq_cst) != 0) {
+                { std::lock_guard<std::mutex> lk(m); }
+                space_cv.notify_all();
+            }
+            if (status == dispatch_status::closed) {
+                close_seen = true;
+            }
+            return status;
+        }
+
+        // Waits until `deadline` (nullptr: forever) for a message; false if none came.
+        bool wait_until_ready(std::chrono::steady_clock::time_point const* deadline) {
+            if (ready()) {
+                return true;
+            }
+            std::unique_lock<std::mutex> lk(m);
+            parked.store(true, std::memory_order_seq_cst);
+            bool woken = true;
+            if (deadline == nullptr) {
+                cv.wait(lk, [&] { return ready(); });
+            } else {
+                woken = cv.wait_until(lk, *deadline, [&] { return ready(); });
+            }
+            parked.store(false, std::memory_order_relaxed);
+            return woken;
+        }
+
+        template<typename Handlers>
+        dispatch_status wait_and_dispatch(Handlers& handlers, std::chrono::steady_clock::time_point const* deadline) {
+            for (; ;) {
+                if (!wait_until_ready(deadline)) {
+                    return dispatch_status::timed_out;
+                }
+                const dispatch_status status = dispatch_next(handlers);
+                if (status != dispatch_status::unhandled) {
+                    return status;
+                }
+            }
+        }
+
+    public:
+        // `capacity`, a power of two, is the most messages the mailbox holds.
+        explicit inline_receiver(std::size_t capacity = 1024) : mask(capacity - 1U), slots(new slot[capacity]) {
+            if (capacity == 0 || (capacity & mask) != 0) {
+                std::fprintf(stderr, "messaging: inline_receiver capacity %zu is not a power of two\n", capacity);
+                std::abort();
+            }
+            for (std::size_t i = 0; i < capacity; ++i) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        inline_receiver(inline_receiver const&) = delete;
+        inline_receiver& operator=(inline_receiver const&) = delete;
+
+        operator inline_sender<Ts...>() { return inline_sender<Ts...>(this); }
+
+        // Dispatches the next message the handlers take, dropping the ones they don't; closed when a close_queue
+        // they don't take comes first.
+        template<typename Handlers>
+        dispatch_status wait(Handlers&& handlers) {
+            return wait_and_dispatch(handlers, nullptr);
+        }
+
+        // As wait(), but timed_out once `timeout` has passed.
+        template<typename Rep, typename Period, typename Handlers>
+        dispatch_status wait_for(std::chrono::duration<Rep, Period> const& timeout, Handlers&& handlers) {
+            const auto deadline = std::chrono::steady_clock::now() +
+                                  std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+            return wait_and_dispatch(handlers, &deadline);
+        }
+
+        // Dispatches one message if there is one, whether the handlers take it or not; timed_out if there is none.
+        template<typename Handlers>
+        dispatch_status try_dispatch(Handlers&& handlers) {
+            return ready() ? dispatch_next(handlers) : dispatch_status::timed_out;
+        }
+
+        // Calls `body` until a close_queue has ended a wait, as receiver::run_until_closed() does.
+        template<typename Body>
+        void run_until_closed(Body&& body) {
+            while (!close_seen) {
+                body();
+            }
+        }
+
+        bool closed() const { return close_seen; }
+        std::size_t capacity() const { return mask + 1U; }
+    };
+
+    /**
+     * A reference to an inline_receiver's mailbox, copied around like sender. It only sends the receiver's own
+     * message types (and close_queue); anything else fails to compile.
+     */
+    template<typename... Ts>
+    class inline_sender {
+        inline_receiver<Ts...>* target = nullptr;
+
+        friend class inline_receiver<Ts...>;
+
+        explicit inline_sender(inline_receiver<Ts...>* target_) : target(target_) {}
+
+    public:
+        inline_sender() = default;
+
+        template<typename Message>
+        void send(Message&& msg) {      // Waits while the mailbox is full.
+            if (target != nullptr) {
+                target->push(std::forward<Message>(msg), true, nullptr);
+            }
+        }
+
+        template<typename Message>
+        bool try_send(Message&& msg) {  // Fails at once instead.
+            return target != nullptr && target->push(std::forward<Message>(msg), false, nullptr);
+        }
+
+        template<typename Message, typename Rep, typename Period>
+        bool send_for(Message&& msg, std::chrono::duration<Rep, Period> const& timeout) {
+            const auto deadline = std::chrono::steady_clock::now() +
+                                  std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+            return target != nullptr && target->push(std::forward<Message>(msg), true, &deadline);
+        }
+    };
+
+    /**
+     * Handlers for inline_receiver::wait(), one lambda per message type:
+     *
+     *     keys.wait(messaging::overload{[&](digit_pressed const&) { ... }, [&](cancel_pressed const&) { ... }});
+     */
+    template<typename... Fs>
+    struct overload : Fs... {
+        using Fs::operator()...;
+    };
+
+    template<typename... Fs>
+    overload(Fs...) -> overload<Fs...>;
+}
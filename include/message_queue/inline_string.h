@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace messaging {
+    /**
+     * A string of at most Capacity characters held inside the object, for the short text fields of messages: account
+     * numbers, PINs, codes. It never allocates and is trivially copyable, so a message built from such fields moves into
+     * its node as a copy of a few bytes, and can be sent to an external mailbox. It is built implicitly from anything
+     * that converts to std::string_view, and converts back to one. Text longer than Capacity is a programming error and
+     * ends the program.
+     */
+    template<std::size_t Capacity>
+    class inline_string {
+        static_assert(Capacity != 0 && Capacity < 256, "an inline_string holds from 1 to 255 characters");
+
+        char chars[Capacity] = {};
+        std::uint8_t length = 0;
+
+        [[noreturn]] static void too_long(std::string_view s) {
+            std::fprintf(stderr, "messaging: \"%.*s\" does not fit an inline_string of %zu characters\n",
+                         static_cast<int>(s.size()), s.data(), Capacity);
+            std::abort();
+        }
+
+    public:
+        inline_string() = default;
+
+        template<typename S>
+            requires (!std::is_same_v<S, inline_string> && std::is_convertible_v<S const&, std::string_view>)
+        inline_string(S const& s) {
+            assign(s);
+        }
+
+        void assign(std::string_view s) {
+            if (s.size() > Capacity) {
+                too_long(s);
+            }
+            std::copy(s.begin(), s.end(), chars);
+            length = static_cast<std::uint8_t>(s.size());
+        }
+
+        void push_back(char c) {
+            if (length == Capacity) {
+                too_long(view());
+            }
+            chars[length++] = c;
+        }
+
+        void pop_back() { --length; }
+        void clear() { length = 0; }
+
+        std::size_t size() const { return length; }
+        bool empty() const { return length == 0; }
+        static constexpr std::size_t capacity() { return Capacity; }
+        char const* data() const { return chars; }  // Not null-terminated.
+
+        std::string_view view() const { return {chars, length}; }
+        operator std::string_view() const { return view(); }
+        std::string str() const { return std::string(view()); }
+
+        friend bool operator==(inline_string const& a, std::string_view b) { return a.view() == b; }
+    };
+}
+
+template<std::size_t Capacity>
+struct std::hash<messaging::inline_string<Capacity>> {
+    std::size_t operator()(messaging::inline_string<Capacity> const& s) const noexcept {
+        return std::hash<std::string_view>{}(s.view());
+    }
+};
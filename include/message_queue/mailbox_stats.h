@@ -0,0 +1,188 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "type_id.h"
+
+namespace messaging {
+    /**
+     * What became of a dispatched message, as far as the statistics go. A close_queue counts as handled.
+     */
+    enum class dispatch_outcome : std::uint8_t {
+        handled,
+        dropped,    // No handler matched it and the receiver doesn't stash.
+        stashed,
+    };
+
+    /**
+     * A copy of a latency_histogram. Bucket b counts the samples of [2^b, 2^(b+1)) nanoseconds (bucket 0 also takes
+     * 0 ns), so a percentile is known to within a factor of two.
+     */
+    struct histogram_snapshot {
+        static constexpr std::size_t bucket_count = 48;   // Up to about three days.
+
+        std::array<std::uint64_t, bucket_count> buckets{};
+        std::uint64_t count = 0;
+        std::uint64_t sum_ns = 0;
+        std::uint64_t max_ns = 0;
+
+        double mean_ns() const { return count == 0 ? 0.0 : static_cast<double>(sum_ns) / static_cast<double>(count); }
+
+        // Upper bound of the bucket holding the p-th fraction (0..1) of the samples.
+        std::uint64_t percentile_ns(double p) const {
+            const auto rank = static_cast<std::uint64_t>(p * static_cast<double>(count));
+            std::uint64_t seen = 0;
+            for (std::size_t b = 0; b < bucket_count; ++b) {
+                seen += buckets[b];
+                if (seen > rank) {
+                    return std::min(max_ns, (std::uint64_t{2} << b) - 1U);
+                }
+            }
+            return max_ns;
+        }
+    };
+
+    /**
+     * Log2 histogram of durations with a single writer: recording is a handful of relaxed loads and stores, with no
+     * read-modify-write, and any thread may take a snapshot at any time.
+     */
+    class latency_histogram {
+        std::array<std::atomic<std::uint64_t>, histogram_snapshot::bucket_count> buckets{};
+        std::atomic<std::uint64_t> count{0};
+        std::atomic<std::uint64_t> sum_ns{0};
+        std::atomic<std::uint64_t> max_ns{0};
+
+        static void bump(std::atomic<std::uint64_t>& a, std::uint64_t by = 1) {
+            a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+
+    public:
+        void record(std::uint64_t ns) {
+            const std::size_t b = ns == 0 ? 0 : std::min<std::size_t>(std::bit_width(ns) - 1U, buckets.size() - 1U);
+            bump(buckets[b]);
+            bump(count);
+            bump(sum_ns, ns);
+            if (ns > max_ns.load(std::memory_order_relaxed)) {
+                max_ns.store(ns, std::memory_order_relaxed);
+            }
+        }
+
+        histogram_snapshot snapshot() const {
+            histogram_snapshot s;
+            for (std::size_t b = 0; b < buckets.size(); ++b) {
+                s.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+            }
+            s.count = count.load(std::memory_order_relaxed);
+            s.sum_ns = sum_ns.load(std::memory_order_relaxed);
+            s.max_ns = max_ns.load(std::memory_order_relaxed);
+            return s;
+        }
+    };
+
+    struct message_type_counts {
+        message_type_id type_id = 0;
+        std::uint64_t handled = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t stashed = 0;
+    };
+
+    /**
+     * A consistent-enough picture of one mailbox, taken by queue::snapshot(): every figure is read atomically, but the
+     * figures are not read all at the same instant.
+     */
+    struct mailbox_snapshot {
+        std::size_t depth = 0;
+        std::size_t high_water_mark = 0;
+        std::size_t stashed = 0;                // Messages in the stash now.
+        histogram_snapshot sojourn;             // From send to the start of dispatch.
+        histogram_snapshot handler_time;        // Handled messages only.
+        std::vector<message_type_counts> types; // In no particular order.
+        message_type_counts other_types;        // Types that found the table full; type_id 0.
+    };
+
+    /**
+     * The statistics a queue keeps once queue::enable_stats() has been called. Only the consumer records (the receiver's
+     * thread, or whichever worker is running the actor), so every counter has a single writer and recording needs no
+     * lock, no read-modify-write and no allocation. Message types get a slot in a fixed open-addressing table the first
+     * time they are seen; once it is full, further types are lumped together.
+     */
+    class mailbox_stats {
+    public:
+        static constexpr std::size_t type_slots = 64;
+
+        void record(message_type_id type_id, dispatch_outcome outcome, std::uint64_t sojourn_ns, bool has_sojourn,
+                    std::uint64_t handler_ns) {
+            if (has_sojourn) {
+                sojourn.record(sojourn_ns);
+            }
+            type_counter& c = counter_for(type_id);
+            switch (outcome) {
+                case dispatch_outcome::handled:
+                    handler_time.record(handler_ns);
+                    bump(c.handled);
+                    break;
+                case dispatch_outcome::dropped:
+                    bump(c.dropped);
+                    break;
+                case dispatch_outcome::stashed:
+                    bump(c.stashed);
+                    break;
+            }
+        }
+
+        void fill(mailbox_snapshot& s) const {
+            s.sojourn = sojourn.snapshot();
+            s.handler_time = handler_time.snapshot();
+            for (auto const& c : types) {
+                const message_type_id id = c.type_id.load(std::memory_order_acquire);
+                if (id != 0) {
+                    s.types.push_back(c.read(id));
+                }
+            }
+            s.other_types = other.read(0);
+        }
+
+    private:
+        struct type_counter {
+            std::atomic<message_type_id> type_id{0};
+            std::atomic<std::uint64_t> handled{0};
+            std::atomic<std::uint64_t> dropped{0};
+            std::atomic<std::uint64_t> stashed{0};
+
+            message_type_counts read(message_type_id id) const {
+                return {id, handled.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed),
+                        stashed.load(std::memory_order_relaxed)};
+            }
+        };
+
+        latency_histogram sojourn;
+        latency_histogram handler_time;
+        std::array<type_counter, type_slots> types{};
+        type_counter other;
+
+        static void bump(std::atomic<std::uint64_t>& a) {
+            a.store(a.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+        }
+
+        type_counter& counter_for(message_type_id type_id) {
+            const std::size_t home = static_cast<std::size_t>((type_id * 0x9e3779b97f4a7c15ULL) >> 58U);
+            for (std::size_t i = 0; i < type_slots; ++i) {
+                type_counter& c = types[(home + i) % type_slots];
+                const message_type_id id = c.type_id.load(std::memory_order_relaxed);
+                if (id == type_id) {
+                    return c;
+                }
+                if (id == 0) {
+                    c.type_id.store(type_id, std::memory_order_release);
+                    return c;
+                }
+            }
+            return other;
+        }
+    };
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace messaging {
+    /**
+     * Per-receiver allocator for message nodes. Nodes come in a few size classes; each class keeps a free list of
+     * blocks carved from chunks, and a block goes back on its list as soon as its message has been dispatched. Once the
+     * lists hold as many blocks as the receiver ever had in flight, sending allocates nothing. A class's first chunk is
+     * small and each further one twice as big, up to 16 KiB, so a mailbox that rarely holds more than a message or two
+     * (one of many thousands of actors, say) costs a kilobyte rather than a page per class. Chunks are only released
+     * when the pool is destroyed.
+     *
+     * Any thread may allocate (senders) and any thread may deallocate (the receiver after dispatch). The free lists are
+     * guarded by a spinlock held for a couple of pointer moves, never across an allocation from the system. Messages
+     * larger than the biggest class, or more aligned than a block, are allocated with operator new, at the alignment
+     * they ask for; the caller hands the same alignment back to deallocate().
+     */
+    class message_pool {
+    public:
+        static constexpr std::size_t class_count = 4;
+        static constexpr std::uint8_t heap_class = 0xFF;   // Not from the pool.
+        static constexpr std::uint8_t view_class = 0xFE;   // Not a node at all: a message_view (message_queue.h).
+        static constexpr std::size_t block_alignment = 64;
+
+        message_pool() = default;
+        message_pool(message_pool const&) = delete;
+        message_pool& operator=(message_pool const&) = delete;
+
+        ~message_pool() {
+            for (auto& c : classes) {
+                while (chunk* ch = c.chunks) {
+                    c.chunks = ch->next;
+                    ::operator delete(ch, std::align_val_t{block_alignment});
+                }
+            }
+        }
+
+        static constexpr std::size_t block_size(std::size_t size_class) {
+            return std::size_t{64} << size_class;   // 64, 128, 256, 512 bytes.
+        }
+
+        static constexpr std::uint8_t size_class_of(std::size_t size, std::size_t alignment) {
+            if (alignment <= block_alignment) {
+                for (std::size_t c = 0; c < class_count; ++c) {
+                    if (size <= block_size(c)) {
+                        return static_cast<std::uint8_t>(c);
+                    }
+                }
+            }
+            return heap_class;
+        }
+
+        void* allocate(std::uint8_t size_class, std::size_t size, std::size_t alignment) {
+            if (size_class == heap_class) {
+                return ::operator new(size, std::align_val_t{alignment});
+            }
+            auto& c = classes[size_class];
+            c.lock();
+            free_block* block = c.free;
+            if (block != nullptr) {
+                c.free = block->next;
+            }
+            c.unlock();
+            return block != nullptr ? block : grow(size_class);
+        }
+
+        void deallocate(void* p, std::uint8_t size_class, std::size_t alignment) noexcept {
+            if (size_class == heap_class) {
+                ::operator delete(p, std::align_val_t{alignment});
+                return;
+            }
+            auto& c = classes[size_class];
+            auto* block = static_cast<free_block*>(p);
+            c.lock();
+            block->next = c.free;
+            c.free = block;
+            c.unlock();
+        }
+
+        // Blocks obtained from the system so far, over all classes.
+        std::size_t blocks_allocated() const {
+            std::size_t total = 0;
+            for (auto const& c : classes) {
+                total += c.blocks.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+    private:
+        static constexpr std::size_t first_chunk_bytes = 1024;
+        static constexpr std::size_t max_chunk_bytes = 16 * 1024;
+
+        struct free_block {
+            free_block* next;
+        };
+
+        struct chunk {
+            chunk* next;
+        };
+
+        struct alignas(64) size_class_list {
+            std::atomic_flag busy = ATOMIC_FLAG_INIT;
+            free_block* free = nullptr;
+            chunk* chunks = nullptr;
+            std::size_t next_chunk_bytes = first_chunk_bytes;
+            std::atomic<std::size_t> blocks{0};
+
+            void lock() {
+                while (busy.test_and_set(std::memory_order_acquire)) {
+                    while (busy.test(std::memory_order_relaxed)) {
+                    }
+                }
+            }
+            void unlock() { busy.clear(std::memory_order_release); }
+        };
+
+        // Carves a new chunk outside the lock, keeps its first block and hands the rest to the free list.
+        void* grow(std::uint8_t size_class) {
+            auto& c = classes[size_class];
+            const std::size_t size = block_size(size_class);
+            c.lock();
+            const std::size_t bytes = c.next_chunk_bytes;
+            c.next_chunk_bytes = bytes < max_chunk_bytes ? bytes * 2 : bytes;
+            c.unlock();
+            const std::size_t count = bytes / size - 1;     // The first block-sized slot holds the chunk header.
+            auto* base = static_cast<char*>(::operator new(bytes, std::align_val_t{block_alignment}));
+            auto* ch = new (base) chunk{nullptr};
+
+            free_block* first = nullptr;
+            for (std::size_t i = count; i > 1; --i) {
+                first = new (base + i * size) free_block{first};
+            }
+            auto* last = count > 1 ? reinterpret_cast<free_block*>(base + count * size) : nullptr;
+
+            c.lock();
+            ch->next = c.chunks;
+            c.chunks = ch;
+            if (last != nullptr) {
+                last->next = c.free;
+                c.free = first;
+            }
+            c.unlock();
+            c.blocks.fetch_add(count, std::memory_order_relaxed);
+            return base + size;
+        }
+
+        size_class_list classes[class_count];
+    };
+}
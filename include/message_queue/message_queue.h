@@ -1,40 +1,818 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
+#include <ranges>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "idle_wait.h"
+#include "mailbox_stats.h"
+#include "message_pool.h"
+#include "type_id.h"
+
+// Whether this translation unit is built with exceptions. Without them, allocation failure ends the program and a
+// closed queue is only ever reported through dispatch_status, never by throwing close_queue.
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define MESSAGING_HAS_EXCEPTIONS 1
+#else
+#define MESSAGING_HAS_EXCEPTIONS 0
+#endif
 
 namespace messaging {
     struct message_base {   // Base class of queue entries.
+        message_type_id const type_id;  // Lets dispatchers identify the message without RTTI.
+        std::atomic<message_base*> next{nullptr};   // Intrusive link while the message sits in a queue.
+        message_pool* pool = nullptr;   // Where the node goes back to after dispatch; nullptr for plain new.
+        std::uint8_t size_class = message_pool::heap_class;
+        std::uint8_t alignment_log2 = 0;    // Of the node, which a heap_class node is freed with.
+        std::uint64_t sent_at_ns = 0;   // steady_clock time of the send, if the receiver keeps statistics; else 0.
+
+        explicit message_base(message_type_id type_id_) : type_id(type_id_) {}
         virtual ~message_base() = default;
     };
 
     template<typename Msg>
-    struct wrapped_message_base : message_base {
+    struct wrapped_message : message_base {
         Msg contents;
 
-        explicit wrapped_message_base(Msg contents_) : contents(contents_) {}
+        template<typename... Args>  // Builds the message in the node, from whatever its constructor takes.
+        explicit wrapped_message(std::in_place_t, Args&&... args)
+            : message_base(type_id_of<Msg>), contents(std::forward<Args>(args)...) {}
     };   // Each message type has a specialization
 
+    /**
+     * A message that is read where it was received, in a slot of a shared_mailbox or a node shared by every
+     * subscription to a bus, instead of being copied into a node of its own. Destroying the view hands its storage
+     * back.
+     */
+    struct message_view : message_base {
+        void* const payload;
+
+        message_view(message_type_id type_id_, void* payload_) : message_base(type_id_), payload(payload_) {
+            size_class = message_pool::view_class;
+        }
+
+        virtual void release() noexcept = 0;    // Called by message_deleter instead of destroying the view.
+    };
+
+    /**
+     * Downcast of a message whose type_id has already been checked against Msg.
+     */
+    template<typename Msg>
+    Msg& message_cast(message_base& msg) {
+        if (msg.size_class == message_pool::view_class) {
+            if constexpr (std::is_trivially_copyable_v<Msg>) {
+                return *std::launder(static_cast<Msg*>(static_cast<message_view&>(msg).payload));
+            } else {
+                return *static_cast<Msg*>(static_cast<message_view&>(msg).payload);  // A live object, on a bus.
+            }
+        }
+        return static_cast<wrapped_message<Msg>&>(msg).contents;
+    }
+
+    /**
+     * Destroys a message and recycles its node into the pool it came from.
+     */
+    struct message_deleter {
+        void operator()(message_base* msg) const noexcept {
+            if (msg->size_class == message_pool::view_class) {
+                static_cast<message_view*>(msg)->release();
+                return;
+            }
+            message_pool* pool = msg->pool;
+            if (pool == nullptr) {
+                delete msg;
+                return;
+            }
+            const std::uint8_t size_class = msg->size_class;
+            const std::size_t alignment = std::size_t{1} << msg->alignment_log2;
+            msg->~message_base();
+            pool->deallocate(msg, size_class, alignment);
+        }
+    };
+
+    using message_ptr = std::unique_ptr<message_base, message_deleter>;   // Sole owner of a queued message.
+
+    /**
+     * Builds a Msg from `args` in a node taken from `pool`; the message is constructed once, where it will be read.
+     */
+    template<typename Msg, typename... Args>
+    message_ptr emplace_message(message_pool& pool, Args&&... args) {
+        using node = wrapped_message<Msg>;
+        constexpr std::uint8_t size_class = message_pool::size_class_of(sizeof(node), alignof(node));
+        void* memory = pool.allocate(size_class, sizeof(node), alignof(node));
+        node* wrapped;
+#if MESSAGING_HAS_EXCEPTIONS
+        try {
+            wrapped = new (memory) node(std::in_place, std::forward<Args>(args)...);
+        } catch (...) {
+            pool.deallocate(memory, size_class, alignof(node));
+            throw;
+        }
+#else
+        wrapped = new (memory) node(std::in_place, std::forward<Args>(args)...);
+#endif
+        wrapped->pool = &pool;
+        wrapped->size_class = size_class;
+        wrapped->alignment_log2 = static_cast<std::uint8_t>(std::countr_zero(alignof(node)));
+        return message_ptr(wrapped);
+    }
+
+    /**
+     * Wraps `msg` in a node taken from `pool`: moved in when it is an rvalue, copied only when it is an lvalue.
+     */
+    template<typename Msg>
+    message_ptr make_message(message_pool& pool, Msg&& msg) {
+        return emplace_message<std::remove_cvref_t<Msg>>(pool, std::forward<Msg>(msg));
+    }
+
+    class close_queue   // The message for closing the queue.
+    {};
+
+    /**
+     * Every mailbox has a small, fixed set of lanes, and the receiver always takes from the lowest lane that has
+     * anything in it. Messages travel in the data lane unless their type is marked as a control message, which is done
+     * at compile time by specialising is_control_message:
+     *
+     *     template<> struct messaging::is_control_message<cancel_pressed> : std::true_type {};
+     *
+     * A control message overtakes every data message already queued, so shutdown and cancellation are handled after at
+     * most the message being dispatched, however long the backlog. Within a lane, messages keep the order they were sent
+     * in. Control messages are not held back by a bounded mailbox either; they are meant to be rare, and a full mailbox
+     * is exactly when a close or a cancel has to get through.
+     */
+    enum class lane : std::uint8_t {
+        control = 0,
+        data = 1,
+    };
+
+    inline constexpr std::size_t lane_count = 2;
+
+    template<typename Msg>
+    struct is_control_message : std::false_type {};
+
+    template<>
+    struct is_control_message<close_queue> : std::true_type {};
+
+    template<typename Msg>
+    inline constexpr lane lane_of = is_control_message<std::remove_cv_t<Msg>>::value ? lane::control : lane::data;
+
+    /**
+     * The messages a receiver has put aside because the chain waiting at the time had no handler for them (see
+     * receiver::stash_unmatched()). They are kept per message type, each with its place in the order of arrival, so a
+     * chain only looks at the types it handles: offering the stash to the next chain costs a lookup per handler, not a
+     * pass over the backlog, and the oldest message the chain handles comes out first. Consumer only.
+     */
+    class message_stash {
+        struct entry {
+            std::uint64_t order;
+            message_ptr msg;
+        };
+
+        struct bucket {
+            message_type_id type_id;
+            std::vector<entry> entries;     // A FIFO from `head` on; emptied once everything has been taken.
+            std::size_t head = 0;
+
+            bool empty() const { return head == entries.size(); }
+        };
+
+        std::vector<bucket> buckets;    // One per message type ever stashed; few, so searched linearly.
+        std::uint64_t next_order = 0;
+        std::atomic<std::size_t> count{0};  // Written by the consumer only; read by snapshots on any thread.
+
+    public:
+        bool empty() const { return size() == 0; }
+        std::size_t size() const { return count.load(std::memory_order_relaxed); }
+
+        void put(message_ptr msg) {
+            const message_type_id type_id = msg->type_id;
+            auto it = std::find_if(buckets.begin(), buckets.end(), [&](bucket const& b) { return b.type_id == type_id; });
+            if (it == buckets.end()) {
+                it = buckets.insert(buckets.end(), bucket{type_id, {}, 0});
+            }
+            it->entries.push_back(entry{next_order++, std::move(msg)});
+            count.store(size() + 1U, std::memory_order_relaxed);
+        }
+
+        // Takes the oldest stashed message whose type is one of `type_ids`, or returns nullptr.
+        template<std::size_t N>
+        message_ptr take_oldest(std::array<message_type_id, N> const& type_ids) {
+            bucket* oldest = nullptr;
+            for (auto& b : buckets) {
+                if (!b.empty() && (oldest == nullptr || b.entries[b.head].order < oldest->entries[oldest->head].order) &&
+                    std::find(type_ids.begin(), type_ids.end(), b.type_id) != type_ids.end()) {
+                    oldest = &b;
+                }
+            }
+            if (oldest == nullptr) {
+                return nullptr;
+            }
+            message_ptr msg = std::move(oldest->entries[oldest->head++].msg);
+            if (oldest->empty()) {
+                oldest->entries.clear();
+                oldest->head = 0;
+            }
+            count.store(size() - 1U, std::memory_order_relaxed);
+            return msg;
+        }
+    };
+
+    /**
+     * What a mailbox wakes instead of a parked thread when it is owned, as an actor's mailbox is: the actor scheduler
+     * uses it to make the actor runnable. Called by the sender whose message ends an idle spell of the mailbox, once
+     * per spell.
+     */
+    class mailbox_owner {
+    public:
+        virtual void mailbox_ready() noexcept = 0;
+
+    protected:
+        ~mailbox_owner() = default;
+    };
+
+    /**
+     * A mailbox whose messages are kept outside the queue, such as a shared_mailbox that other processes send to. It
+     * only carries trivially copyable messages, as raw bytes tagged with their type id. A queue handed one with
+     * set_external() takes every message from it, so the dispatchers and receiver::wait() work on it unchanged; a
+     * remote_sender made from one copies the bytes of each message straight into it.
+     */
+    class external_mailbox {
+    public:
+        static constexpr std::size_t payload_alignment = 64;    // Payloads are stored at least this aligned.
+
+        // Producer side. Return false when the mailbox stays full: at once for try_push_bytes(), or at `deadline`
+        // (nullptr: never) for push_bytes().
+        virtual bool try_push_bytes(message_type_id type_id, void const* payload, std::size_t size) = 0;
+        virtual bool push_bytes(message_type_id type_id, void const* payload, std::size_t size,
+                                std::chrono::steady_clock::time_point const* deadline) = 0;
+
+        // Consumer side. Waits for a message until `deadline` (nullptr: forever) if `wait` is set.
+        virtual message_ptr pop(bool wait, std::chrono::steady_clock::time_point const* deadline) = 0;
+
+    protected:
+        ~external_mailbox() = default;
+    };
+
+    /**
+     * Each lane is an intrusive multi-producer/single-consumer list (Vyukov's MPSC queue): a sender links its node in
+     * with one exchange on the tail and one store, and the receiver's thread, the only consumer, unlinks from the head
+     * without any read-modify-write. Nodes come from the receiver's own message_pool and return to it once the
+     * dispatcher is done with them, so a receiver in steady state does no heap allocation at all.
+     *
+     * The consumer parks only when it finds every lane empty. It raises `parked` and re-checks the tails before
+     * sleeping; a sender checks `parked` after linking its node. Both sides use sequentially consistent operations, so
+     * at least one of them sees the other: either the consumer finds the message or the sender sees it parked and wakes
+     * it. The mutex and condition variable are therefore only touched on the empty to non-empty transition of an idle
+     * receiver. With wait_strategy::adaptive the consumer first keeps looking for a while, spinning and then yielding,
+     * for as long as its idle_tuner expects the next message to take. A queue with an owner is never waited on: its
+     * consumer parks it with park() when it runs out of messages, and the sender that finds it parked claims the flag
+     * back and calls the owner.
+     *
+     * A queue may be bounded. A sender then reserves one unit of `depth` before it allocates, and push, try_push and
+     * push_until differ only in what they do when the queue is full: wait for the receiver, fail at once, or wait up to
+     * a deadline. Waiting senders use the same flag-then-recheck handshake as the consumer, on `senders_waiting`, so the
+     * receiver only signals space when someone is actually waiting for it. `depth` is counted for unbounded queues and
+     * for control messages too, which is what the high-water mark is taken from.
+     *
+     * Both ends can work in batches. push_batch builds a chain of nodes and splices it in with a single exchange, after
+     * a single reservation, and the consumer drains everything that is pending in a lane (up to max_drain nodes) into
+     * that lane's private FIFO, from which wait_and_pop hands them out after one look at the control lane. In an
+     * unbounded queue, where `depth` only feeds the high-water mark, the drained depth is released with one atomic. A
+     * bounded queue releases each message's unit as it hands the message out, so it never holds more than `capacity`
+     * undispatched messages, the private FIFO included.
+     */
     class queue {       // Message Queue
+        struct mpsc_lane {
+            alignas(64) std::atomic<message_base*> tail;    // Producer side.
+
+            alignas(64) message_base* head;                 // Consumer side.
+            message_base* drained_head = nullptr;           // Private FIFO filled by drain().
+            message_base* drained_tail = nullptr;
+            message_base stub{0};   // Always in the list when it is empty, so push never has to handle a null tail.
+
+            mpsc_lane() : tail(&stub), head(&stub) {}
+        };
+
+        message_pool pool;  // Declared first: outlives every node still linked below.
+
+        std::size_t const capacity;     // 0: unbounded.
+        mailbox_owner* owner = nullptr;
+        external_mailbox* external = nullptr;
+        bool close_seen = false;        // Consumer only: a close_queue has been dispatched.
+        bool throw_on_close = MESSAGING_HAS_EXCEPTIONS;  // Consumer only: see set_close_throws().
+        bool stash_on_miss = false;     // Consumer only: see set_stash_unmatched().
+        message_stash stashed;          // Consumer only.
+        std::unique_ptr<mailbox_stats> recorder;    // See enable_stats().
+        std::atomic<bool> stamping{false};          // Senders time-stamp their messages.
+        wait_strategy strategy = wait_strategy::park;   // Consumer only, as is `idle`.
+        idle_tuner idle;
+
+        alignas(64) std::atomic<bool> parked{false};
+
+        alignas(64) std::atomic<std::size_t> depth{0};  // Reserved by senders, released by the consumer.
+        std::atomic<std::size_t> high_water{0};
+        std::atomic<std::size_t> senders_waiting{0};
+
+        mpsc_lane lanes[lane_count];    // Indexed by lane; the consumer looks at them in that order.
         std::mutex m;
         std::condition_variable cv;
-        std::queue<std::shared_ptr<message_base>> q; // Actual queue stores pointers to message base.
+        std::condition_variable space_cv;
+
+        bool try_reserve(lane l, std::size_t n = 1) {
+            std::size_t d;
+            if (capacity == 0 || l == lane::control) {
+                d = depth.fetch_add(n, std::memory_order_seq_cst);
+            } else {
+                // seq_cst loads, failed exchanges included: a waiting sender's senders_waiting increment and its
+                // "full" reading of depth pair with unreserve()'s decrement and senders_waiting load, so one of the
+                // two always sees the other and no room is freed without a wake-up.
+                d = depth.load(std::memory_order_seq_cst);
+                do {
+                    if (d + n > capacity) {
+                        return false;
+                    }
+                } while (!depth.compare_exchange_weak(d, d + n, std::memory_order_seq_cst));
+            }
+            std::size_t mark = high_water.load(std::memory_order_relaxed);
+            while (d + n > mark && !high_water.compare_exchange_weak(mark, d + n, std::memory_order_relaxed)) {
+            }
+            return true;
+        }
+
+        // Waits for room for `n` messages in a bounded queue; `deadline` nullptr waits as long as it takes.
+        bool reserve(lane l, std::chrono::steady_clock::time_point const* deadline, std::size_t n = 1) {
+            if (try_reserve(l, n)) {
+                return true;
+            }
+            std::unique_lock<std::mutex> lk(m);
+            senders_waiting.fetch_add(1, std::memory_order_seq_cst);
+            bool reserved = true;
+            while (!try_reserve(l, n)) {
+                if (deadline == nullptr) {
+                    space_cv.wait(lk);
+                } else if (space_cv.wait_until(lk, *deadline) == std::cv_status::timeout) {
+                    reserved = try_reserve(l, n);
+                    break;
+                }
+            }
+            senders_waiting.fetch_sub(1, std::memory_order_relaxed);
+            return reserved;
+        }
+
+        void unreserve(std::size_t n = 1) {
+            depth.fetch_sub(n, std::memory_order_seq_cst);
+            if (senders_waiting.load(std::memory_order_seq_cst) != 0) {
+                { std::lock_guard<std::mutex> lk(m); }
+                space_cv.notify_all();  // Waiters may want different amounts of room.
+            }
+        }
+
+        // Builds the node for a reserved unit of depth and links it into the lane of its type.
+        template<typename Msg, typename... Args>
+        void enqueue_reserved(Args&&... args) {
+            message_base* node;
+#if MESSAGING_HAS_EXCEPTIONS
+            try {
+                node = emplace_message<Msg>(pool, std::forward<Args>(args)...).release();
+            } catch (...) {
+                unreserve();
+                throw;
+            }
+#else
+            node = emplace_message<Msg>(pool, std::forward<Args>(args)...).release();
+#endif
+            enqueue(lanes[static_cast<std::size_t>(lane_of<Msg>)], node, node);
+        }
+
+        // Links the chain first..last (already linked through `next`) into `l` with one exchange.
+        void enqueue(mpsc_lane& l, message_base* first, message_base* last) {
+            if (stamping.load(std::memory_order_relaxed)) {
+                const std::uint64_t now = steady_now_ns();
+                for (message_base* node = first; ; node = node->next.load(std::memory_order_relaxed)) {
+                    node->sent_at_ns = now;
+                    if (node == last) {
+                        break;
+                    }
+                }
+            }
+            last->next.store(nullptr, std::memory_order_relaxed);
+            message_base* prev = l.tail.exchange(last, std::memory_order_seq_cst);
+            prev->next.store(first, std::memory_order_release);  // Until this store the consumer sees a gap.
+            if (parked.load(std::memory_order_seq_cst)) {
+                wake();
+            }
+        }
+
+        void wake() {
+            if (owner != nullptr) {
+                if (parked.exchange(false, std::memory_order_seq_cst)) {    // Only one sender gets to call the owner.
+                    owner->mailbox_ready();
+                }
+                return;
+            }
+            { std::lock_guard<std::mutex> lk(m); }
+            cv.notify_one();
+        }
+
+        // Consumer only. Returns nullptr when the lane is empty or when a sender has claimed the tail but not linked
+        // its node yet.
+        static message_base* try_pop_node(mpsc_lane& l) {
+            message_base* h = l.head;
+            message_base* next = h->next.load(std::memory_order_acquire);
+            if (h == &l.stub) {
+                if (next == nullptr) {
+                    return nullptr;
+                }
+                l.head = next;
+                h = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if (next != nullptr) {
+                l.head = next;
+                return h;
+            }
+            if (h != l.tail.load(std::memory_order_acquire)) {
+                return nullptr;     // A push is in flight behind h.
+            }
+            enqueue_stub(l);
+            next = h->next.load(std::memory_order_acquire);
+            if (next != nullptr) {
+                l.head = next;
+                return h;
+            }
+            return nullptr;
+        }
+
+        // Re-links the stub behind the last node, so that node can be handed out.
+        static void enqueue_stub(mpsc_lane& l) {
+            l.stub.next.store(nullptr, std::memory_order_relaxed);
+            message_base* prev = l.tail.exchange(&l.stub, std::memory_order_seq_cst);
+            prev->next.store(&l.stub, std::memory_order_release);
+        }
+
+        bool empty() const {
+            for (auto const& l : lanes) {
+                if (l.head != &l.stub || l.tail.load(std::memory_order_seq_cst) != &l.stub) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Consumer only. Moves what is pending in `l` to its private FIFO; an unbounded queue releases its depth at once.
+        std::size_t drain(mpsc_lane& l) {
+            std::size_t n = 0;
+            while (n < max_drain) {
+                message_base* node = try_pop_node(l);
+                if (node == nullptr) {
+                    break;
+                }
+                // Once popped, a node's link is only ever touched by the consumer.
+                node->next.store(nullptr, std::memory_order_relaxed);
+                if (l.drained_tail != nullptr) {
+                    l.drained_tail->next.store(node, std::memory_order_relaxed);
+                } else {
+                    l.drained_head = node;
+                }
+                l.drained_tail = node;
+                ++n;
+            }
+            if (n != 0 && capacity == 0) {
+                unreserve(n);
+            }
+            return n;
+        }
+
+        message_ptr pop_drained(mpsc_lane& l) {
+            message_base* node = l.drained_head;
+            if (node != nullptr) {
+                l.drained_head = node->next.load(std::memory_order_relaxed);
+                if (l.drained_head == nullptr) {
+                    l.drained_tail = nullptr;
+                }
+                node->next.store(nullptr, std::memory_order_relaxed);
+                if (capacity != 0) {
+                    unreserve();    // Bounded: the message leaves the mailbox only now.
+                }
+            }
+            return message_ptr(node);
+        }
+
+        // Consumer only. The next message of the lowest lane that has one, or nullptr.
+        message_ptr pop_next() {
+            for (auto& l : lanes) {
+                if (l.drained_head != nullptr || drain(l) != 0) {
+                    return pop_drained(l);
+                }
+            }
+            return nullptr;
+        }
+
+        // Looks for a message for the idle budget, counted from `start`: spinning for the first half of it (on a
+        // machine with more than one CPU; with one, spinning only keeps the sender off it) and yielding for the rest.
+        // Returns false once the budget or the deadline has run out with the queue still empty.
+        bool look_before_parking(std::uint64_t start, std::chrono::steady_clock::time_point const* deadline) {
+            static const bool spin = std::thread::hardware_concurrency() > 1;
+            const std::uint64_t budget = idle.budget_ns();
+            std::uint64_t end = start + budget;
+            if (deadline != nullptr) {
+                end = std::min(end, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        deadline->time_since_epoch()).count()));
+            }
+            const std::uint64_t spin_end = spin ? start + budget / 2 : start;
+            for (std::uint64_t now = start; now < end; now = steady_now_ns()) {
+                const bool spinning = now < spin_end;
+                for (int i = 0; i < 32; ++i) {  // Between clock reads.
+                    if (!empty()) {
+                        return true;
+                    }
+                    if (spinning) {
+                        detail::cpu_relax();
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+            return !empty();
+        }
+
+        message_ptr pop_waiting(std::chrono::steady_clock::time_point const* deadline) {
+            if (external != nullptr) {
+                return external->pop(true, deadline);
+            }
+            std::uint64_t idle_since = 0;   // When an adaptive wait found the queue empty.
+            for (; ;) {
+                if (message_ptr msg = pop_next()) {
+                    if (idle_since != 0) {
+                        idle.record(steady_now_ns() - idle_since);
+                    }
+                    return msg;
+                }
+                if (!empty()) {
+                    std::this_thread::yield();  // A sender is between its two steps; it links the node next.
+                    continue;
+                }
+                if (strategy == wait_strategy::adaptive && idle_since == 0) {
+                    idle_since = steady_now_ns();
+                    if (look_before_parking(idle_since, deadline)) {
+                        continue;
+                    }
+                }
+                std::unique_lock<std::mutex> lk(m);
+                parked.store(true, std::memory_order_seq_cst);
+                bool woken = true;
+                if (deadline == nullptr) {
+                    cv.wait(lk, [&] { return !empty(); });
+                } else {
+                    woken = cv.wait_until(lk, *deadline, [&] { return !empty(); });
+                }
+                parked.store(false, std::memory_order_relaxed);
+                if (!woken) {
+                    lk.unlock();        // pop_next() may unreserve, which takes `m` to wake a waiting sender.
+                    return pop_next();  // Timed out, unless a message slipped in at the last moment.
+                }
+            }
+        }
+
+        template<typename Iterator>
+        void push_chunk(mpsc_lane& l, Iterator& it, std::size_t n) {
+            message_base* first = nullptr;
+            message_base* last = nullptr;
+#if MESSAGING_HAS_EXCEPTIONS
+            try {
+                link_chunk(it, n, first, last);
+            } catch (...) {
+                while (first != nullptr) {
+                    message_base* next = first->next.load(std::memory_order_relaxed);
+                    message_deleter{}(first);
+                    first = next;
+                }
+                unreserve(n);
+                throw;
+            }
+#else
+            link_chunk(it, n, first, last);
+#endif
+            enqueue(l, first, last);
+        }
+
+        // Builds the nodes of the next `n` messages and links them into the chain first..last.
+        template<typename Iterator>
+        void link_chunk(Iterator& it, std::size_t n, message_base*& first, message_base*& last) {
+            for (std::size_t i = 0; i < n; ++i, ++it) {
+                message_base* node = make_message(pool, *it).release();
+                if (last != nullptr) {
+                    last->next.store(node, std::memory_order_relaxed);
+                } else {
+                    first = node;
+                }
+                last = node;
+            }
+        }
 
     public:
+        explicit queue(std::size_t capacity_ = 0) : capacity(capacity_) {}
+        queue(queue const&) = delete;
+        queue& operator=(queue const&) = delete;
+
+        static constexpr std::size_t max_drain = 256;  // Most messages moved to a private FIFO at once.
+
+        ~queue() {
+            for (auto& l : lanes) {
+                while (message_ptr node = pop_drained(l)) {
+                }
+                while (message_base* node = try_pop_node(l)) {
+                    message_deleter{}(node);
+                }
+            }
+        }
+
+        // Messages are forwarded all the way into their node: an rvalue is moved once, from the caller's object into
+        // the node, and an lvalue copied once; nothing is copied along the way.
         template<typename Msg>
-        void push (Msg msg) {
-            std::lock_guard<std::mutex> lk(m);
-            q.push(std::make_shared<wrapped_message_base<Msg>>(std::move(msg)));    // Wrap posted message and store pointer.
-            cv.notify_all();
+        void push(Msg&& msg) {  // Waits while a bounded queue is full.
+            using type = std::remove_cvref_t<Msg>;
+            reserve(lane_of<type>, nullptr);
+            enqueue_reserved<type>(std::forward<Msg>(msg));     // Wrap posted message and link it in.
         }
-        std::shared_ptr<message_base> wait_and_pop() {
-            std::unique_lock<std::mutex> lk(m);
-            cv.wait(lk, [&] { return !q.empty(); });
-            auto res = q.front();
-            q.pop();
-            return res;
+
+        template<typename Msg>
+        bool try_push(Msg&& msg) {  // Fails at once when a bounded queue is full.
+            using type = std::remove_cvref_t<Msg>;
+            if (!try_reserve(lane_of<type>)) {
+                return false;
+            }
+            enqueue_reserved<type>(std::forward<Msg>(msg));
+            return true;
         }
+
+        template<typename Msg>
+        bool push_until(Msg&& msg, std::chrono::steady_clock::time_point deadline) {
+            using type = std::remove_cvref_t<Msg>;
+            if (!reserve(lane_of<type>, &deadline)) {
+                return false;
+            }
+            enqueue_reserved<type>(std::forward<Msg>(msg));
+            return true;
+        }
+
+        template<typename Msg, typename... Args>
+        void emplace(Args&&... args) {  // As push(), building the Msg from `args` in its node: not even a move.
+            reserve(lane_of<Msg>, nullptr);
+            enqueue_reserved<Msg>(std::forward<Args>(args)...);
+        }
+
+        /**
+         * Sends every message of `msgs` (a forward range of one message type), in order, with one reservation and one
+         * splice per chunk. A bounded queue takes a range of data messages in chunks of at most its capacity, waiting
+         * for room between chunks. Elements are copied, or moved when the range yields rvalues.
+         */
+        template<typename Range>
+        void push_batch(Range&& msgs) {
+            constexpr lane message_lane = lane_of<std::ranges::range_value_t<Range>>;
+            mpsc_lane& l = lanes[static_cast<std::size_t>(message_lane)];
+            auto it = std::ranges::begin(msgs);
+            auto remaining = static_cast<std::size_t>(std::ranges::distance(msgs));
+            while (remaining != 0) {
+                const bool unbounded = capacity == 0 || message_lane == lane::control;
+                const std::size_t n = unbounded || remaining < capacity ? remaining : capacity;
+                reserve(message_lane, nullptr, n);
+                push_chunk(l, it, n);
+                remaining -= n;
+            }
+        }
+
+        // Consumer only.
+        message_ptr try_pop() {
+            if (external != nullptr) {
+                return external->pop(false, nullptr);
+            }
+            return pop_next();
+        }
+
+        message_ptr wait_and_pop() {
+            return pop_waiting(nullptr);
+        }
+
+        // Like wait_and_pop(), but gives up at `deadline` and returns nullptr. The only clock read is the one the
+        // condition variable makes when the queue is empty.
+        message_ptr wait_and_pop_until(std::chrono::steady_clock::time_point deadline) {
+            return pop_waiting(&deadline);
+        }
+
+        // Consumer only. Whether a control message is waiting; such messages go ahead of the stash too.
+        bool control_pending() const {
+            mpsc_lane const& l = lanes[static_cast<std::size_t>(lane::control)];
+            return l.drained_head != nullptr || l.head != &l.stub ||
+                   l.tail.load(std::memory_order_acquire) != &l.stub;
+        }
+
+        // Consumer only. When set, dispatchers stash the messages their chain has no handler for instead of dropping
+        // them, and offer them to later chains.
+        void set_stash_unmatched(bool stash) { stash_on_miss = stash; }
+        bool stash_unmatched() const { return stash_on_miss; }
+        message_stash& stash() { return stashed; }
+        message_stash const& stash() const { return stashed; }
+
+        /**
+         * Makes the queue take its messages from `mailbox` instead of its own lanes, which stay empty. Set once, before
+         * anything is sent or received; an external mailbox can't be owned by an actor.
+         */
+        void set_external(external_mailbox* mailbox) {
+            external = mailbox;
+        }
+
+        /**
+         * Hands the queue to `owner_`, which is called from then on instead of a waiting consumer. The queue starts
+         * out parked; if messages are already waiting, the owner is called right away. Set once, before the owner
+         * consumes anything.
+         */
+        void set_owner(mailbox_owner* owner_) {
+            owner = owner_;
+            if (!park()) {
+                owner->mailbox_ready();
+            }
+        }
+
+        // Consumer of an owned queue only. Marks the queue idle, so that the next sender calls the owner. Returns
+        // false, leaving the queue unparked, when there are messages and the consumer should carry on.
+        bool park() {
+            for (auto const& l : lanes) {
+                if (l.drained_head != nullptr || l.head != &l.stub) {
+                    return false;
+                }
+            }
+            parked.store(true, std::memory_order_seq_cst);
+            // From here on a sender may hand the queue to another consumer, so only the tails may be looked at.
+            for (auto const& l : lanes) {
+                if (l.tail.load(std::memory_order_seq_cst) != &l.stub) {
+                    return !parked.exchange(false, std::memory_order_seq_cst);
+                }
+            }
+            return true;
+        }
+
+        // Consumer only. How the consumer waits for messages; owned and external queues are never waited on this way.
+        void set_wait_strategy(wait_strategy s) { strategy = s; }
+        wait_strategy waiting_strategy() const { return strategy; }
+
+        // Consumer only. Whether a close_queue has been dispatched from this queue.
+        bool closed() const { return close_seen; }
+        void mark_closed() { close_seen = true; }
+
+        // Consumer only. Whether a waiting dispatcher reports close_queue by throwing it, as it always used to, or
+        // only through its dispatch_status and closed(). Never true without exceptions.
+        bool close_throws() const { return throw_on_close; }
+        void set_close_throws(bool throws) { throw_on_close = throws && MESSAGING_HAS_EXCEPTIONS; }
+
+        static std::uint64_t steady_now_ns() {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        /**
+         * Starts keeping statistics: senders time-stamp their messages and dispatchers record, per message, the time it
+         * spent in the mailbox, the time its handler took and what became of it. Allocates the recorder once; from
+         * then on recording allocates nothing and takes no lock. Call it before the mailbox is in use.
+         */
+        void enable_stats() {
+            if (!recorder) {
+                recorder = std::make_unique<mailbox_stats>();
+                stamping.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        mailbox_stats* stats() { return recorder.get(); }   // nullptr unless enabled.
+
+        // Safe to call from any thread while the mailbox is in use. Without enable_stats(), only the depths are filled.
+        mailbox_snapshot snapshot() const {
+            mailbox_snapshot s;
+            s.depth = size();
+            s.high_water_mark = high_water_mark();
+            s.stashed = stashed.size();
+            if (recorder) {
+                recorder->fill(s);
+            }
+            return s;
+        }
+
+        std::size_t max_depth() const { return capacity; }
+        std::size_t size() const { return depth.load(std::memory_order_relaxed); }
+        std::size_t high_water_mark() const { return high_water.load(std::memory_order_relaxed); }
+
+        message_pool const& node_pool() const { return pool; }
     };
-}
\ No newline at end of file
+}
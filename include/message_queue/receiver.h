@@ -1,18 +1,139 @@
 #pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+
 #include "dispatcher.h"
 #include "sender.h"
 
 namespace messaging {
+    class inbox;
+
     class receiver {
         queue q;    // A receiver owns the queue.
+        external_mailbox* external = nullptr;
+
+        friend class inbox;     // Feeds a coroutine machine from the queue; see coroutine.h.
 
     public:
+        receiver() = default;
+
+        // A bounded receiver holds at most `capacity` messages; senders then wait (send), fail (try_send) or wait up
+        // to a timeout (send_for) while it is full.
+        explicit receiver(std::size_t capacity) : q(capacity) {}
+
+        // A receiver whose messages all come from `mailbox`, a shared_mailbox other processes send to, say. Waiting and
+        // dispatching work as usual; it is sent to through a remote_sender, which sends into `mailbox` as well.
+        explicit receiver(external_mailbox& mailbox) : external(&mailbox) {
+            q.set_external(&mailbox);
+        }
+
         operator sender() { // Allow implicit conversion to a sender that references the queue.
+            if (external != nullptr) {
+                std::fprintf(stderr, "messaging: send to a receiver on an external mailbox through a remote_sender\n");
+                std::abort();
+            }
             return sender(&q);
         }
 
+        operator remote_sender() {  // Only for a receiver on an external mailbox.
+            if (external == nullptr) {
+                std::fprintf(stderr, "messaging: a remote_sender needs a receiver on an external mailbox\n");
+                std::abort();
+            }
+            return remote_sender(external);
+        }
+
         dispatcher wait() {     // Waiting for a queue creates a dispatcher.
             return dispatcher(&q);
         }
+
+        /**
+         * Like wait(), but only until `timeout` has passed. When no handler has taken a message by then, the chain's
+         * on_timeout() handler runs instead:
+         *
+         *     incoming.wait_for(std::chrono::seconds(30))
+         *         .handle<pin_verified>([&](pin_verified const&) { ... })
+         *         .on_timeout([&] { state = &atm::done_processing; });
+         *
+         * The wait is a single timed wait on the mailbox; no timer thread is involved.
+         */
+        template<typename Rep, typename Period>
+        dispatcher wait_for(std::chrono::duration<Rep, Period> const& timeout) {
+            return dispatcher(&q, std::chrono::steady_clock::now() +
+                                      std::chrono::ceil<std::chrono::steady_clock::duration>(timeout));
+        }
+
+        template<typename Clock, typename Duration>
+        dispatcher wait_until(std::chrono::time_point<Clock, Duration> const& deadline) {
+            if constexpr (std::is_same_v<Clock, std::chrono::steady_clock>) {
+                return dispatcher(&q, std::chrono::ceil<std::chrono::steady_clock::duration>(deadline));
+            } else {
+                return wait_for(deadline - Clock::now());   // Other clocks are followed as of now.
+            }
+        }
+
+        /**
+         * Calls `body` until a close_queue has been dispatched, with wait() reporting the close through closed()
+         * instead of throwing it. `body` waits the same way as a plain message loop does,
+         *
+         *     incoming.run_until_closed([&] {
+         *         incoming.wait()
+         *             .handle<verify_pin>([&](verify_pin const& msg) { ... })
+         *             .handle<withdraw>([&](withdraw const& msg) { ... });
+         *     });
+         *
+         * so an existing loop (or a state machine whose states each call wait()) only needs its try/catch removed.
+         */
+        template<typename Body>
+        void run_until_closed(Body&& body) {
+            const bool throws = q.close_throws();
+            q.set_close_throws(false);
+            while (!q.closed()) {
+                body();
+            }
+            q.set_close_throws(throws);
+        }
+
+        /**
+         * Turns selective receive on or off. With it on, a message the waiting chain has no handler for is kept in a
+         * stash, in order, instead of being dropped, and every later wait() offers the stash to its chain first:
+         *
+         *     incoming.stash_unmatched(true);
+         *     incoming.wait().handle<card_inserted>(...);     // A digit_pressed that comes first is kept,
+         *     incoming.wait().handle<digit_pressed>(...);     // and handled here.
+         *
+         * A chain only looks at the stashed types it handles, so a state change costs no rescan of the backlog. Types
+         * that no state ever handles pile up in the stash; stashed() tells how many messages it holds. Turning it off
+         * keeps what is already stashed on offer.
+         */
+        void stash_unmatched(bool stash) { q.set_stash_unmatched(stash); }
+        std::size_t stashed() const { return q.stash().size(); }
+
+        bool closed() const { return q.closed(); }  // Whether a close_queue has been dispatched.
+
+        /**
+         * Sets how wait() waits on an empty mailbox. wait_strategy::adaptive suits a receiver in a request/reply
+         * exchange on a lightly loaded machine: it keeps looking for the next message, spinning and then yielding, for
+         * about twice as long as messages have lately been taking to come, and parks only once that has passed, so a
+         * quick answer costs no sleep and wake-up. Receivers that mostly sit idle find their budget shrinks to nothing
+         * and park at once. Call it on the receiver's own thread, or before the receiver is in use.
+         */
+        void set_wait_strategy(wait_strategy strategy) { q.set_wait_strategy(strategy); }
+
+        /**
+         * Starts keeping statistics on this mailbox: how long messages wait in it, how long their handlers take, and
+         * what became of each message type. Recording is lock-free and allocation-free; the cost is two clock reads per
+         * message and one per send. Call it before the receiver is in use; snapshot() may then be called from any
+         * thread at any time.
+         */
+        void enable_stats() { q.enable_stats(); }
+        mailbox_snapshot snapshot() const { return q.snapshot(); }
+
+        std::size_t capacity() const { return q.max_depth(); }  // 0 when unbounded.
+        std::size_t depth() const { return q.size(); }
+        std::size_t high_water_mark() const { return q.high_water_mark(); }    // Deepest the mailbox has been.
     };
 }
@@ -0,0 +1,219 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+namespace messaging {
+    class sender;
+
+    namespace detail {
+        /**
+         * The one-shot slot a request and its reply_future share. The responder fills it in place and the asker reads
+         * it; the mutex and condition variable are only touched when the asker is already waiting, with the same
+         * raise-then-recheck handshake as a parked queue.
+         */
+        template<typename Reply>
+        struct reply_state {
+            enum : std::uint32_t { pending, answered, dropped };
+
+            std::atomic<std::uint32_t> status{pending};
+            std::atomic<int> owners{2};     // The request and the future.
+            std::atomic<bool> waiting{false};
+            std::optional<Reply> value;
+            std::mutex m;
+            std::condition_variable cv;
+
+            void complete(std::uint32_t outcome) {
+                status.store(outcome, std::memory_order_seq_cst);
+                if (waiting.load(std::memory_order_seq_cst)) {
+                    { std::lock_guard<std::mutex> lk(m); }  // The asker is either asleep in the wait or yet to look.
+                    cv.notify_one();    // Outside the lock, so the asker doesn't wake up only to block on it.
+                }
+            }
+
+            // Each thread keeps the last slot it released for its next ask, so an asker that waits for every answer
+            // allocates nothing after its first request.
+            static reply_state* make() {
+                reply_state*& spare = spare_slot();
+                return spare != nullptr ? std::exchange(spare, nullptr) : new reply_state();
+            }
+
+            void release() noexcept {
+                if (owners.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    return;
+                }
+                reply_state*& spare = spare_slot();
+                if (spare != nullptr) {
+                    delete this;
+                    return;
+                }
+                value.reset();
+                status.store(pending, std::memory_order_relaxed);
+                owners.store(2, std::memory_order_relaxed);
+                spare = this;
+            }
+
+        private:
+            struct spare_holder {
+                reply_state* state = nullptr;
+                ~spare_holder() { delete state; }
+            };
+
+            static reply_state*& spare_slot() {
+                thread_local spare_holder holder;
+                return holder.state;
+            }
+        };
+    }
+
+    /**
+     * The asking end of sender::ask(): becomes ready once the responder has replied, or has dropped the request
+     * without replying. Move-only; the asker may give it up at any time, and a reply that comes later is discarded.
+     */
+    template<typename Reply>
+    class reply_future {
+        detail::reply_state<Reply>* state = nullptr;
+
+        template<typename> friend class request;
+
+        explicit reply_future(detail::reply_state<Reply>* state_) : state(state_) {}
+
+        bool wait(std::chrono::steady_clock::time_point const* deadline) {
+            auto done = [&] { return state->status.load(std::memory_order_seq_cst) != detail::reply_state<Reply>::pending; };
+            if (done()) {
+                return true;
+            }
+            std::unique_lock<std::mutex> lk(state->m);
+            state->waiting.store(true, std::memory_order_seq_cst);
+            bool ready = true;
+            if (deadline == nullptr) {
+                state->cv.wait(lk, done);
+            } else {
+                ready = state->cv.wait_until(lk, *deadline, done);
+            }
+            state->waiting.store(false, std::memory_order_relaxed);
+            return ready;
+        }
+
+    public:
+        reply_future() = default;
+        reply_future(reply_future&& other) noexcept : state(std::exchange(other.state, nullptr)) {}
+        reply_future& operator=(reply_future&& other) noexcept {
+            if (this != &other) {
+                if (state != nullptr) {
+                    state->release();
+                }
+                state = std::exchange(other.state, nullptr);
+            }
+            return *this;
+        }
+        reply_future(reply_future const&) = delete;
+        reply_future& operator=(reply_future const&) = delete;
+
+        ~reply_future() {
+            if (state != nullptr) {
+                state->release();
+            }
+        }
+
+        bool valid() const { return state != nullptr; }    // False once get() has been called.
+
+        bool ready() const {
+            return state != nullptr && state->status.load(std::memory_order_acquire) != detail::reply_state<Reply>::pending;
+        }
+
+        // Returns false if `timeout` passes before the request is answered or dropped.
+        template<typename Rep, typename Period>
+        bool wait_for(std::chrono::duration<Rep, Period> const& timeout) {
+            const auto deadline = std::chrono::steady_clock::now() +
+                                  std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+            return state != nullptr && wait(&deadline);
+        }
+
+        /**
+         * Waits for the outcome and takes it: the reply, or nothing when the request was dropped unanswered (sent to a
+         * receiver that closed first, say, or handled without a reply).
+         */
+        std::optional<Reply> get() {
+            if (state == nullptr) {
+                return std::nullopt;
+            }
+            wait(nullptr);
+            while (state->owners.load(std::memory_order_acquire) != 1) {
+                std::this_thread::yield();  // The responder lets go right after completing; then the slot is ours to keep.
+            }
+            std::optional<Reply> result;
+            if (state->status.load(std::memory_order_acquire) == detail::reply_state<Reply>::answered) {
+                result = std::move(state->value);
+            }
+            std::exchange(state, nullptr)->release();
+            return result;
+        }
+    };
+
+    /**
+     * Base of a message that can be asked with sender::ask<Reply>(). The responder answers from its handler with
+     * reply(), which completes the asker's reply_future in place: the reply never goes through the asker's mailbox.
+     *
+     *     struct get_balance : messaging::request<balance> { std::string account; };
+     *
+     *     auto answer = bank.ask<balance>(get_balance{{}, account});     // The asker.
+     *     if (std::optional<balance> b = answer.get()) { ... }
+     *
+     *     .handle<get_balance>([&](get_balance const& msg) { msg.reply(balance(amount)); })    // The responder.
+     *
+     * A request sent with plain send() expects no answer, and reply() then does nothing. Requests are move-only, since
+     * there is only one answer to give, and only travel between threads of one process.
+     */
+    template<typename Reply>
+    class request {
+        mutable detail::reply_state<Reply>* state = nullptr;
+
+        friend class sender;
+
+        reply_future<Reply> expect_reply() {
+            state = detail::reply_state<Reply>::make();
+            return reply_future<Reply>(state);
+        }
+
+        void drop() const noexcept {
+            if (state != nullptr) {
+                state->complete(detail::reply_state<Reply>::dropped);
+                std::exchange(state, nullptr)->release();
+            }
+        }
+
+    public:
+        using reply_type = Reply;
+
+        request() = default;
+        request(request&& other) noexcept : state(std::exchange(other.state, nullptr)) {}
+        request& operator=(request&& other) noexcept {
+            if (this != &other) {
+                drop();
+                state = std::exchange(other.state, nullptr);
+            }
+            return *this;
+        }
+        request(request const&) = delete;
+        request& operator=(request const&) = delete;
+
+        ~request() {
+            drop();     // Never answered: don't leave the asker waiting.
+        }
+
+        // Answers the request; later calls do nothing.
+        void reply(Reply answer) const {
+            if (state != nullptr) {
+                state->value.emplace(std::move(answer));
+                state->complete(detail::reply_state<Reply>::answered);
+                std::exchange(state, nullptr)->release();
+            }
+        }
+    };
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "actor.h"
+
+namespace messaging {
+    /**
+     * Runs any number of actors on a fixed pool of worker threads. The run queue is an intrusive FIFO of actors whose
+     * mailboxes are not empty; a worker takes the actor at its head, runs it for up to `batch` messages and, if the actor
+     * still has messages, puts it back at the tail, so that a busy actor can't starve the others. An actor with nothing
+     * to do costs no thread and no wakeup: it sits parked in its mailbox until the next sender makes it runnable again.
+     *
+     * Destroying the scheduler (or calling shutdown()) lets the workers finish every activation still queued, and
+     * whatever those activations send, then joins them. Close the actors first to have their loops end cleanly.
+     */
+    class scheduler {
+        std::mutex m;
+        std::condition_variable cv;
+        actor* runnable_head = nullptr;
+        actor* runnable_tail = nullptr;
+        std::size_t const batch;
+        bool stopping = false;
+        std::vector<std::thread> workers;
+
+        friend class actor;
+
+        void make_runnable(actor& a) noexcept {
+            {
+                std::lock_guard<std::mutex> lk(m);
+                a.next_runnable = nullptr;
+                if (runnable_tail != nullptr) {
+                    runnable_tail->next_runnable = &a;
+                } else {
+                    runnable_head = &a;
+                }
+                runnable_tail = &a;
+            }
+            cv.notify_one();
+        }
+
+        void work() {
+            for (;;) {
+                actor* a;
+                {
+                    std::unique_lock<std::mutex> lk(m);
+                    cv.wait(lk, [&] { return runnable_head != nullptr || stopping; });
+                    if (runnable_head == nullptr) {
+                        return;     // Stopping, and nothing left to run.
+                    }
+                    a = runnable_head;
+                    runnable_head = a->next_runnable;
+                    if (runnable_head == nullptr) {
+                        runnable_tail = nullptr;
+                    }
+                }
+                if (a->activate(batch)) {
+                    make_runnable(*a);
+                }
+            }
+        }
+
+    public:
+        static constexpr std::size_t default_batch = 64;   // Messages per activation.
+
+        explicit scheduler(std::size_t threads = std::max(1U, std::thread::hardware_concurrency()),
+                           std::size_t batch_ = default_batch)
+            : batch(std::max<std::size_t>(batch_, 1)) {
+            workers.reserve(threads);
+            for (std::size_t i = 0; i < threads; ++i) {
+                workers.emplace_back(&scheduler::work, this);
+            }
+        }
+        scheduler(scheduler const&) = delete;
+        scheduler& operator=(scheduler const&) = delete;
+
+        ~scheduler() {
+            shutdown();
+        }
+
+        /**
+         * Attaches `a` to this scheduler. Messages already in its mailbox make it runnable at once. An actor is started
+         * once, on one scheduler.
+         */
+        void start(actor& a) {
+            a.sched = this;
+            a.started();
+            a.q.set_owner(&a);
+        }
+
+        void shutdown() {
+            {
+                std::lock_guard<std::mutex> lk(m);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto& w : workers) {
+                if (w.joinable()) {
+                    w.join();
+                }
+            }
+        }
+
+        std::size_t thread_count() const { return workers.size(); }
+        std::size_t messages_per_activation() const { return batch; }
+    };
+
+    inline void actor::mailbox_ready() noexcept {
+        sched->make_runnable(*this);
+    }
+}
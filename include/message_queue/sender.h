@@ -1,9 +1,27 @@
 #pragma once
+#include <chrono>
+#include <type_traits>
+#include <utility>
+
 #include "message_queue.h"
+#include "reply.h"
 
 namespace messaging {
+    /**
+     * Whether a message can be copied into an external mailbox as plain bytes and still mean the same to a receiver in
+     * another process: trivially copyable, no more aligned than a payload, and not itself a pointer. Senders and
+     * requests hold pointers into the sending process (a queue, a reply slot), so they are not trivially copyable on
+     * purpose, and neither is any message that carries one. A raw pointer member can't be seen from here; don't put
+     * one in a message meant for another process.
+     */
+    template<typename Message>
+    inline constexpr bool travels_between_processes =
+        std::is_trivially_copyable_v<Message> && !std::is_pointer_v<Message> && !std::is_member_pointer_v<Message> &&
+        alignof(Message) <= external_mailbox::payload_alignment;
+
     class sender {
         queue* q;   // sender is wrapper around queue pointer.
+
         public:
         sender()    // Default constructed sender has no queue.
             :q{nullptr}
@@ -13,11 +31,131 @@ namespace messaging {
             : q{q_}
         {}
 
+        // Written out, so that a message holding a sender isn't trivially copyable and can't be sent to another
+        // process, where the queue pointer means nothing.
+        sender(sender const& other) noexcept : q{other.q} {}
+        sender& operator=(sender const& other) noexcept {
+            q = other.q;
+            return *this;
+        }
+
+        // Forwarded to the node: send(card_inserted(account)) moves the message once and copies nothing, a named
+        // message is copied once, and a move-only message can be sent with std::move.
         template<typename Message>
-        void send (Message msg) {
+        void send (Message&& msg) {
+            if (q) {
+                q->push(std::forward<Message>(msg));    // Pushes message on the queue; waits while a bounded one is full.
+            }
+        }
+
+        template<typename Message, typename... Args>
+        void emplace(Args&&... args) {  // Sends a Message built from `args` right in its node.
             if (q) {
-                q->push(msg);   // Sending pushes message on the queue.
+                q->emplace<Message>(std::forward<Args>(args)...);
             }
         }
+
+        /**
+         * Sends a request (a message derived from request<Reply>) and returns the future its answer arrives in. The
+         * responder completes it in place from its handler, so the asker needs neither a mailbox of its own nor a
+         * state to wait for the reply in. A request that can't be sent, or is dropped unanswered, leaves the future
+         * ready and empty. The request is forwarded into its node, as send() forwards a message.
+         */
+        template<typename Reply, typename Message>
+        reply_future<Reply> ask(Message&& msg) {
+            using type = std::remove_cvref_t<Message>;
+            static_assert(std::is_base_of_v<request<Reply>, type>, "ask<Reply> needs a message derived from request<Reply>");
+            reply_future<Reply> answer = static_cast<request<Reply>&>(msg).expect_reply();
+            if (q) {
+                q->push(std::forward<Message>(msg));
+            } else {
+                type dropped(std::forward<Message>(msg));   // Nowhere to send it: dropped before we return.
+            }
+            return answer;
+        }
+
+        template<typename Range>
+        void send_batch(Range&& msgs) {     // Sends a range of messages of one type for the cost of one send.
+            if (q) {
+                q->push_batch(std::forward<Range>(msgs));
+            }
+        }
+
+        template<typename Message>
+        bool try_send(Message&& msg) {  // Returns false instead of waiting when the receiver's mailbox is full.
+            return q != nullptr && q->try_push(std::forward<Message>(msg));
+        }
+
+        template<typename Message, typename Rep, typename Period>
+        bool send_for(Message&& msg, std::chrono::duration<Rep, Period> const& timeout) {
+            const auto deadline = std::chrono::steady_clock::now() +
+                                  std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+            return q != nullptr && q->push_until(std::forward<Message>(msg), deadline);
+        }
+    };
+
+    /**
+     * A sender for an external mailbox, such as a shared_mailbox another process receives from. Each message is copied
+     * into the mailbox as bytes, so only types for which travels_between_processes holds can be sent: anything else,
+     * requests included, fails to compile. There is no ask(), since a reply can't find its way back to another process.
+     *
+     *     auto bank = messaging::shared_mailbox::open("/bank");
+     *     messaging::remote_sender(bank.get()).send(balance{42});
+     */
+    class remote_sender {
+        external_mailbox* mailbox = nullptr;
+
+        // Waits as long as it takes when `deadline` is nullptr, unless `wait` is false.
+        template<typename Message>
+        bool push(Message const& msg, bool wait, std::chrono::steady_clock::time_point const* deadline) {
+            static_assert(travels_between_processes<Message>,
+                          "only trivially copyable messages without pointers can be sent to an external mailbox");
+            if (mailbox == nullptr) {
+                return false;
+            }
+            return wait ? mailbox->push_bytes(type_id_of<Message>, &msg, sizeof(Message), deadline)
+                        : mailbox->try_push_bytes(type_id_of<Message>, &msg, sizeof(Message));
+        }
+
+    public:
+        remote_sender() = default;  // Sends nowhere.
+
+        explicit remote_sender(external_mailbox* mailbox_) : mailbox{mailbox_} {}
+
+        // Not trivially copyable either, for the same reason as sender: the mailbox is mapped in this process only.
+        remote_sender(remote_sender const& other) noexcept : mailbox{other.mailbox} {}
+        remote_sender& operator=(remote_sender const& other) noexcept {
+            mailbox = other.mailbox;
+            return *this;
+        }
+
+        template<typename Message>
+        void send(Message const& msg) {     // Waits while the mailbox is full.
+            push(msg, true, nullptr);
+        }
+
+        template<typename Message, typename... Args>
+        void emplace(Args&&... args) {
+            push(Message(std::forward<Args>(args)...), true, nullptr);
+        }
+
+        template<typename Range>
+        void send_batch(Range const& msgs) {
+            for (auto const& msg : msgs) {
+                push(msg, true, nullptr);
+            }
+        }
+
+        template<typename Message>
+        bool try_send(Message const& msg) {
+            return push(msg, false, nullptr);
+        }
+
+        template<typename Message, typename Rep, typename Period>
+        bool send_for(Message const& msg, std::chrono::duration<Rep, Period> const& timeout) {
+            const auto deadline = std::chrono::steady_clock::now() +
+                                  std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+            return push(msg, true, &deadline);
+        }
     };
 }
@@ -0,0 +1,455 @@
+#pragma once
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "message_queue.h"
+
+namespace messaging {
+    namespace detail {
+        inline constexpr char shared_mailbox_magic[8] = {'M', 'S', 'G', 'B', 'O', 'X', '\0', '\0'};
+        inline constexpr std::uint32_t shared_mailbox_version = 1;
+        inline constexpr std::size_t shared_line = 64;
+
+        constexpr std::size_t round_up(std::size_t value, std::size_t alignment) {
+            return (value + alignment - 1U) & ~(alignment - 1U);
+        }
+
+        // Start of the segment. Everything in it is read and written by several processes, so only lock-free atomics
+        // and plain data live here.
+        struct shared_mailbox_header {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t slot_count;
+            std::uint32_t slot_size;
+            std::uint32_t payload_capacity;
+            std::uint64_t segment_size;
+
+            alignas(shared_line) std::atomic<std::uint64_t> write_index{0};    // Producers claim slots here.
+
+            alignas(shared_line) std::atomic<std::uint32_t> consumer_parked{0};
+            std::atomic<std::uint32_t> message_futex{0};    // Bumped by the producer that wakes the consumer.
+
+            alignas(shared_line) std::atomic<std::uint32_t> producers_waiting{0};
+            std::atomic<std::uint32_t> space_futex{0};      // Bumped by the consumer when it frees a slot for them.
+        };
+
+        // A slot is a line of bookkeeping followed by the payload, so the payload is aligned for any message that
+        // travels as bytes.
+        struct shared_slot {
+            std::atomic<std::uint64_t> sequence;
+            message_type_id type_id;
+            std::uint32_t size;
+        };
+
+        static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+                      "shared_mailbox needs address-free atomics");
+        static_assert(sizeof(shared_slot) <= external_mailbox::payload_alignment);
+
+        // Returns false when `deadline` passed first. Not being woken by the time the word changes is never an error:
+        // the callers look again either way.
+        inline bool futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected,
+                               std::chrono::steady_clock::time_point const* deadline) {
+            timespec timeout{};
+            if (deadline != nullptr) {
+                const auto left = *deadline - std::chrono::steady_clock::now();
+                if (left <= std::chrono::steady_clock::duration::zero()) {
+                    return false;
+                }
+                const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+                timeout.tv_sec = static_cast<time_t>(ns / 1000000000);
+                timeout.tv_nsec = static_cast<long>(ns % 1000000000);
+            }
+            // Not FUTEX_PRIVATE_FLAG: the waker may be another process.
+            const long r = ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected,
+                                     deadline != nullptr ? &timeout : nullptr, nullptr, 0);
+            return !(r == -1 && errno == ETIMEDOUT);
+        }
+
+        inline void futex_wake(std::atomic<std::uint32_t>& word, int count) {
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+        }
+    }
+
+    /**
+     * A mailbox in a shared memory segment, for messages between processes. One process, the consumer, creates it
+     * under a name and receives from it through a receiver; any number of processes open it by that name and send to
+     * it through a remote_sender, much as they would send to a receiver in their own process:
+     *
+     *     auto inbox = messaging::shared_mailbox::create("/bank");        // The bank process.
+     *     messaging::receiver incoming(*inbox);
+     *     incoming.wait().handle<balance>([&](balance const& msg) { ... });
+     *
+     *     auto bank = messaging::shared_mailbox::open("/bank");           // Any ATM process.
+     *     messaging::remote_sender(bank.get()).send(balance{42});
+     *
+     * Only trivially copyable messages without pointers travel, since they are copied as bytes; put text in fixed-size
+     * arrays rather than std::string. remote_sender refuses anything else at compile time. Each message goes into its
+     * own fixed-size slot of a ring, together with its type id (which only matches between processes built by the
+     * same compiler). The consumer dispatches it right there, from the
+     * shared slot, without copying it again, and the slot is handed back once the handler returns (or, for a message
+     * the receiver stashes, once a later state has handled it).
+     *
+     * The ring is the bounded multi-producer queue the logger uses: each slot has a sequence word that says whether it
+     * is free for position `pos` (sequence == pos), published (pos + 1) or consumed. A producer claims a position with
+     * one compare-and-swap and publishes it with one store; the consumer takes positions in order without any atomic
+     * read-modify-write. Sleeping is done on futexes in the segment, with the same raise-then-recheck protocol as
+     * queue: the consumer raises `consumer_parked` and a producer only makes the wakeup system call when it sees it
+     * raised. Producers that find the ring full sleep on a second futex until the consumer frees a slot.
+     *
+     * There is a single lane, so control messages keep their place in line. Errors opening or creating the segment are
+     * reported on stderr and give nullptr.
+     */
+    class shared_mailbox final : public external_mailbox {
+    public:
+        struct options {
+            std::uint32_t slot_count = 1024;        // A power of two.
+            std::uint32_t payload_capacity = 192;   // Largest message, in bytes.
+            bool unlink_on_close = true;            // Remove the name when the creator closes the mailbox.
+        };
+
+        /**
+         * Creates the segment `name` (a POSIX shared memory name such as "/bank"), replacing any left behind, and maps
+         * it. The calling process is the consumer: it is the only one that may receive from the mailbox.
+         */
+        static std::unique_ptr<shared_mailbox> create(char const* name, options const& opts) {
+            if (opts.slot_count == 0U || (opts.slot_count & (opts.slot_count - 1U)) != 0U) {
+                std::fprintf(stderr, "messaging: slot_count %u is not a power of two\n", opts.slot_count);
+                return nullptr;
+            }
+            const std::size_t slot_size = detail::round_up(payload_alignment + opts.payload_capacity, detail::shared_line);
+            const std::size_t slots_offset = detail::round_up(sizeof(detail::shared_mailbox_header), detail::shared_line);
+            const std::size_t size = slots_offset + slot_size * opts.slot_count;
+
+            std::unique_ptr<shared_mailbox> mailbox(new shared_mailbox());
+            mailbox->creator = true;
+            mailbox->unlink_on_close = opts.unlink_on_close;
+            if (!mailbox->set_name(name)) {
+                return nullptr;
+            }
+            mailbox->fd = ::shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0600);
+            if (mailbox->fd < 0 || ::ftruncate(mailbox->fd, static_cast<off_t>(size)) != 0) {
+                std::fprintf(stderr, "messaging: cannot create mailbox %s: %s\n", name, std::strerror(errno));
+                return nullptr;
+            }
+            if (!mailbox->map(size)) {
+                return nullptr;
+            }
+
+            auto* h = new (mailbox->base) detail::shared_mailbox_header{};
+            h->version = detail::shared_mailbox_version;
+            h->slot_count = opts.slot_count;
+            h->slot_size = static_cast<std::uint32_t>(slot_size);
+            h->payload_capacity = static_cast<std::uint32_t>(slot_size - payload_alignment);
+            h->segment_size = size;
+            mailbox->attach(h);
+            for (std::uint32_t i = 0; i < opts.slot_count; ++i) {
+                auto* slot = new (mailbox->slot_at(i)) detail::shared_slot{};
+                slot->sequence.store(i, std::memory_order_relaxed);
+            }
+            // Openers check the magic last, so they never see a half-built ring.
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(h->magic, detail::shared_mailbox_magic, sizeof(h->magic));
+            return mailbox;
+        }
+
+        static std::unique_ptr<shared_mailbox> create(char const* name) {
+            return create(name, options{});
+        }
+
+        /**
+         * Maps the existing mailbox `name` for sending.
+         */
+        static std::unique_ptr<shared_mailbox> open(char const* name) {
+            std::unique_ptr<shared_mailbox> mailbox(new shared_mailbox());
+            if (!mailbox->set_name(name)) {
+                return nullptr;
+            }
+            mailbox->fd = ::shm_open(name, O_RDWR, 0600);
+            struct stat st{};
+            if (mailbox->fd < 0 || ::fstat(mailbox->fd, &st) != 0) {
+                std::fprintf(stderr, "messaging: cannot open mailbox %s: %s\n", name, std::strerror(errno));
+                return nullptr;
+            }
+            const auto size = static_cast<std::size_t>(st.st_size);
+            if (size < sizeof(detail::shared_mailbox_header) || !mailbox->map(size)) {
+                std::fprintf(stderr, "messaging: %s is not a mailbox\n", name);
+                return nullptr;
+            }
+            auto* h = static_cast<detail::shared_mailbox_header*>(mailbox->base);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (std::memcmp(h->magic, detail::shared_mailbox_magic, sizeof(h->magic)) != 0 ||
+                h->version != detail::shared_mailbox_version || h->segment_size != size || h->slot_count == 0U ||
+                (h->slot_count & (h->slot_count - 1U)) != 0U ||
+                detail::round_up(sizeof(detail::shared_mailbox_header), detail::shared_line) +
+                        std::size_t{h->slot_size} * h->slot_count != size) {
+                std::fprintf(stderr, "messaging: %s is not a mailbox\n", name);
+                return nullptr;
+            }
+            mailbox->attach(h);
+            return mailbox;
+        }
+
+        shared_mailbox(shared_mailbox const&) = delete;
+        shared_mailbox& operator=(shared_mailbox const&) = delete;
+
+        // Messages still being dispatched must be done with first: their payloads live in the mapping.
+        ~shared_mailbox() {
+            if (base != nullptr) {
+                ::munmap(base, mapped_size);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+                if (creator && unlink_on_close) {
+                    ::shm_unlink(name);
+                }
+            }
+        }
+
+        std::size_t payload_capacity() const { return header->payload_capacity; }
+        std::size_t slot_count() const { return header->slot_count; }
+
+        // Whether `p` points into the segment; lets a test see that a message was dispatched in place.
+        bool contains(void const* p) const {
+            auto const* c = static_cast<char const*>(p);
+            auto const* b = static_cast<char const*>(base);
+            return c >= b && c < b + mapped_size;
+        }
+
+        bool try_push_bytes(message_type_id type_id, void const* payload, std::size_t size) override {
+            check_size(size);
+            std::uint64_t pos;
+            if (!claim(pos)) {
+                return false;
+            }
+            publish(pos, type_id, payload, size);
+            return true;
+        }
+
+        bool push_bytes(message_type_id type_id, void const* payload, std::size_t size,
+                        std::chrono::steady_clock::time_point const* deadline) override {
+            check_size(size);
+            std::uint64_t pos;
+            for (int spins = 0; !claim(pos); ++spins) {
+                if (spins < spin_limit) {
+                    std::this_thread::yield();  // The consumer is usually a few messages behind, not asleep.
+                } else if (!wait_for_space(deadline)) {
+                    if (!claim(pos)) {
+                        return false;
+                    }
+                    break;
+                }
+            }
+            publish(pos, type_id, payload, size);
+            return true;
+        }
+
+        // Consumer only.
+        message_ptr pop(bool wait, std::chrono::steady_clock::time_point const* deadline) override {
+            for (; ;) {
+                if (message_ptr msg = take()) {
+                    return msg;
+                }
+                if (!wait) {
+                    return nullptr;
+                }
+                const std::uint32_t seen = header->message_futex.load(std::memory_order_seq_cst);
+                header->consumer_parked.store(1, std::memory_order_seq_cst);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (ready()) {
+                    header->consumer_parked.store(0, std::memory_order_relaxed);
+                    continue;
+                }
+                const bool woken = detail::futex_wait(header->message_futex, seen, deadline);
+                header->consumer_parked.store(0, std::memory_order_relaxed);
+                if (!woken) {
+                    return take();  // One last look, as queue does after a timed wait.
+                }
+            }
+        }
+
+    private:
+        static constexpr int spin_limit = 64;
+
+        // What the consumer hands out: a view of the payload in its slot. One per slot, built in place when the slot
+        // is taken.
+        struct slot_view final : message_view {
+            shared_mailbox* mailbox;
+            std::uint64_t pos;
+
+            slot_view(message_type_id type_id_, void* payload_, shared_mailbox* mailbox_, std::uint64_t pos_)
+                : message_view(type_id_, payload_), mailbox(mailbox_), pos(pos_) {}
+
+            void release() noexcept override {
+                shared_mailbox* m = mailbox;
+                const std::uint64_t p = pos;
+                this->~slot_view();
+                m->release(p);
+            }
+        };
+
+        struct alignas(slot_view) view_storage {
+            unsigned char bytes[sizeof(slot_view)];
+        };
+
+        char name[256] = {};
+        int fd = -1;
+        bool creator = false;
+        bool unlink_on_close = false;
+        void* base = nullptr;
+        std::size_t mapped_size = 0;
+        detail::shared_mailbox_header* header = nullptr;
+        char* slots = nullptr;
+        std::uint64_t mask = 0;
+
+        // Consumer side; private to the creating process.
+        std::uint64_t next_pos = 0;     // Next position to hand out.
+        std::uint64_t free_pos = 0;     // Oldest position handed out and not handed back yet.
+        std::vector<view_storage> views;
+        std::vector<bool> released;     // Per slot: handed back out of order, waiting for the ones before it.
+
+        shared_mailbox() = default;
+
+        bool set_name(char const* name_) {
+            if (name_ == nullptr || std::strlen(name_) >= sizeof(name)) {
+                std::fprintf(stderr, "messaging: a mailbox name is required\n");
+                return false;
+            }
+            std::strncpy(name, name_, sizeof(name) - 1U);
+            return true;
+        }
+
+        bool map(std::size_t size) {
+            void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                std::fprintf(stderr, "messaging: mmap of %zu bytes failed: %s\n", size, std::strerror(errno));
+                return false;
+            }
+            base = p;
+            mapped_size = size;
+            return true;
+        }
+
+        void attach(detail::shared_mailbox_header* h) {
+            header = h;
+            slots = static_cast<char*>(base) + detail::round_up(sizeof(detail::shared_mailbox_header), detail::shared_line);
+            mask = h->slot_count - 1U;
+            if (creator) {
+                views.resize(h->slot_count);
+                released.resize(h->slot_count);
+            }
+        }
+
+        detail::shared_slot* slot_at(std::uint64_t pos) const {
+            return reinterpret_cast<detail::shared_slot*>(slots + (pos & mask) * header->slot_size);
+        }
+
+        static void* payload_of(detail::shared_slot* slot) {
+            return reinterpret_cast<char*>(slot) + payload_alignment;
+        }
+
+        void check_size(std::size_t size) const {
+            if (size > header->payload_capacity) {
+                std::fprintf(stderr, "messaging: a %zu byte message doesn't fit the %u byte slots of mailbox %s\n", size,
+                             header->payload_capacity, name);
+                std::abort();
+            }
+        }
+
+        // Producer side: claims the next free position, or returns false when the ring is full.
+        bool claim(std::uint64_t& pos) {
+            pos = header->write_index.load(std::memory_order_relaxed);
+            for (; ;) {
+                const auto diff = static_cast<std::int64_t>(slot_at(pos)->sequence.load(std::memory_order_acquire) - pos);
+                if (diff == 0) {
+                    if (header->write_index.compare_exchange_weak(pos, pos + 1U, std::memory_order_relaxed)) {
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = header->write_index.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void publish(std::uint64_t pos, message_type_id type_id, void const* payload, std::size_t size) {
+            detail::shared_slot* slot = slot_at(pos);
+            slot->type_id = type_id;
+            slot->size = static_cast<std::uint32_t>(size);
+            std::memcpy(payload_of(slot), payload, size);
+            slot->sequence.store(pos + 1U, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (header->consumer_parked.load(std::memory_order_seq_cst) != 0U) {
+                header->message_futex.fetch_add(1, std::memory_order_seq_cst);
+                detail::futex_wake(header->message_futex, 1);
+            }
+        }
+
+        // Sleeps until the consumer frees a slot. Returns false once `deadline` has passed.
+        bool wait_for_space(std::chrono::steady_clock::time_point const* deadline) {
+            header->producers_waiting.fetch_add(1, std::memory_order_seq_cst);
+            const std::uint32_t seen = header->space_futex.load(std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const std::uint64_t pos = header->write_index.load(std::memory_order_relaxed);
+            bool woken = true;
+            if (slot_at(pos)->sequence.load(std::memory_order_acquire) != pos) {
+                woken = detail::futex_wait(header->space_futex, seen, deadline);
+            }
+            header->producers_waiting.fetch_sub(1, std::memory_order_relaxed);
+            return woken;
+        }
+
+        bool ready() const {
+            return slot_at(next_pos)->sequence.load(std::memory_order_acquire) == next_pos + 1U;
+        }
+
+        message_ptr take() {
+            if (!ready()) {
+                return nullptr;
+            }
+            const std::uint64_t pos = next_pos++;
+            detail::shared_slot* slot = slot_at(pos);
+            return message_ptr(new (&views[pos & mask]) slot_view(slot->type_id, payload_of(slot), this, pos));
+        }
+
+        // Hands slots back in ring order; a view destroyed early waits for the ones taken before it.
+        void release(std::uint64_t pos) noexcept {
+            released[pos & mask] = true;
+            if (pos != free_pos) {
+                return;
+            }
+            while (free_pos != next_pos && released[free_pos & mask]) {
+                released[free_pos & mask] = false;
+                slot_at(free_pos)->sequence.store(free_pos + header->slot_count, std::memory_order_release);
+                ++free_pos;
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (header->producers_waiting.load(std::memory_order_seq_cst) != 0U) {
+                header->space_futex.fetch_add(1, std::memory_order_seq_cst);
+                detail::futex_wake(header->space_futex, INT_MAX);
+            }
+        }
+    };
+}
+#endif
@@ -1,5 +1,13 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "message_queue.h"
+#include "type_id.h"
 
 namespace messaging {
     /**
@@ -16,6 +24,15 @@ namespace messaging {
      * This simple framework allows you to push any type of message on the queue and then selectively match against
      * messages you can handle on the receiving end. It also allows you to pass around a reference to the queue for
      * pushing messages on, while keeping the receiving end private.
+     *
+     * The chain can also be run on the spot with result(), which returns the dispatch_status (handled, or closed when
+     * a close_queue came in that no handler took) and never throws.
+     *
+     * Matching does not walk the chain. The message types of the whole chain are known at compile time, so each
+     * TemplateDispatcher type carries a constexpr table from message type_id to the position of its handler, and a
+     * jump table of one invoker per position. Dispatching a message is a multiply, a shift, one compare and an indirect
+     * call, whatever the number of handlers. Messages no handler matches go to the root dispatcher, which recognises
+     * close_queue.
      * @tparam PreviousDispatcher
      * @tparam Msg
      * @tparam Func
@@ -32,22 +49,102 @@ namespace messaging {
 
         template<typename Dispatcher, typename OtherMsg, typename OtherFunc>
         friend class TemplateDispatcher;        // TemplateDispatcher instantiations are friends of each other.
+        friend class dispatcher;                // The root runs the chain.
+
+        using message_type = Msg;
+
+        static constexpr std::size_t handler_count = PreviousDispatcher::handler_count + 1;
+
+        // Handler 0 is this one, handler 1 the previous one, and so on back to the root dispatcher.
+        static constexpr message_type_id handler_id(std::size_t index) {
+            return index == 0 ? type_id_of<Msg> : PreviousDispatcher::handler_id(index - 1);
+        }
+
+        static constexpr std::array<message_type_id, handler_count> handler_ids() {
+            std::array<message_type_id, handler_count> ids{};
+            for (std::size_t i = 0; i < handler_count; ++i) {
+                ids[i] = handler_id(i);
+            }
+            return ids;
+        }
 
-        void wait_and_dispatch() {
-            for (; ;) {
-                auto msg = q->wait_and_pop();
-                if (dispatch(msg))
-                    break;          // If we handle the message, break out of the loop
+        // False if a handler from this one back to the root takes a type other than M with the id of M.
+        template<typename M>
+        static constexpr bool only_type_with_id_of() {
+            return (type_id_of<Msg> != type_id_of<M> || std::is_same_v<std::remove_cv_t<Msg>, std::remove_cv_t<M>>) &&
+                   PreviousDispatcher::template only_type_with_id_of<M>();
+        }
+
+        // Equal ids in the chain belong to the same type, handled twice; distinct types never share an id.
+        static constexpr bool ids_name_one_type() {
+            return PreviousDispatcher::template only_type_with_id_of<Msg>() && PreviousDispatcher::ids_name_one_type();
+        }
+
+        template<std::size_t Index>
+        auto& handler_at() {
+            if constexpr (Index == 0) {
+                return *this;
+            } else {
+                return prev->template handler_at<Index - 1>();
             }
         }
-        bool dispatch(std::shared_ptr<message_base> const& msg) {
-            if (wrapped_message<Msg>* wrapper = dynamic_cast<wrapped_message<Msg>*>(msg.get())) {
-                // Check the message type, and call the function.
-                f(wrapper->contents);
-                return true;
+
+        dispatcher& root() {
+            if constexpr (handler_count == 1) {
+                return *prev;
             } else {
-                return prev->dispatch(msg);     // Chain to the previous dispatcher.
+                return prev->root();
+            }
+        }
+
+        template<std::size_t Index>
+        static dispatch_status invoke(TemplateDispatcher& self, message_base& msg) {
+            auto& handler = self.template handler_at<Index>();
+            using Handler = std::remove_reference_t<decltype(handler)>;
+            handler.f(message_cast<typename Handler::message_type>(msg));
+            return dispatch_status::handled;
+        }
+
+        using invoker = dispatch_status (*)(TemplateDispatcher&, message_base&);
+
+        template<std::size_t... Index>
+        static constexpr std::array<invoker, handler_count> make_invokers(std::index_sequence<Index...>) {
+            return {&invoke<Index>...};
+        }
+
+        // Position of the handler a timeout goes to, the one chained last if there are several; handler_count if none.
+        static constexpr std::size_t timeout_index() {
+            for (std::size_t i = 0; i < handler_count; ++i) {
+                if (handler_id(i) == type_id_of<timeout>) {
+                    return i;
+                }
+            }
+            return handler_count;
+        }
+
+        void dispatch_timeout() {
+            constexpr std::size_t index = timeout_index();
+            if constexpr (index < handler_count) {
+                handler_at<index>().f(timeout{});
+            }
+        }
+
+        dispatch_status wait_and_dispatch() {
+            return root().wait_and_dispatch(*this);   // Ends once we handle a message, or the queue closes or times out.
+        }
+        dispatch_status dispatch(message_base& msg) {
+            // Built at compile time, once the whole chain type is complete.
+            static constexpr detail::perfect_hash hash = detail::find_perfect_hash(handler_ids());
+            static_assert(ids_name_one_type(), "two message types of this handler chain have the same type id");
+            static_assert(hash.found, "message type ids of this handler chain collide");
+            static constexpr auto table = detail::build_dispatch_table<hash.bits>(handler_ids(), hash);
+            static constexpr auto invokers = make_invokers(std::make_index_sequence<handler_count>{});
+
+            const std::uint16_t index = table.find(msg.type_id);
+            if (index != detail::dispatch_table<hash.bits>::empty) {
+                return invokers[index](*this, msg);    // Call the function registered for this message type.
             }
+            return root().dispatch(msg);    // Unhandled: only close_queue is left to check.
         }
     public:
         TemplateDispatcher(TemplateDispatcher&& other):
@@ -64,9 +161,17 @@ namespace messaging {
             return TemplateDispatcher<TemplateDispatcher, OtherMsg, OtherFunc>(
                 q, this, std::forward<OtherFunc>(of));
         }
+        template<typename OtherFunc>
+        auto on_timeout(OtherFunc&& of) {   // Called with no arguments when the deadline of a timed wait passes.
+            return handle<timeout>([of = std::forward<OtherFunc>(of)](timeout const&) mutable { of(); });
+        }
+        dispatch_status result() {  // Dispatches now rather than in the destructor; never throws.
+            chained = true;
+            return root().finish(root().run(*this), false);
+        }
         ~TemplateDispatcher() noexcept(false) {
             if (!chained) {
-                wait_and_dispatch();
+                root().finish(root().run(*this), true);
             }
         }
     };
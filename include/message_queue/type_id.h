@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+namespace messaging {
+    using message_type_id = std::uint64_t;
+
+    namespace detail {
+        constexpr message_type_id fnv1a(std::string_view text) {
+            message_type_id hash = 0xcbf29ce484222325ULL;
+            for (char c : text) {
+                hash ^= static_cast<unsigned char>(c);
+                hash *= 0x100000001b3ULL;
+            }
+            return hash;
+        }
+
+        template<typename T>
+        constexpr std::string_view type_signature() {
+#if defined(_MSC_VER) && !defined(__clang__)
+            return __FUNCSIG__;
+#else
+            return __PRETTY_FUNCTION__;
+#endif
+        }
+    }
+
+    /**
+     * Every message type gets a 64-bit id at compile time: the FNV-1a hash of the compiler's spelling of the type. No
+     * registration and no RTTI are needed, and the id is the same in every translation unit (and every process built by
+     * the same compiler), so it can travel with the message. Two types handled by the same dispatcher that hash to
+     * the same id fail to compile (TemplateDispatcher::ids_name_one_type).
+     */
+    template<typename Msg>
+    inline constexpr message_type_id type_id_of = detail::fnv1a(detail::type_signature<std::remove_cv_t<Msg>>());
+
+    namespace detail {
+        struct perfect_hash {
+            unsigned bits;                  // The table has 1 << bits slots.
+            message_type_id multiplier;
+            bool found;
+
+            constexpr std::size_t slot(message_type_id id) const {
+                return bits == 0 ? 0 : static_cast<std::size_t>((id * multiplier) >> (64U - bits));
+            }
+        };
+
+        /**
+         * Finds a multiplicative hash that maps the N ids of a handler chain to distinct slots of a power-of-two table.
+         * The search runs at compile time over a few table sizes and multipliers; since the ids are already well mixed,
+         * the first table twice the size of the chain almost always works. Repeated ids (the same message handled twice
+         * in one chain) are allowed to share a slot.
+         */
+        template<std::size_t N>
+        constexpr perfect_hash find_perfect_hash(std::array<message_type_id, N> const& ids) {
+            constexpr unsigned first_bits = static_cast<unsigned>(std::bit_width(N));
+            for (unsigned bits = first_bits; bits <= first_bits + 5U; ++bits) {
+                for (message_type_id k = 0; k < 64U; ++k) {
+                    perfect_hash h{bits, 0x9e3779b97f4a7c15ULL * (2U * k + 1U), true};
+                    bool distinct = true;
+                    for (std::size_t i = 0; i < N && distinct; ++i) {
+                        for (std::size_t j = i + 1; j < N; ++j) {
+                            if (ids[i] != ids[j] && h.slot(ids[i]) == h.slot(ids[j])) {
+                                distinct = false;
+                                break;
+                            }
+                        }
+                    }
+                    if (distinct) {
+                        return h;
+                    }
+                }
+            }
+            return {0U, 0U, false};
+        }
+
+        /**
+         * Slot table of a dispatcher: for each slot, the message id that lives there and the position of its handler
+         * in the chain. The id is stored so that a message nobody handles, which may hash to an occupied slot, is told
+         * apart with one compare.
+         */
+        template<unsigned Bits>
+        struct dispatch_table {
+            static constexpr std::uint16_t empty = 0xFFFF;
+
+            struct entry {
+                message_type_id id = 0;
+                std::uint16_t handler = empty;
+            };
+
+            perfect_hash hash;
+            std::array<entry, std::size_t{1} << Bits> slots{};
+
+            constexpr std::uint16_t find(message_type_id id) const {
+                entry const& e = slots[hash.slot(id)];
+                return e.id == id ? e.handler : empty;
+            }
+        };
+
+        // When a message type is handled more than once, the lowest index (the handler chained last) wins, as it did
+        // when the chain was searched from the outermost dispatcher inwards.
+        template<unsigned Bits, std::size_t N>
+        constexpr dispatch_table<Bits> build_dispatch_table(std::array<message_type_id, N> const& ids,
+                                                            perfect_hash hash) {
+            dispatch_table<Bits> table{hash};
+            for (std::size_t i = 0; i < N; ++i) {
+                auto& e = table.slots[hash.slot(ids[i])];
+                if (e.handler == dispatch_table<Bits>::empty) {
+                    e.id = ids[i];
+                    e.handler = static_cast<std::uint16_t>(i);
+                }
+            }
+            return table;
+        }
+    }
+}
@@ -1,29 +1,62 @@
 #include "atm.h"
+
+#include <chrono>
+#include <optional>
+#include <variant>
+
 #include "messages.h"
 #include "include/message_queue/dispatcher.h"
 
-void atm::process_withdrawal() {
-    incoming.wait()
-        .handle<withdraw_ok>(
-            [&](withdraw_ok const & msg) {
-                interface_hardware.send(issue_money(withdrawal_amount));
-                bank.send(
-                    withdrawal_processed(account, withdrawal_amount));
-                state = &atm::done_processing;
-            });
-}
-
-void atm::process_balance() {
-    incoming.wait()
-    .handle<balance>(
-        [&](balance const & msg) {
-            interface_hardware.send(display_balance(msg.amount));
-            state=&atm::wait_for_action;
-        })
+// One turn of a state waiting for the bank: true once `answer` is ready to take. Between turns the keypad is still
+// read, so cancel_pressed ends the session, as the bank not answering by bank_deadline does; `on_give_up` then runs.
+template<typename Reply, typename OnGiveUp>
+bool atm::bank_answered(messaging::reply_future<Reply>& answer, OnGiveUp on_give_up) {
+    if (answer.wait_for(keypad_poll)) {
+        return true;
+    }
+    if (std::chrono::steady_clock::now() >= bank_deadline) {
+        interface_hardware.send(display_bank_unavailable());
+        on_give_up();
+        state=&atm::done_processing;
+        return false;
+    }
+    incoming.wait_for(std::chrono::seconds(0))
     .handle<cancel_pressed>(
         [&](cancel_pressed const & msg) {
+            on_give_up();
             state=&atm::done_processing;
         });
+    return false;
+}
+
+void atm::process_withdrawal() {
+    if (!bank_answered(withdrawal, [&] {
+            bank.send(cancel_withdrawal(account, withdrawal_amount));
+            interface_hardware.send(display_withdrawal_cancelled());
+        })) {
+        return;
+    }
+    std::optional<withdraw_reply> reply = withdrawal.get();
+    if (reply && std::holds_alternative<withdraw_ok>(*reply)) {
+        interface_hardware.send(issue_money(withdrawal_amount));
+        bank.send(
+            withdrawal_processed(account, withdrawal_amount));
+    } else {
+        interface_hardware.send(display_insufficient_funds());
+    }
+    state = &atm::done_processing;
+}
+
+void atm::process_balance() {
+    if (!bank_answered(balance_query, [] {})) {
+        return;
+    }
+    if (std::optional<::balance> reply = balance_query.get()) {
+        interface_hardware.send(display_balance(reply->amount));
+        state=&atm::wait_for_action;
+    } else {
+        state=&atm::done_processing;
+    }
 }
 
 void atm::wait_for_action() {
@@ -32,12 +65,14 @@ void atm::wait_for_action() {
     .handle<withdraw_pressed>(
         [&](withdraw_pressed const & msg) {
             withdrawal_amount=msg.amount;
-            bank.send(account, msg.amount, incoming);
+            withdrawal = bank.ask<withdraw_reply>(withdraw(account, msg.amount));
+            bank_deadline = std::chrono::steady_clock::now() + bank_timeout;
             state=&atm::process_withdrawal;
         })
     .handle<balance_pressed>(
         [&](balance_pressed const & msg) {
-            bank.send(get_balance(account, incoming));
+            balance_query = bank.ask<::balance>(get_balance(account));
+            bank_deadline = std::chrono::steady_clock::now() + bank_timeout;
             state=&atm::process_balance;
         })
     .handle<cancel_pressed>(
@@ -47,21 +82,20 @@ void atm::wait_for_action() {
 }
 
 void atm::verifying_pin() {
-    incoming.wait()
-    .handle<pin_verified>(
-        [&](pin_verified const & msg) {
-            state=&atm::wait_for_action;
-        })
-    .handle<pin_incorrect>(
-        [&](pin_incorrect  const & msg) {
-            interface_hardware.send(
-                display_pin_incorrect_message());
-            state=&atm::done_processing;
-        })
-    .handle<cancel_pressed>(
-        [&](cancel_pressed const & msg) {
-            state=&atm::done_processing;
-        });
+    if (!bank_answered(pin_check, [] {})) {
+        return;
+    }
+    std::optional<pin_reply> reply = pin_check.get();
+    if (!reply) {
+        interface_hardware.send(display_bank_unavailable());
+        state=&atm::done_processing;
+    } else if (std::holds_alternative<pin_verified>(*reply)) {
+        state=&atm::wait_for_action;
+    } else {
+        interface_hardware.send(
+            display_pin_incorrect_message());
+        state=&atm::done_processing;
+    }
 }
 
 void atm::getting_pin() {
@@ -69,9 +103,10 @@ void atm::getting_pin() {
     .handle<digit_pressed>(
         [&](digit_pressed const & msg) {
             unsigned const pin_length=4;
-            pin += msg.digit;
-            if (pin.length()==pin_length) {
-                bank.send(verify_pin(account, pin, incoming));
+            pin.push_back(msg.digit);
+            if (pin.size()==pin_length) {
+                pin_check = bank.ask<pin_reply>(verify_pin(account, pin));
+                bank_deadline = std::chrono::steady_clock::now() + bank_timeout;
                 state=&atm::verifying_pin;
             }
         })
@@ -94,7 +129,8 @@ void atm::waiting_for_card() {
     .handle<card_inserted>(
         [&](card_inserted const & msg) {
             account=msg.account;
-            pin="";
+            bank=route_bank(account);
+            pin.clear();
             interface_hardware.send(display_enter_card());
             state=&atm::getting_pin;
         });
@@ -110,13 +146,11 @@ void atm::done() {
 }
 
 void atm::run() {
+    incoming.set_wait_strategy(messaging::wait_strategy::adaptive);    // Keypresses follow the screens closely.
     state=&atm::waiting_for_card;
-    try {
-        for (; ;) {
-            (this->*state)();
-        }
-    }
-    catch (messaging::close_queue const & ) {}
+    incoming.run_until_closed([&] {
+        (this->*state)();
+    });
 }
 
 messaging::sender atm::get_sender() {
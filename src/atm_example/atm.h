@@ -1,15 +1,32 @@
 # pragma once
+#include <chrono>
+#include <functional>
+#include <string_view>
+#include <utility>
+
 #include "include/message_queue/receiver.h"
+#include "messages.h"
 
 
 class atm {
+    static constexpr std::chrono::seconds bank_timeout{30};    // How long to wait for any answer from the bank.
+    static constexpr std::chrono::milliseconds keypad_poll{10}; // How long the keypad goes unread meanwhile.
+
     messaging::receiver incoming;
-    messaging::sender bank;
+    std::function<messaging::sender(std::string_view)> route_bank;
+    messaging::sender bank;     // The bank holding the current card's account.
     messaging::sender interface_hardware;
     void (atm::*state) (){};
-    std::string account;
+    account_id account;
     unsigned withdrawal_amount{};
-    std::string pin;
+    pin_code pin;
+    messaging::reply_future<pin_reply> pin_check;      // The bank's answers, awaited by the states below.
+    messaging::reply_future<::balance> balance_query;
+    messaging::reply_future<withdraw_reply> withdrawal;
+    std::chrono::steady_clock::time_point bank_deadline;
+
+    template<typename Reply, typename OnGiveUp>
+    bool bank_answered(messaging::reply_future<Reply>& answer, OnGiveUp on_give_up);
 
     void process_withdrawal();
 
@@ -26,11 +43,21 @@ class atm {
     atm& operator=(const atm&) = delete;
 
 public:
+    using bank_router = std::function<messaging::sender(std::string_view account)>;
+
     atm(const messaging::sender bank_,
         const messaging::sender interface_hardware_):
-        bank(bank_), interface_hardware(interface_hardware_) {}
+        route_bank([bank_](std::string_view) { return bank_; }), interface_hardware(interface_hardware_) {}
+
+    // Asks `route_bank_` which bank holds the account of each card inserted, e.g. sharded_bank::shard_for.
+    atm(bank_router route_bank_,
+        const messaging::sender interface_hardware_):
+        route_bank(std::move(route_bank_)), interface_hardware(interface_hardware_) {}
 
     void done();
     void run();
     messaging::sender get_sender();
+
+    void enable_stats() { incoming.enable_stats(); }   // Before run(); see receiver::enable_stats().
+    messaging::mailbox_snapshot snapshot() const { return incoming.snapshot(); }
 };
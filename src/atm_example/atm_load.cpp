@@ -0,0 +1,248 @@
+//
+// Created by coolk on 19-10-2026.
+//
+// Copyright Aeva 2026
+//
+// Load generator for the ATM example. Build it optimised:
+//
+//   bazel run -c opt //:atm_load -- [atms] [bank shards] [sessions per atm] [think time us]
+//
+// Runs `atms` real atm state machines, each on its own thread, against a
+// sharded_bank of `bank shards` bank_machines, every ATM's customer holding
+// an account of their own. Every ATM has a scripted
+// customer on a thread of its own that plays the interface hardware: it
+// inserts a card, types a PIN, waits for the ATM's screens and presses keys
+// in reply, then thinks for the given time before the next card. The script
+// cycles through a withdrawal, a balance query and, every tenth card, a wrong
+// PIN. Reports
+//   * sessions/s and messages/s, counting the messages dispatched from every
+//     ATM, bank and customer mailbox (answers to asks go straight into the
+//     asker's reply_future and are not counted);
+//   * percentiles of the session time seen by the customers, and of the time
+//     messages spend in the ATM, bank and screen mailboxes before dispatch
+//     (read off log2 histograms, so each is an upper bound within a factor of
+//     two);
+//   * process CPU time (all threads, as std::clock() reports it) per message.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "atm.h"
+#include "messages.h"
+#include "sharded_bank.h"
+#include "include/message_queue/dispatcher.h"
+#include "include/message_queue/mailbox_stats.h"
+
+namespace {
+
+struct options {
+    unsigned atms = 16;
+    unsigned shards = 1;
+    uint64_t sessions = 2000;               // Per ATM.
+    std::chrono::microseconds think{0};     // Between one card and the next.
+};
+
+// Plays the interface hardware of one ATM and the customer in front of it.
+class customer {
+    messaging::receiver screen;
+    messaging::sender atm_keys;
+    account_id account;
+    messaging::latency_histogram session_times;
+
+    // Waits until the ATM shows `Shown` (true) or ejects the card (false).
+    template <typename Shown>
+    bool until_shown() {
+        bool shown = false;
+        bool ejected = false;
+        while (!shown && !ejected) {
+            screen.wait()
+                .handle<Shown>([&](Shown const&) { shown = true; })
+                .template handle<eject_card>([&](eject_card const&) { ejected = true; });
+        }
+        return shown;
+    }
+
+    void until_ejected() {
+        bool ejected = false;
+        while (!ejected) {
+            screen.wait().handle<eject_card>([&](eject_card const&) { ejected = true; });
+        }
+    }
+
+    void type_pin(char const* pin) {
+        for (char const* c = pin; *c != '\0'; ++c) {
+            atm_keys.send(digit_pressed(*c));
+        }
+    }
+
+    void session(uint64_t n) {
+        atm_keys.send(card_inserted(account));
+        type_pin(n % 10U == 9U ? "0000" : "1937");
+        if (!until_shown<display_withdrawal_options>()) {
+            return;     // Wrong PIN.
+        }
+        if (n % 2U == 0U) {
+            atm_keys.send(withdraw_pressed(50));
+            until_ejected();
+        } else {
+            atm_keys.send(balance_pressed());
+            if (until_shown<display_withdrawal_options>()) {    // Shown again after the balance.
+                atm_keys.send(cancel_pressed());
+                until_ejected();
+            }
+        }
+    }
+
+public:
+    explicit customer(unsigned index) : account("acc" + std::to_string(index)) {
+        screen.enable_stats();
+        screen.set_wait_strategy(messaging::wait_strategy::adaptive);
+    }
+
+    messaging::sender get_screen() { return screen; }
+    void set_atm(messaging::sender atm_) { atm_keys = atm_; }
+
+    void run(uint64_t sessions, std::chrono::microseconds think) {
+        for (uint64_t n = 0; n < sessions; ++n) {
+            const auto start = std::chrono::steady_clock::now();
+            session(n);
+            session_times.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+            if (think.count() != 0) {
+                std::this_thread::sleep_for(think);
+            }
+        }
+    }
+
+    messaging::histogram_snapshot session_snapshot() const { return session_times.snapshot(); }
+    messaging::mailbox_snapshot snapshot() const { return screen.snapshot(); }
+};
+
+void merge(messaging::histogram_snapshot& into, messaging::histogram_snapshot const& h) {
+    for (std::size_t b = 0; b < into.buckets.size(); ++b) {
+        into.buckets[b] += h.buckets[b];
+    }
+    into.count += h.count;
+    into.sum_ns += h.sum_ns;
+    into.max_ns = std::max(into.max_ns, h.max_ns);
+}
+
+// Adds the messages `m` dispatched to `messages` and its sojourn times to `sojourn`.
+void merge(messaging::mailbox_snapshot const& m, uint64_t& messages, messaging::histogram_snapshot& sojourn) {
+    for (auto const& t : m.types) {
+        messages += t.handled + t.dropped + t.stashed;
+    }
+    messages += m.other_types.handled + m.other_types.dropped + m.other_types.stashed;
+    merge(sojourn, m.sojourn);
+}
+
+void print_latency(char const* what, messaging::histogram_snapshot const& h) {
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    std::printf("%-16s %10.1f %10.1f %10.1f %10.1f %10.1f\n", what, h.mean_ns() / 1000.0, us(h.percentile_ns(0.5)),
+                us(h.percentile_ns(0.99)), us(h.percentile_ns(0.999)), us(h.max_ns));
+}
+
+options parse(int argc, char** argv) {
+    options o;
+    if (argc > 1) {
+        o.atms = static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10));
+    }
+    if (argc > 2) {
+        o.shards = static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10));
+    }
+    if (argc > 3) {
+        o.sessions = std::strtoull(argv[3], nullptr, 10);
+    }
+    if (argc > 4) {
+        o.think = std::chrono::microseconds(std::strtoll(argv[4], nullptr, 10));
+    }
+    if (o.atms == 0 || o.shards == 0) {
+        std::fprintf(stderr, "usage: atm_load [atms] [bank shards] [sessions per atm] [think time us]\n");
+        std::exit(1);
+    }
+    return o;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const options o = parse(argc, argv);
+
+    sharded_bank bank(o.shards);
+    bank.enable_stats();
+    const atm::bank_router route = [&bank](std::string_view account) { return bank.shard_for(account); };
+    std::vector<std::unique_ptr<customer>> customers;
+    std::vector<std::unique_ptr<atm>> atms;
+    for (unsigned i = 0; i < o.atms; ++i) {
+        customers.push_back(std::make_unique<customer>(i));
+        atms.push_back(std::make_unique<atm>(route, customers.back()->get_screen()));
+        atms.back()->enable_stats();
+        customers.back()->set_atm(atms.back()->get_sender());
+    }
+
+    bank.start();
+    std::vector<std::thread> atm_threads;
+    for (auto& a : atms) {
+        atm_threads.emplace_back(&atm::run, a.get());
+    }
+
+    const std::clock_t cpu_start = std::clock();
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> customer_threads;
+    for (auto& c : customers) {
+        customer_threads.emplace_back(&customer::run, c.get(), o.sessions, o.think);
+    }
+    for (auto& t : customer_threads) {
+        t.join();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const double cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    for (auto& a : atms) {
+        a->done();
+    }
+    for (auto& t : atm_threads) {
+        t.join();
+    }
+    bank.done();
+
+    uint64_t messages = 0;
+    messaging::histogram_snapshot sessions;
+    messaging::histogram_snapshot atm_sojourn;
+    messaging::histogram_snapshot bank_sojourn;
+    messaging::histogram_snapshot screen_sojourn;
+    for (auto const& c : customers) {
+        merge(sessions, c->session_snapshot());
+        merge(c->snapshot(), messages, screen_sojourn);
+    }
+    for (auto const& a : atms) {
+        merge(a->snapshot(), messages, atm_sojourn);
+    }
+    for (unsigned s = 0; s < bank.shard_count(); ++s) {
+        merge(bank.snapshot(s), messages, bank_sojourn);
+    }
+
+    std::printf("%u atms, %u bank shards, %llu sessions per atm, %lld us think time\n\n", o.atms, o.shards,
+                static_cast<unsigned long long>(o.sessions), static_cast<long long>(o.think.count()));
+    std::printf("%llu sessions in %.2f s: %.0f sessions/s, %llu messages, %.0f messages/s\n",
+                static_cast<unsigned long long>(sessions.count), elapsed.count(),
+                static_cast<double>(sessions.count) / elapsed.count(), static_cast<unsigned long long>(messages),
+                static_cast<double>(messages) / elapsed.count());
+    std::printf("cpu %.2f s, %.0f ns cpu per message\n\n", cpu_seconds,
+                cpu_seconds * 1e9 / static_cast<double>(messages));
+    std::printf("%-16s %10s %10s %10s %10s %10s\n", "latency us", "mean", "p50", "p99", "p99.9", "max");
+    print_latency("session", sessions);
+    print_latency("atm mailbox", atm_sojourn);
+    print_latency("bank mailbox", bank_sojourn);
+    print_latency("screen mailbox", screen_sojourn);
+    return 0;
+}
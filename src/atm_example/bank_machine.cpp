@@ -8,9 +8,13 @@
 #include "include/message_queue/dispatcher.h"
 
 bank_machine::bank_machine()
-    :balance(199)
+    :incoming(64)     // ATMs wait for the bank rather than let its backlog grow without limit.
 {
+    incoming.set_wait_strategy(messaging::wait_strategy::adaptive);    // Asked and answered in quick succession.
+}
 
+unsigned& bank_machine::balance_of(account_id const& account) {
+    return balances.try_emplace(account, opening_balance).first->second;
 }
 
 void bank_machine::done() {
@@ -18,37 +22,36 @@ void bank_machine::done() {
 }
 
 void bank_machine::run() {
-    try {
-        for (; ;) {
-            incoming.wait()
-            .handle<verify_pin>(
-                [&](verify_pin const& msg) {
-                    if (msg.pin == "1937") {
-                        msg.atm_queue.send(pin_verified());
-                    } else {
-                        msg.atm_queue.send(pin_incorrect());
-                    }
-                })
-            .handle<withdraw>(
-                [&](withdraw const& msg) {
-                    if (balance >= msg.amount) {
-                        msg.atm_queue.send(withdraw_ok());
-                        balance -= msg.amount;
-                    }
-                    else {
-                        msg.atm_queue.send(withdraw_denied());
-                    }
-                })
-            .handle<get_balance>(
-                [&](get_balance const& msg) {
-                    msg.atm_queue.send(::balance(balance));
-                })
-            .handle<withdrawal_processed>(
-                [&](withdrawal_processed const& msg) {})
-            .handle<cancel_withdrawal>(
-                [&](cancel_withdrawal const& msg) {});
-        }
-    } catch (messaging::close_queue const& e) {}
+    incoming.run_until_closed([&] {
+        incoming.wait()
+        .handle<verify_pin>(
+            [&](verify_pin const& msg) {
+                if (msg.pin == "1937") {
+                    msg.reply(pin_verified());
+                } else {
+                    msg.reply(pin_incorrect());
+                }
+            })
+        .handle<withdraw>(
+            [&](withdraw const& msg) {
+                unsigned& balance = balance_of(msg.account);
+                if (balance >= msg.amount) {
+                    msg.reply(withdraw_ok());
+                    balance -= msg.amount;
+                }
+                else {
+                    msg.reply(withdraw_denied());
+                }
+            })
+        .handle<get_balance>(
+            [&](get_balance const& msg) {
+                msg.reply(::balance(balance_of(msg.account)));
+            })
+        .handle<withdrawal_processed>(
+            [&](withdrawal_processed const& msg) {})
+        .handle<cancel_withdrawal>(
+            [&](cancel_withdrawal const& msg) {});
+    });
 }
 
 messaging::sender bank_machine::get_sender() {
@@ -4,11 +4,18 @@
 
 #ifndef BANK_MACHINE_H
 #define BANK_MACHINE_H
+#include <unordered_map>
+
 #include "include/message_queue/receiver.h"
+#include "messages.h"
 
 class bank_machine {
+    static constexpr unsigned opening_balance = 199;    // Of every account, the first time the bank hears of it.
+
     messaging::receiver incoming;
-    unsigned balance;
+    std::unordered_map<account_id, unsigned> balances;
+
+    unsigned& balance_of(account_id const& account);
 
 public:
     bank_machine();
@@ -18,6 +25,9 @@ public:
     void run();
 
     messaging::sender get_sender();
+
+    void enable_stats() { incoming.enable_stats(); }   // Before run(); see receiver::enable_stats().
+    messaging::mailbox_snapshot snapshot() const { return incoming.snapshot(); }
 };
 
 
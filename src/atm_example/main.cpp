@@ -59,10 +59,10 @@ int main() {
         }
     }
 
-    bank.done();
     machine.done();
+    atm_thread.join();      // The ATM may still be waiting for an answer from the bank.
+    bank.done();
     interface_hardware.done();
-    atm_thread.join();
     bank_thread.join();
     if_thread.join();
 
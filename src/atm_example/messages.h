@@ -1,17 +1,13 @@
 #pragma once
-#include <string>
-#include <utility>
+#include <type_traits>
+#include <variant>
 
+#include "include/message_queue/inline_string.h"
 #include "include/message_queue/sender.h"
 
-struct withdraw {
-    std::string account;
-    unsigned amount;
-    mutable messaging::sender atm_queue;
-
-    withdraw(std::string _account, const unsigned _amount, const messaging::sender _atm_queue):
-        account(std::move(_account)), amount(_amount), atm_queue(_atm_queue) {}
-};
+// Protocol text fields are held inline, so no message allocates beyond its node and every move is a copy of bytes.
+using account_id = messaging::inline_string<23>;
+using pin_code = messaging::inline_string<7>;
 
 struct withdraw_ok
 {};
@@ -19,25 +15,35 @@ struct withdraw_ok
 struct withdraw_denied
 {};
 
+using withdraw_reply = std::variant<withdraw_ok, withdraw_denied>;
+
+struct withdraw : messaging::request<withdraw_reply> {     // Asked by the ATM, answered by the bank.
+    account_id account;
+    unsigned amount;
+
+    withdraw(account_id _account, const unsigned _amount):
+        account(_account), amount(_amount) {}
+};
+
 struct cancel_withdrawal {
-    std::string account;
+    account_id account;
     unsigned amount;
 
-    cancel_withdrawal(std::string _account, const unsigned _amount):
-        account(std::move(_account)), amount(_amount) {}
+    cancel_withdrawal(account_id _account, const unsigned _amount):
+        account(_account), amount(_amount) {}
 };
 
 struct withdrawal_processed {
-    std::string account;
+    account_id account;
     unsigned amount;
-    withdrawal_processed(std::string _account, const unsigned _amount):
-     account(std::move(_account)), amount(_amount) {}
+    withdrawal_processed(account_id _account, const unsigned _amount):
+     account(_account), amount(_amount) {}
 };
 
 struct card_inserted {
-    std::string account;
-    explicit card_inserted(std::string _account):
-        account(std::move(_account)) {}
+    account_id account;
+    explicit card_inserted(account_id _account):
+        account(_account) {}
 };
 
 struct digit_pressed {
@@ -62,27 +68,31 @@ struct withdraw_pressed {
 struct cancel_pressed
 {};
 
+template<>  // Cancel overtakes any keypresses still queued for the ATM.
+struct messaging::is_control_message<cancel_pressed> : std::true_type {};
+
 struct issue_money {
     unsigned amount;
     issue_money(const unsigned _amount):
         amount(_amount){}
 };
 
-struct verify_pin {
-    std::string account;
-    std::string pin;
-    mutable messaging::sender atm_queue;
-
-    verify_pin(std::string _account, std::string _pin, const messaging::sender _atm_queue):
-        account(std::move(_account)), pin(std::move(_pin)), atm_queue(_atm_queue) {}
-};
-
 struct pin_verified
 {};
 
 struct pin_incorrect
 {};
 
+using pin_reply = std::variant<pin_verified, pin_incorrect>;
+
+struct verify_pin : messaging::request<pin_reply> {
+    account_id account;
+    pin_code pin;
+
+    verify_pin(account_id _account, pin_code _pin):
+        account(_account), pin(_pin) {}
+};
+
 struct display_enter_pin
 {};
 
@@ -98,16 +108,11 @@ struct display_withdrawal_cancelled
 struct display_pin_incorrect_message
 {};
 
-struct display_withdrawal_options
+struct display_bank_unavailable
 {};
 
-struct get_balance {
-    std::string account;
-    mutable messaging::sender atm_queue;
-
-    get_balance(std::string _account, const messaging::sender _atm_queue):
-        account(std::move(_account)), atm_queue(_atm_queue) {}
-};
+struct display_withdrawal_options
+{};
 
 struct balance {
     unsigned amount;
@@ -116,6 +121,13 @@ struct balance {
         amount(_amount){}
 };
 
+struct get_balance : messaging::request<balance> {
+    account_id account;
+
+    explicit get_balance(account_id _account):
+        account(_account) {}
+};
+
 struct display_balance {
     unsigned amount;
     explicit display_balance(const unsigned _amount):
@@ -0,0 +1,46 @@
+//
+// Created by coolk on 19-10-2026.
+//
+
+#include "sharded_bank.h"
+
+#include <functional>
+
+sharded_bank::sharded_bank(unsigned shard_count) {
+    for (unsigned s = 0; s < (shard_count == 0 ? 1U : shard_count); ++s) {
+        shards.push_back(std::make_unique<bank_machine>());
+    }
+}
+
+sharded_bank::~sharded_bank() {
+    done();
+}
+
+void sharded_bank::start() {
+    for (auto& shard : shards) {
+        threads.emplace_back(&bank_machine::run, shard.get());
+    }
+}
+
+void sharded_bank::done() {
+    if (threads.empty()) {
+        return;
+    }
+    for (auto& shard : shards) {
+        shard->done();
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    threads.clear();
+}
+
+messaging::sender sharded_bank::shard_for(std::string_view account) {
+    return shards[std::hash<std::string_view>{}(account) % shards.size()]->get_sender();
+}
+
+void sharded_bank::enable_stats() {
+    for (auto& shard : shards) {
+        shard->enable_stats();
+    }
+}
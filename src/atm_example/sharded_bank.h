@@ -0,0 +1,43 @@
+//
+// Created by coolk on 19-10-2026.
+//
+
+#ifndef SHARDED_BANK_H
+#define SHARDED_BANK_H
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bank_machine.h"
+#include "include/message_queue/receiver.h"
+
+/**
+ * A bank split into shards by account: each shard is a bank_machine with its own mailbox, account table and thread,
+ * and owns the accounts whose name hashes to it. A sender obtained from shard_for() for an account keeps every
+ * message about that account on one shard, in the order it was sent, while shards run in parallel.
+ */
+class sharded_bank {
+    std::vector<std::unique_ptr<bank_machine>> shards;
+    std::vector<std::thread> threads;
+
+public:
+    explicit sharded_bank(unsigned shard_count);
+    ~sharded_bank();
+
+    sharded_bank(const sharded_bank&) = delete;
+    sharded_bank& operator=(const sharded_bank&) = delete;
+
+    void start();   // One thread per shard.
+    void done();    // Closes every shard and joins its thread.
+
+    messaging::sender shard_for(std::string_view account);
+
+    unsigned shard_count() const { return static_cast<unsigned>(shards.size()); }
+    void enable_stats();    // Before start().
+    messaging::mailbox_snapshot snapshot(unsigned shard) const { return shards[shard]->snapshot(); }
+};
+
+
+
+#endif //SHARDED_BANK_H
@@ -7,15 +7,30 @@
 
 // Copyright Aeva 2026
 
-#include "Logger.h"
+#include "logger.h"
+
+// Statements below this level compile to nothing. Selected with
+// --define LOG_LEVEL=<DEBUG|INFO|WARN|ERROR>, see src/logger/BUILD.
+#ifndef SAFE_LOG_BUILD_LEVEL
+#define SAFE_LOG_BUILD_LEVEL kLOG_LEVEL_ERROR
+#endif
 
 constexpr auto BUILD_LOG_LEVEL =
-    aeva::safe::logger::LogLevel::kLOG_LEVEL_ERROR;
+    aeva::safe::logger::LogLevel::SAFE_LOG_BUILD_LEVEL;
 
 #define SAFE_LOG_ENABLED(LEVEL) (BUILD_LOG_LEVEL <= LEVEL)
 
-#define SAFE_LOG_EMIT(FMT, ...) \
-  aeva::safe::logger::Logger::instance().log(__FILE__, __LINE__, FMT, ##__VA_ARGS__);
+// Each call site registers its format string once; afterwards a record only
+// carries the event id and the raw argument bits.
+#define SAFE_LOG_EMIT(LEVEL, FMT, ...)                                   \
+  do {                                                                   \
+    auto& _logger = aeva::safe::logger::Logger::instance();              \
+    if (_logger.enabled(LEVEL)) {                                        \
+      static const uint32_t _event =                                     \
+          _logger.register_event(__FILE__, __LINE__, FMT);               \
+      _logger.log(LEVEL, _event, ##__VA_ARGS__);                         \
+    }                                                                    \
+  } while (0);
 
 #define SAFE_LOG_POLICY_ALWAYS(BODY) BODY
 
@@ -60,84 +75,118 @@ constexpr auto BUILD_LOG_LEVEL =
     }                                       \
   } while (0)
 
-#define LOG_INTERNAL(LEVEL, POLICY)     \
-  do {                                  \
-    if constexpr (LOG_ENABLED(LEVEL)) { \
-      POLICY                            \
-    }                                   \
+#define LOG_INTERNAL(LEVEL, POLICY)          \
+  do {                                       \
+    if constexpr (SAFE_LOG_ENABLED(LEVEL)) { \
+      POLICY                                 \
+    }                                        \
   } while (0)
 
-#define SAFE_LOG_DEBUG(FMT, ...) \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_DEBUG, FMT, __VA_ARGS__)
-#define SAFE_LOG_INFO(FMT, ...) \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_INFO, FMT, __VA_ARGS__)
-#define SAFE_LOG_WARN(FMT, ...) \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_INFO, FMT, __VA_ARGS__)
-#define SAFE_LOG_ERROR(FMT, ...) \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_ERROR, FMT, __VA_ARGS__)
-
-#define SAFE_LOG_DEBUG_IF(COND, FMT, ...)                      \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_DEBUG, \
-               LOG_POLICY_IF(COND, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_WARN_IF(COND, FMT, ...)                      \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_WARN, \
-               LOG_POLICY_IF(COND, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_INFO_IF(COND, FMT, ...)                      \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_INFO, \
-               LOG_POLICY_IF(COND, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_ERROR_IF(COND, FMT, ...)                      \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_ERROR, \
-               LOG_POLICY_IF(COND, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_DEBUG_EVERY_N(N, FMT, ...)                            \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_DEBUG, MODULE, \
-               LOG_POLICY_EVERY_N(N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_INFO_EVERY_N(N, FMT, ...)                            \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_INFO, MODULE, \
-               LOG_POLICY_EVERY_N(N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_WARN_EVERY_N(N, FMT, ...)                            \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_WARN, MODULE, \
-               LOG_POLICY_EVERY_N(N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_ERROR_EVERY_N(N, FMT, ...)                            \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_ERROR, MODULE, \
-               LOG_POLICY_EVERY_N(N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_DEBUG_FIRST_N(N, FMT, ...)                    \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_DEBUG, \
-               LOG_POLICY_FIRST_N(N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_INFO_FIRST_N(N, FMT, ...)                    \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_INFO, \
-               LOG_POLICY_FIRST_N(N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_WARN_FIRST_N(N, FMT, ...)                    \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_WARN, \
-               LOG_POLICY_FIRST_N(N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_ERROR_FIRST_N(N, FMT, ...)                    \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_ERROR, \
-               LOG_POLICY_FIRST_N(N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_DEBUG_IF_EVERY_N(COND, N, FMT, ...)                   \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_DEBUG, MODULE, \
-               LOG_POLICY_IF_EVERY_N(COND, N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_WARN_IF_EVERY_N(COND, N, FMT, ...)                   \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_WARN, MODULE, \
-               LOG_POLICY_IF_EVERY_N(COND, N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_ERROR_IF_EVERY_N(COND, N, FMT, ...)                   \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_ERROR, MODULE, \
-               LOG_POLICY_IF_EVERY_N(COND, N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
-
-#define SAFE_LOG_INFO_IF_EVERY_N(COND, N, FMT, ...)                   \
-  LOG_INTERNAL(aeva::safe::logger::LogLevel::kLOG_LEVEL_INFO, MODULE, \
-               LOG_POLICY_IF_EVERY_N(COND, N, SAFE_LOG_EMIT(FMT, __VA_ARGS__)))
+#define SAFE_LOG_LEVEL(NAME) aeva::safe::logger::LogLevel::NAME
+
+#define SAFE_LOG_AT(NAME, POLICY) LOG_INTERNAL(SAFE_LOG_LEVEL(NAME), POLICY)
+
+#define SAFE_LOG_EMIT_AT(NAME, FMT, ...) \
+  SAFE_LOG_EMIT(SAFE_LOG_LEVEL(NAME), FMT, ##__VA_ARGS__)
+
+#define SAFE_LOG_DEBUG(FMT, ...)      \
+  SAFE_LOG_AT(kLOG_LEVEL_DEBUG,       \
+              SAFE_LOG_POLICY_ALWAYS( \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_DEBUG, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_INFO(FMT, ...)       \
+  SAFE_LOG_AT(kLOG_LEVEL_INFO,        \
+              SAFE_LOG_POLICY_ALWAYS( \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_INFO, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_WARN(FMT, ...)       \
+  SAFE_LOG_AT(kLOG_LEVEL_WARN,        \
+              SAFE_LOG_POLICY_ALWAYS( \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_WARN, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_ERROR(FMT, ...)      \
+  SAFE_LOG_AT(kLOG_LEVEL_ERROR,       \
+              SAFE_LOG_POLICY_ALWAYS( \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_ERROR, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_DEBUG_IF(COND, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_DEBUG,           \
+              LOG_POLICY_IF(COND,         \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_DEBUG, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_INFO_IF(COND, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_INFO,           \
+              LOG_POLICY_IF(COND,        \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_INFO, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_WARN_IF(COND, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_WARN,           \
+              LOG_POLICY_IF(COND,        \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_WARN, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_ERROR_IF(COND, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_ERROR,           \
+              LOG_POLICY_IF(COND,         \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_ERROR, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_DEBUG_EVERY_N(N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_DEBUG,             \
+              LOG_POLICY_EVERY_N(N,         \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_DEBUG, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_INFO_EVERY_N(N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_INFO,             \
+              LOG_POLICY_EVERY_N(N,        \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_INFO, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_WARN_EVERY_N(N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_WARN,             \
+              LOG_POLICY_EVERY_N(N,        \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_WARN, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_ERROR_EVERY_N(N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_ERROR,             \
+              LOG_POLICY_EVERY_N(N,         \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_ERROR, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_DEBUG_FIRST_N(N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_DEBUG,             \
+              LOG_POLICY_FIRST_N(N,         \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_DEBUG, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_INFO_FIRST_N(N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_INFO,             \
+              LOG_POLICY_FIRST_N(N,        \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_INFO, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_WARN_FIRST_N(N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_WARN,             \
+              LOG_POLICY_FIRST_N(N,        \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_WARN, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_ERROR_FIRST_N(N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_ERROR,             \
+              LOG_POLICY_FIRST_N(N,         \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_ERROR, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_DEBUG_IF_EVERY_N(COND, N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_DEBUG,                      \
+              LOG_POLICY_IF_EVERY_N(COND, N,         \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_DEBUG, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_INFO_IF_EVERY_N(COND, N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_INFO,                      \
+              LOG_POLICY_IF_EVERY_N(COND, N,        \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_INFO, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_WARN_IF_EVERY_N(COND, N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_WARN,                      \
+              LOG_POLICY_IF_EVERY_N(COND, N,        \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_WARN, FMT, ##__VA_ARGS__)))
+
+#define SAFE_LOG_ERROR_IF_EVERY_N(COND, N, FMT, ...) \
+  SAFE_LOG_AT(kLOG_LEVEL_ERROR,                      \
+              LOG_POLICY_IF_EVERY_N(COND, N,         \
+                  SAFE_LOG_EMIT_AT(kLOG_LEVEL_ERROR, FMT, ##__VA_ARGS__)))
 
 #endif //LOGGER_LOG_H
\ No newline at end of file
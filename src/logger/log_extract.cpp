@@ -0,0 +1,260 @@
+//
+// Created by coolk on 19-10-2026.
+//
+// Copyright Aeva 2026
+//
+// Post-mortem reader for logger regions.
+//
+//   log_extract [-n N] <region file | shm name | core file | binary log>
+//
+// Prints the last N records (default 100) of every ring of every log region
+// found in the input. A region file or /dev/shm object starts with the region
+// header; a core file is scanned page by page for the header magic, which
+// works because regions are page aligned mappings and core dumps keep segment
+// data page aligned. Records the backend had not consumed yet are marked with '*'.
+// Files written by BinaryFileSink are recognised by their own magic.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "log_region.h"
+#include "log_sink.h"
+
+using aeva::safe::logger::decode_compact;
+using aeva::safe::logger::EventInfo;
+using aeva::safe::logger::format_record;
+using aeva::safe::logger::is_valid_region;
+using aeva::safe::logger::kBinaryEventHeaderSize;
+using aeva::safe::logger::kBinaryEventTag;
+using aeva::safe::logger::kBinaryHeaderSize;
+using aeva::safe::logger::kBinaryMagic;
+using aeva::safe::logger::kBinaryRecordTag;
+using aeva::safe::logger::kBinaryVersion;
+using aeva::safe::logger::lookup_event;
+using aeva::safe::logger::kRegionAlignment;
+using aeva::safe::logger::load_sequence;
+using aeva::safe::logger::LogRecord;
+using aeva::safe::logger::RegionHeader;
+using aeva::safe::logger::ring_header;
+using aeva::safe::logger::ring_slots;
+using aeva::safe::logger::RingHeader;
+
+namespace {
+
+void usage(const char* program) {
+  std::fprintf(stderr,
+               "usage: %s [-n N] <region file | shm name | core file | "
+               "binary log>\n",
+               program);
+}
+
+// Accept "/name" or "name" for objects created with kSharedMemory.
+std::string resolve_path(const char* arg) {
+  struct stat st {};
+  if (::stat(arg, &st) == 0 || std::strchr(arg + 1, '/') != nullptr) {
+    return arg;
+  }
+  std::string shm = "/dev/shm/";
+  shm += arg[0] == '/' ? arg + 1 : arg;
+  return shm;
+}
+
+void dump_ring(const RegionHeader* header, uint32_t index,
+               std::size_t last_n) {
+  const RingHeader* ring = ring_header(header, index);
+  const uint64_t write = ring->write_index.load(std::memory_order_acquire);
+  const uint64_t read = ring->read_index.load(std::memory_order_acquire);
+  const uint64_t capacity = ring->slot_count;
+  const LogRecord* slots = ring_slots(header, ring);
+
+  std::printf(" ring %u", index);
+  if (ring->node != aeva::safe::logger::kNoNumaNode) {
+    std::printf(" (node %d)", ring->node);
+  }
+  std::printf(": written %llu, consumed %llu\n",
+              static_cast<unsigned long long>(write),
+              static_cast<unsigned long long>(read));
+
+  // Only positions in [write - capacity, write) can still be in the ring; a
+  // slot holds position `pos` if it was published (pos + 1) or published and
+  // consumed (pos + capacity). Anything else was torn by the crash.
+  const uint64_t first = write > capacity ? write - capacity : 0U;
+  const uint64_t start =
+      write - first > last_n ? write - static_cast<uint64_t>(last_n) : first;
+  char line[512];
+  for (uint64_t pos = start; pos < write; ++pos) {
+    const LogRecord& slot = slots[pos & (capacity - 1U)];
+    const uint64_t seq = load_sequence(slot);
+    if (seq != pos + 1U && seq != pos + capacity) {
+      std::printf("  %llu <incomplete>\n", static_cast<unsigned long long>(pos));
+      continue;
+    }
+    EventInfo event{};
+    const bool known = lookup_event(header, slot.event_id, event);
+    format_record(known ? &event : nullptr, slot, line, sizeof(line));
+    std::printf("%c %s\n", pos >= read ? '*' : ' ', line);
+  }
+}
+
+// Rings are listed one after the other; within a ring records are in
+// publication order. Timestamps order records across rings.
+void dump_region(const RegionHeader* header, std::size_t last_n) {
+  std::printf("region '%s' pid %d: %u ring(s), dropped %llu\n",
+              header->logger_name, header->pid, header->ring_count,
+              static_cast<unsigned long long>(
+                  header->dropped.load(std::memory_order_relaxed)));
+  for (uint32_t r = 0; r < header->ring_count; ++r) {
+    dump_ring(header, r, last_n);
+  }
+}
+
+bool is_binary_log(const char* base, std::size_t size) {
+  return size >= kBinaryHeaderSize &&
+         std::memcmp(base, kBinaryMagic, sizeof(kBinaryMagic)) == 0;
+}
+
+bool has_known_version(const char* base) {
+  uint32_t version;
+  std::memcpy(&version, base + sizeof(kBinaryMagic), sizeof(version));
+  return version == kBinaryVersion;
+}
+
+// Walks a BinaryFileSink stream. Calls `on_record` for every record with the
+// definition of its event (or nullptr); returns false on a truncated entry,
+// which is expected for the tail of a file whose writer died.
+template <typename OnRecord>
+bool walk_binary_log(const char* base, std::size_t size, OnRecord on_record) {
+  std::unordered_map<uint32_t, EventInfo> events;
+  std::size_t offset = kBinaryHeaderSize;
+  while (offset < size) {
+    const char tag = base[offset++];
+    if (tag == kBinaryEventTag) {
+      uint32_t id;
+      uint16_t file_size;
+      uint16_t format_size;
+      EventInfo event{};
+      if (size - offset < kBinaryEventHeaderSize) {
+        return false;
+      }
+      std::memcpy(&id, base + offset, 4U);
+      std::memcpy(&event.line, base + offset + 4U, 4U);
+      std::memcpy(&file_size, base + offset + 8U, 2U);
+      std::memcpy(&format_size, base + offset + 10U, 2U);
+      offset += kBinaryEventHeaderSize;
+      if (file_size == 0U || format_size == 0U ||
+          size - offset < std::size_t{file_size} + format_size) {
+        return false;
+      }
+      event.file = base + offset;
+      event.format = base + offset + file_size;
+      offset += std::size_t{file_size} + format_size;
+      events[id] = event;
+    } else if (tag == kBinaryRecordTag) {
+      LogRecord record{};
+      const std::size_t used = decode_compact(base + offset, size - offset, record);
+      if (used == 0U) {
+        return false;
+      }
+      offset += used;
+      const auto it = events.find(record.event_id);
+      on_record(it == events.end() ? nullptr : &it->second, record);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void dump_binary_log(const char* base, std::size_t size, std::size_t last_n) {
+  std::size_t total = 0U;
+  const bool complete = walk_binary_log(
+      base, size, [&](const EventInfo*, const LogRecord&) { ++total; });
+  std::printf("binary log: %zu records%s\n", total,
+              complete ? "" : ", truncated tail ignored");
+
+  const std::size_t skip = total > last_n ? total - last_n : 0U;
+  std::size_t index = 0U;
+  char line[512];
+  walk_binary_log(base, size,
+                  [&](const EventInfo* event, const LogRecord& record) {
+                    if (index++ >= skip) {
+                      format_record(event, record, line, sizeof(line));
+                      std::printf("  %s\n", line);
+                    }
+                  });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t last_n = 100U;
+  int opt;
+  while ((opt = ::getopt(argc, argv, "n:")) != -1) {
+    if (opt == 'n') {
+      last_n = std::strtoull(optarg, nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (optind + 1 != argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  const std::string path = resolve_path(argv[optind]);
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat st {};
+  if (fd < 0 || ::fstat(fd, &st) != 0) {
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+    return 1;
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  void* map = size == 0U ? MAP_FAILED
+                         : ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    std::fprintf(stderr, "%s: cannot map file\n", path.c_str());
+    return 1;
+  }
+
+  const auto* base = static_cast<const char*>(map);
+  if (is_binary_log(base, size)) {
+    if (!has_known_version(base)) {
+      std::fprintf(stderr, "%s: unsupported binary log version\n",
+                   path.c_str());
+      ::munmap(map, size);
+      return 1;
+    }
+    dump_binary_log(base, size, last_n);
+    ::munmap(map, size);
+    return 0;
+  }
+
+  std::size_t found = 0U;
+  for (std::size_t offset = 0U; offset < size; offset += kRegionAlignment) {
+    if (is_valid_region(base + offset, size - offset)) {
+      const auto* header = reinterpret_cast<const RegionHeader*>(base + offset);
+      dump_region(header, last_n);
+      offset += header->region_size - kRegionAlignment;
+      ++found;
+    }
+  }
+  ::munmap(map, size);
+
+  if (found == 0U) {
+    std::fprintf(stderr, "%s: no log region found\n", path.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+//
+// Created by coolk on 24-03-2026.
+//
+
+#ifndef LOGGER_LOG_RECORD_H
+#define LOGGER_LOG_RECORD_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace aeva::safe::logger {
+
+enum class LogLevel : uint8_t {
+  kLOG_LEVEL_INFO = 0,
+  kLOG_LEVEL_WARN = 1,
+  kLOG_LEVEL_DEBUG = 2,
+  kLOG_LEVEL_ERROR = 3
+};
+
+enum class ArgType : uint8_t {
+  U32,
+  I32,
+  F32,
+};
+
+union ArgValue {
+  uint32_t u32;
+  int32_t i32;
+  float f32;
+};
+struct LogArg {
+  ArgType type;
+  ArgValue value;
+};
+template <std::size_t N>
+struct LogPayload {
+  LogArg args[N];
+  uint8_t count;
+};
+
+template <typename T>
+constexpr LogArg encode_one(T value) {
+  if constexpr (std::is_same_v<T, uint32_t>) {
+    return {ArgType::U32, {.u32 = value}};
+  } else if constexpr (std::is_same_v<T, int32_t>) {
+    return {ArgType::I32, {.i32 = value}};
+  } else if constexpr (std::is_same_v<T, float>) {
+    return {ArgType::F32, {.f32 = value}};
+  } else {
+    static_assert(sizeof(T) == 0, "Unsupported type");
+    return {ArgType::F32, {.f32 = value}};
+  }
+}
+
+template <typename... Args>
+constexpr auto make_payload(Args&&... args) {
+  constexpr std::size_t N = sizeof...(args);
+
+  LogPayload<N> payload{};
+  payload.count = static_cast<uint8_t>(N);
+
+  if constexpr (N > 0) {
+    LogArg tmp[] = {encode_one(std::forward<Args>(args))...};
+
+    for (std::size_t i = 0; i < N; ++i) {
+      payload.args[i] = tmp[i];
+    }
+  }
+
+  return payload;
+}
+
+constexpr std::size_t MAX_ARGS = 8;
+
+/// Bit layout of LogRecord::header: the argument types as 3-bit fields, then
+/// the argument count and the level.
+constexpr uint32_t kArgTypeBits = 3U;
+constexpr uint32_t kArgTypeMask = (1U << kArgTypeBits) - 1U;
+constexpr uint32_t kCountShift = kArgTypeBits * MAX_ARGS;
+constexpr uint32_t kCountMask = 0xFU;
+constexpr uint32_t kLevelShift = kCountShift + 4U;
+constexpr uint32_t kLevelMask = 0x7U;
+
+static_assert(static_cast<uint32_t>(ArgType::F32) <= kArgTypeMask,
+              "ArgType no longer fits in its header field");
+static_assert(MAX_ARGS <= kCountMask, "count no longer fits in its header field");
+static_assert(kLevelShift + 3U <= 32U, "LogRecord header overflows 32 bits");
+
+/// One log record, exactly one cache line. A ring slot *is* a LogRecord: the
+/// ring owns `sequence`, everything after it is the record proper, and
+/// producers never share a line with each other.
+struct alignas(64) LogRecord {
+  uint64_t sequence;        // Ring publication word, see LogRegion.
+  uint64_t timestamp;
+  uint32_t event_id;
+  uint32_t header;          // Packed types, count and level.
+  uint32_t data[MAX_ARGS];  // raw bits (floats included)
+  uint32_t thread;          // Small per-thread index of the producer.
+  uint32_t reserved;
+
+  constexpr uint32_t count() const {
+    return (header >> kCountShift) & kCountMask;
+  }
+
+  constexpr ArgType type(std::size_t i) const {
+    return static_cast<ArgType>((header >> (i * kArgTypeBits)) & kArgTypeMask);
+  }
+
+  constexpr LogLevel level() const {
+    return static_cast<LogLevel>((header >> kLevelShift) & kLevelMask);
+  }
+};
+
+static_assert(sizeof(LogRecord) == 64, "LogRecord must fill one cache line");
+static_assert(alignof(LogRecord) == 64, "LogRecord must be cache line aligned");
+static_assert(std::is_trivially_copyable_v<LogRecord>,
+              "LogRecord is copied into shared memory byte-wise");
+
+/// Offset of the part of a record a producer writes; the bytes before it
+/// belong to the ring.
+constexpr std::size_t kRecordBodyOffset = sizeof(uint64_t);
+constexpr std::size_t kRecordBodySize = sizeof(LogRecord) - kRecordBodyOffset;
+
+template <std::size_t N>
+constexpr LogRecord to_record(LogLevel level, uint32_t event_id,
+                              const LogPayload<N>& p) {
+  static_assert(N <= MAX_ARGS, "A maximum of 8 arguments are supported");
+  LogRecord r{};
+  r.event_id = event_id;
+  r.header = (static_cast<uint32_t>(p.count) << kCountShift) |
+             (static_cast<uint32_t>(level) << kLevelShift);
+
+  for (std::size_t i = 0; i < p.count; ++i) {
+    r.header |= static_cast<uint32_t>(p.args[i].type) << (i * kArgTypeBits);
+    switch (p.args[i].type) {
+      case ArgType::U32:
+        r.data[i] = p.args[i].value.u32;
+        break;
+      case ArgType::I32:
+        r.data[i] = static_cast<uint32_t>(p.args[i].value.i32);
+        break;
+      case ArgType::F32:
+        r.data[i] = std::bit_cast<uint32_t>(p.args[i].value.f32);
+        break;
+      default: ;
+    }
+  }
+
+  return r;
+}
+
+/// Variable-length encoding for records leaving the ring (files, sockets):
+/// timestamp, event id, header and thread, followed by only the `count()`
+/// arguments actually used. All fields are little-endian host order.
+constexpr std::size_t kCompactHeaderSize =
+    sizeof(uint64_t) + 3U * sizeof(uint32_t);
+constexpr std::size_t kCompactMaxSize =
+    kCompactHeaderSize + MAX_ARGS * sizeof(uint32_t);
+
+constexpr std::size_t compact_size(const LogRecord& r) {
+  return kCompactHeaderSize + r.count() * sizeof(uint32_t);
+}
+
+/// Writes `r` to `out` (at least compact_size(r) bytes) and returns the number
+/// of bytes written.
+inline std::size_t encode_compact(const LogRecord& r, void* out) {
+  auto* p = static_cast<char*>(out);
+  std::memcpy(p, &r.timestamp, sizeof(r.timestamp));
+  std::memcpy(p + 8, &r.event_id, sizeof(r.event_id));
+  std::memcpy(p + 12, &r.header, sizeof(r.header));
+  std::memcpy(p + 16, &r.thread, sizeof(r.thread));
+  std::memcpy(p + kCompactHeaderSize, r.data, r.count() * sizeof(uint32_t));
+  return compact_size(r);
+}
+
+/// Reads one compact record from `in`. Returns the number of bytes consumed,
+/// or 0 when `available` does not hold a complete, well-formed record.
+inline std::size_t decode_compact(const void* in, std::size_t available,
+                                  LogRecord& r) {
+  if (available < kCompactHeaderSize) {
+    return 0U;
+  }
+  const auto* p = static_cast<const char*>(in);
+  r = LogRecord{};
+  std::memcpy(&r.timestamp, p, sizeof(r.timestamp));
+  std::memcpy(&r.event_id, p + 8, sizeof(r.event_id));
+  std::memcpy(&r.header, p + 12, sizeof(r.header));
+  std::memcpy(&r.thread, p + 16, sizeof(r.thread));
+  if (r.count() > MAX_ARGS || compact_size(r) > available) {
+    return 0U;
+  }
+  std::memcpy(r.data, p + kCompactHeaderSize, r.count() * sizeof(uint32_t));
+  return compact_size(r);
+}
+
+} // namespace aeva::safe::logger
+
+#endif //LOGGER_LOG_RECORD_H
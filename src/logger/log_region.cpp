@@ -0,0 +1,410 @@
+//
+// Created by coolk on 19-10-2026.
+//
+// Copyright Aeva 2026
+
+#include "log_region.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+
+namespace aeva::safe::logger {
+
+namespace {
+
+constexpr std::size_t round_up(std::size_t value, std::size_t alignment) {
+  return (value + alignment - 1U) & ~(alignment - 1U);
+}
+
+constexpr bool is_power_of_two(uint32_t value) {
+  return value != 0U && (value & (value - 1U)) == 0U;
+}
+
+// Event table entry. `file` and `format` follow the entry as NUL terminated
+// strings; entries are 4 byte aligned and the entry's offset is its event id.
+struct EventEntry {
+  uint32_t line;
+  uint16_t file_size;    // Including the NUL.
+  uint16_t format_size;  // Including the NUL.
+};
+
+#if defined(__linux__)
+constexpr int kMpolPreferred = 1;  // MPOL_PREFERRED from <linux/mempolicy.h>.
+#endif
+
+// Asks the kernel to allocate the (not yet touched) pages of [addr, addr+len)
+// on `node`. Preferred rather than strict, so a full node falls back to
+// another one instead of failing the first write. Best effort: without NUMA
+// support the call fails and the pages land wherever the kernel puts them.
+bool bind_to_node(void* addr, std::size_t len, uint32_t node) {
+#if defined(__linux__) && defined(SYS_mbind)
+  if (node >= 64U) {
+    return false;
+  }
+  const unsigned long mask = 1UL << node;
+  return ::syscall(SYS_mbind, addr, len, kMpolPreferred, &mask,
+                   sizeof(mask) * 8U + 1U, 0U) == 0;
+#else
+  (void)addr;
+  (void)len;
+  (void)node;
+  return false;
+#endif
+}
+
+// Whether `fd` already holds a region this build can read: the records of an
+// earlier run that did not exit cleanly, or of a process still logging there.
+bool holds_region(int fd) {
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(RegionHeader))) {
+    return false;
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  void* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  const bool valid = is_valid_region(map, size);
+  ::munmap(map, size);
+  return valid;
+}
+
+}  // namespace
+
+uint32_t numa_node_count() {
+  static const uint32_t count = [] {
+    // "0" or "0-3" (or a list such as "0,2-3"); the highest id is last.
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodes;
+    if (!(online >> nodes) || nodes.empty()) {
+      return 1U;
+    }
+    const std::size_t last = nodes.find_last_of(",-");
+    const unsigned long highest = std::strtoul(
+        nodes.c_str() + (last == std::string::npos ? 0U : last + 1U), nullptr,
+        10);
+    return static_cast<uint32_t>(highest) + 1U;
+  }();
+  return count;
+}
+
+uint32_t current_numa_node() {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu = 0U;
+  unsigned node = 0U;
+  if (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+    return node;
+  }
+#endif
+  return 0U;
+}
+
+std::unique_ptr<LogRegion> LogRegion::create(const char* logger_name,
+                                             const Options& options) {
+  if (!is_power_of_two(options.slot_count)) {
+    std::fprintf(stderr, "logger: slot_count %u is not a power of two\n",
+                 options.slot_count);
+    return nullptr;
+  }
+
+  const uint32_t nodes = numa_node_count();
+  const uint32_t ring_count =
+      options.ring_count != 0U ? options.ring_count : nodes;
+  const std::size_t rings_offset =
+      round_up(sizeof(RegionHeader), kRegionAlignment);
+  const std::size_t ring_slots_offset =
+      round_up(sizeof(RingHeader), alignof(LogRecord));
+  const std::size_t ring_stride = round_up(
+      ring_slots_offset + sizeof(LogRecord) * options.slot_count,
+      kRegionAlignment);
+  const std::size_t strings_offset = rings_offset + ring_stride * ring_count;
+  const std::size_t size =
+      round_up(strings_offset + options.strings_capacity, kRegionAlignment);
+
+  std::unique_ptr<LogRegion> region(new LogRegion());
+  region->kind_ = options.kind;
+  region->size_ = size;
+  region->unlink_on_close_ = options.unlink_on_close;
+
+  void* base = MAP_FAILED;
+  if (options.kind == RegionKind::kAnonymous) {
+    base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  } else {
+    if (options.name == nullptr ||
+        std::strlen(options.name) >= sizeof(region->name_)) {
+      std::fprintf(stderr, "logger: a region name is required\n");
+      return nullptr;
+    }
+    std::strncpy(region->name_, options.name, sizeof(region->name_) - 1U);
+    region->fd_ = options.kind == RegionKind::kSharedMemory
+                      ? ::shm_open(options.name, O_CREAT | O_RDWR, 0600)
+                      : ::open(options.name, O_CREAT | O_RDWR, 0600);
+    if (region->fd_ >= 0 && holds_region(region->fd_)) {
+      // Never truncate it: those records are what log_extract recovers.
+      std::fprintf(stderr,
+                   "logger: %s holds the log region of an earlier run; "
+                   "recover it with log_extract and remove it, or choose "
+                   "another name\n",
+                   options.name);
+      ::close(region->fd_);
+      region->fd_ = -1;  // Not ours to unlink either.
+      return nullptr;
+    }
+    if (region->fd_ < 0 || ::ftruncate(region->fd_, 0) != 0 ||
+        ::ftruncate(region->fd_, static_cast<off_t>(size)) != 0) {
+      std::fprintf(stderr, "logger: cannot create region %s: %s\n",
+                   options.name, std::strerror(errno));
+      return nullptr;
+    }
+    base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  region->fd_, 0);
+  }
+  if (base == MAP_FAILED) {
+    std::fprintf(stderr, "logger: mmap of %zu bytes failed: %s\n", size,
+                 std::strerror(errno));
+    return nullptr;
+  }
+
+  auto* header = new (base) RegionHeader{};
+  std::memcpy(header->magic, kRegionMagic, sizeof(kRegionMagic));
+  header->version = kRegionVersion;
+  header->header_size = sizeof(RegionHeader);
+  header->ring_header_size = sizeof(RingHeader);
+  header->slot_size = sizeof(LogRecord);
+  header->slot_count = options.slot_count;
+  header->ring_count = ring_count;
+  header->max_args = MAX_ARGS;
+  header->pid = static_cast<int32_t>(::getpid());
+  header->region_size = size;
+  header->rings_offset = rings_offset;
+  header->ring_stride = ring_stride;
+  header->strings_offset = strings_offset;
+  header->strings_capacity = options.strings_capacity;
+  if (logger_name != nullptr) {
+    std::strncpy(header->logger_name, logger_name, kLoggerNameSize - 1U);
+  }
+
+  region->rings_.reserve(ring_count);
+  for (uint32_t r = 0; r < ring_count; ++r) {
+    char* ring_base = static_cast<char*>(base) + rings_offset + ring_stride * r;
+    // Bind before the loop below touches the pages: that first touch is what
+    // allocates them.
+    const uint32_t node = r % nodes;
+    const bool bound = nodes > 1U && bind_to_node(ring_base, ring_stride, node);
+
+    auto* ring = new (ring_base) RingHeader{};
+    ring->node = bound ? static_cast<int32_t>(node) : kNoNumaNode;
+    ring->slot_count = options.slot_count;
+    ring->slots_offset = rings_offset + ring_stride * r + ring_slots_offset;
+    auto* slots = reinterpret_cast<LogRecord*>(ring_base + ring_slots_offset);
+    for (uint32_t i = 0; i < options.slot_count; ++i) {
+      new (&slots[i]) LogRecord{};
+      slots[i].sequence = i;
+    }
+    region->rings_.emplace_back(ring, slots);
+  }
+
+  region->header_ = header;
+  region->ring_count_ = ring_count;
+  return region;
+}
+
+uint64_t LogRegion::written() const {
+  uint64_t total = 0U;
+  for (const LogRing& ring : rings_) {
+    total += ring.header()->write_index.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+LogRegion::~LogRegion() {
+  if (header_ != nullptr) {
+    ::munmap(header_, size_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    if (unlink_on_close_) {
+      if (kind_ == RegionKind::kSharedMemory) {
+        ::shm_unlink(name_);
+      } else {
+        ::unlink(name_);
+      }
+    }
+  }
+}
+
+uint32_t LogRegion::add_event(const char* file, uint32_t line,
+                              const char* format) {
+  const std::size_t file_size = std::strlen(file) + 1U;
+  const std::size_t format_size = std::strlen(format) + 1U;
+  if (file_size > UINT16_MAX || format_size > UINT16_MAX) {
+    return kUnknownEvent;
+  }
+  const std::size_t entry_size =
+      round_up(sizeof(EventEntry) + file_size + format_size, 4U);
+
+  // Callers serialise registration; the release store below only orders the
+  // entry bytes for a post-mortem reader.
+  const uint64_t offset =
+      header_->strings_used.load(std::memory_order_relaxed);
+  if (offset + entry_size > header_->strings_capacity) {
+    return kUnknownEvent;
+  }
+
+  char* base = reinterpret_cast<char*>(header_) + header_->strings_offset;
+  EventEntry entry{line, static_cast<uint16_t>(file_size),
+                   static_cast<uint16_t>(format_size)};
+  std::memcpy(base + offset, &entry, sizeof(entry));
+  std::memcpy(base + offset + sizeof(entry), file, file_size);
+  std::memcpy(base + offset + sizeof(entry) + file_size, format, format_size);
+  header_->strings_used.store(offset + entry_size, std::memory_order_release);
+  return static_cast<uint32_t>(offset);
+}
+
+bool is_valid_region(const void* base, std::size_t available) {
+  if (available < sizeof(RegionHeader)) {
+    return false;
+  }
+  const auto* header = static_cast<const RegionHeader*>(base);
+  if (std::memcmp(header->magic, kRegionMagic, sizeof(kRegionMagic)) != 0 ||
+      header->version != kRegionVersion ||
+      header->header_size != sizeof(RegionHeader) ||
+      header->ring_header_size != sizeof(RingHeader) ||
+      header->slot_size != sizeof(LogRecord) ||
+      !is_power_of_two(header->slot_count) || header->ring_count == 0U ||
+      header->region_size > available ||
+      header->rings_offset < sizeof(RegionHeader) ||
+      header->rings_offset + header->ring_stride * header->ring_count >
+          header->strings_offset ||
+      header->strings_offset + header->strings_capacity >
+          header->region_size) {
+    return false;
+  }
+  for (uint32_t r = 0; r < header->ring_count; ++r) {
+    const RingHeader* ring = ring_header(header, r);
+    const uint64_t ring_offset =
+        header->rings_offset + header->ring_stride * r;
+    if (ring->slot_count != header->slot_count ||
+        ring->slots_offset < ring_offset + sizeof(RingHeader) ||
+        ring->slots_offset + static_cast<uint64_t>(header->slot_size) *
+                                 header->slot_count >
+            ring_offset + header->ring_stride) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool lookup_event(const RegionHeader* header, uint32_t event_id,
+                  EventInfo& info) {
+  const uint64_t used = header->strings_used.load(std::memory_order_acquire);
+  if (event_id == kUnknownEvent || event_id + sizeof(EventEntry) > used) {
+    return false;
+  }
+  const char* base =
+      reinterpret_cast<const char*>(header) + header->strings_offset;
+  EventEntry entry{};
+  std::memcpy(&entry, base + event_id, sizeof(entry));
+  if (event_id + sizeof(entry) + entry.file_size + entry.format_size > used) {
+    return false;
+  }
+  info.line = entry.line;
+  info.file = base + event_id + sizeof(entry);
+  info.format = info.file + entry.file_size;
+  return info.file[entry.file_size - 1U] == '\0' &&
+         info.format[entry.format_size - 1U] == '\0';
+}
+
+const char* to_string(LogLevel level) {
+  switch (level) {
+    case LogLevel::kLOG_LEVEL_INFO:
+      return "INFO";
+    case LogLevel::kLOG_LEVEL_WARN:
+      return "WARN";
+    case LogLevel::kLOG_LEVEL_DEBUG:
+      return "DEBUG";
+    case LogLevel::kLOG_LEVEL_ERROR:
+      return "ERROR";
+    default:
+      return "?";
+  }
+}
+
+std::size_t format_record(const EventInfo* event, const LogRecord& record,
+                          char* out, std::size_t out_size) {
+  if (out_size == 0U) {
+    return 0U;
+  }
+  std::size_t used = 0U;
+  auto append = [&](int written) {
+    if (written > 0) {
+      used += static_cast<std::size_t>(written);
+      if (used >= out_size) {
+        used = out_size - 1U;
+      }
+    }
+  };
+
+  if (event == nullptr) {
+    append(std::snprintf(out, out_size, "%llu %s t%u <event %u>",
+                         static_cast<unsigned long long>(record.timestamp),
+                         to_string(record.level()), record.thread,
+                         record.event_id));
+    return used;
+  }
+
+  append(std::snprintf(out, out_size, "%llu %s t%u %s:%u ",
+                       static_cast<unsigned long long>(record.timestamp),
+                       to_string(record.level()), record.thread, event->file,
+                       event->line));
+
+  const uint32_t count = record.count();
+  std::size_t arg = 0U;
+  for (const char* p = event->format; *p != '\0' && used + 1U < out_size; ++p) {
+    if (p[0] == '{' && p[1] == '}' && arg < count && arg < MAX_ARGS) {
+      const uint32_t bits = record.data[arg];
+      switch (record.type(arg)) {
+        case ArgType::U32:
+          append(std::snprintf(out + used, out_size - used, "%u", bits));
+          break;
+        case ArgType::I32:
+          append(std::snprintf(out + used, out_size - used, "%d",
+                               static_cast<int32_t>(bits)));
+          break;
+        case ArgType::F32: {
+          float value;
+          std::memcpy(&value, &bits, sizeof(value));
+          append(std::snprintf(out + used, out_size - used, "%g",
+                               static_cast<double>(value)));
+          break;
+        }
+        default:
+          append(std::snprintf(out + used, out_size - used, "0x%08x", bits));
+          break;
+      }
+      ++arg;
+      ++p;
+    } else {
+      out[used++] = *p;
+    }
+  }
+  out[used] = '\0';
+  return used;
+}
+
+}  // namespace aeva::safe::logger
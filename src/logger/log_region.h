@@ -0,0 +1,260 @@
+//
+// Created by coolk on 19-10-2026.
+//
+
+#ifndef LOGGER_LOG_REGION_H
+#define LOGGER_LOG_REGION_H
+
+// Copyright Aeva 2026
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "log_record.h"
+
+namespace aeva::safe::logger {
+
+/// Where the log ring lives. Anything other than kAnonymous outlives the
+/// process, so the records that were still queued when it died can be
+/// recovered with log_extract.
+enum class RegionKind : uint8_t {
+  kAnonymous = 0,     // Private anonymous mapping, found in core files.
+  kSharedMemory = 1,  // Named POSIX shared memory object (/dev/shm/<name>).
+  kFile = 2,          // Regular file mapped MAP_SHARED.
+};
+
+constexpr char kRegionMagic[8] = {'A', 'E', 'V', 'A', 'L', 'O', 'G', '\0'};
+constexpr uint32_t kRegionVersion = 3U;
+constexpr std::size_t kRegionAlignment = 4096U;
+constexpr std::size_t kLoggerNameSize = 32U;
+constexpr uint32_t kUnknownEvent = 0xFFFFFFFFU;
+constexpr int32_t kNoNumaNode = -1;
+
+/// Ring slots are LogRecords. Their `sequence` word follows the bounded MPMC
+/// queue protocol: a slot at ring position `pos` is free when
+/// sequence == pos, published when sequence == pos + 1 and consumed (but
+/// still intact) when sequence == pos + capacity.
+inline std::atomic_ref<uint64_t> sequence_of(LogRecord& slot) {
+  return std::atomic_ref<uint64_t>(slot.sequence);
+}
+
+inline uint64_t load_sequence(const LogRecord& slot) {
+  return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(slot.sequence))
+      .load(std::memory_order_acquire);
+}
+
+/// Control block at the start of each ring. A ring and its slots share one
+/// page-aligned span of the region, so the whole ring can be placed on the
+/// NUMA node of the threads that write into it.
+struct RingHeader {
+  int32_t node;  // NUMA node the span was bound to, or kNoNumaNode.
+  uint32_t slot_count;
+  uint64_t slots_offset;  // From the region base.
+
+  alignas(64) std::atomic<uint64_t> write_index;
+  alignas(64) std::atomic<uint64_t> read_index;
+};
+
+/// Self-describing header at the start of every region. Everything after the
+/// magic is located through offsets, never pointers, so the header is
+/// meaningful in any address space: a live process, a /dev/shm object, a
+/// mapped file or a core dump.
+struct RegionHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t ring_header_size;
+  uint32_t slot_size;
+  uint32_t slot_count;  // Per ring, power of two.
+  uint32_t ring_count;
+  uint32_t max_args;
+  int32_t pid;
+  uint64_t region_size;
+  uint64_t rings_offset;
+  uint64_t ring_stride;  // Distance between consecutive RingHeaders.
+  uint64_t strings_offset;
+  uint64_t strings_capacity;
+  char logger_name[kLoggerNameSize];
+
+  alignas(64) std::atomic<uint64_t> strings_used;
+  std::atomic<uint64_t> dropped;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "Region atomics must be address free to be shared between processes");
+
+inline const RingHeader* ring_header(const RegionHeader* header,
+                                     uint32_t ring) {
+  return reinterpret_cast<const RingHeader*>(
+      reinterpret_cast<const char*>(header) + header->rings_offset +
+      header->ring_stride * ring);
+}
+
+inline const LogRecord* ring_slots(const RegionHeader* header,
+                                   const RingHeader* ring) {
+  return reinterpret_cast<const LogRecord*>(
+      reinterpret_cast<const char*>(header) + ring->slots_offset);
+}
+
+/// Decoded view of an entry in the region's event table.
+struct EventInfo {
+  const char* file;
+  uint32_t line;
+  const char* format;
+};
+
+/// One bounded MPMC ring of LogRecord inside a region. Producers on any
+/// thread push; a single consumer (the backend) takes records off in order.
+class LogRing {
+ public:
+  LogRing(RingHeader* header, LogRecord* slots)
+      : header_(header), slots_(slots), mask_(header->slot_count - 1U) {}
+
+  RingHeader* header() const { return header_; }
+  LogRecord* slots() const { return slots_; }
+  uint32_t mask() const { return mask_; }
+
+  /// Claims a slot and publishes a record into it. Returns false when the
+  /// ring is full; what happens then is up to the caller's OverflowPolicy.
+  bool try_push(const LogRecord& record) {
+    uint64_t pos = header_->write_index.load(std::memory_order_relaxed);
+    for (;;) {
+      LogRecord& slot = slots_[pos & mask_];
+      const auto diff = static_cast<int64_t>(load_sequence(slot) - pos);
+      if (diff == 0) {
+        if (header_->write_index.compare_exchange_weak(
+                pos, pos + 1U, std::memory_order_relaxed)) {
+          std::memcpy(reinterpret_cast<char*>(&slot) + kRecordBodyOffset,
+                      reinterpret_cast<const char*>(&record) + kRecordBodyOffset,
+                      kRecordBodySize);
+          sequence_of(slot).store(pos + 1U, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = header_->write_index.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Single consumer side: returns the next published slot, or nullptr when
+  /// the ring is empty. The slot stays valid until release() is called.
+  const LogRecord* front() const {
+    const uint64_t pos = header_->read_index.load(std::memory_order_relaxed);
+    const LogRecord& slot = slots_[pos & mask_];
+    if (load_sequence(slot) != pos + 1U) {
+      return nullptr;
+    }
+    return &slot;
+  }
+
+  /// Hands the slot returned by front() back to the producers. The record is
+  /// left in place, so the last `slot_count` records remain recoverable.
+  void release() {
+    const uint64_t pos = header_->read_index.load(std::memory_order_relaxed);
+    sequence_of(slots_[pos & mask_])
+        .store(pos + mask_ + 1U, std::memory_order_release);
+    header_->read_index.store(pos + 1U, std::memory_order_release);
+  }
+
+ private:
+  RingHeader* header_;
+  LogRecord* slots_;
+  uint32_t mask_;
+};
+
+/// A mapped log region: header, one ring of LogRecord per NUMA node and the
+/// event string table. Each ring's pages are bound to its node before they
+/// are first touched, so a producer that pushes into the ring of the node it
+/// runs on never writes to remote memory. The producer side only touches
+/// memory that is already mapped, so logging into a shared-memory or
+/// file-backed region costs exactly what logging into the heap costs.
+class LogRegion {
+ public:
+  struct Options {
+    RegionKind kind = RegionKind::kAnonymous;
+    const char* name = nullptr;  // shm object name or file path.
+    uint32_t slot_count = 4096U;  // Per ring.
+    /// Number of rings; 0 gives one per NUMA node. Ring `i` is placed on
+    /// node `i % numa_node_count()`.
+    uint32_t ring_count = 0U;
+    uint32_t strings_capacity = 64U * 1024U;
+    bool unlink_on_close = true;
+  };
+
+  /// Creates and maps a fresh region. Returns nullptr (and prints why) when
+  /// the backing object could not be created, or when it already holds a
+  /// valid region: that is the record of an earlier run, left for
+  /// log_extract, and is never overwritten.
+  static std::unique_ptr<LogRegion> create(const char* logger_name,
+                                           const Options& options);
+
+  ~LogRegion();
+
+  LogRegion(const LogRegion&) = delete;
+  LogRegion& operator=(const LogRegion&) = delete;
+
+  RegionHeader* header() const { return header_; }
+  uint32_t ring_count() const { return ring_count_; }
+  LogRing& ring(uint32_t index) { return rings_[index]; }
+  const LogRing& ring(uint32_t index) const { return rings_[index]; }
+
+  /// The ring producers running on NUMA node `node` push into.
+  LogRing& ring_for_node(uint32_t node) {
+    return rings_[node < ring_count_ ? node : node % ring_count_];
+  }
+
+  /// Records published so far, over all rings.
+  uint64_t written() const;
+
+  /// Appends a `file`/`line`/`format` triple to the event table and returns its
+  /// id, or kUnknownEvent when the table is full.
+  uint32_t add_event(const char* file, uint32_t line, const char* format);
+
+ private:
+  LogRegion() = default;
+
+  RegionHeader* header_ = nullptr;
+  std::vector<LogRing> rings_;
+  uint32_t ring_count_ = 0U;
+  std::size_t size_ = 0U;
+  int fd_ = -1;
+  RegionKind kind_ = RegionKind::kAnonymous;
+  char name_[256] = {};
+  bool unlink_on_close_ = true;
+};
+
+/// Number of NUMA nodes on this machine (1 when it is not NUMA or the
+/// topology is unknown).
+uint32_t numa_node_count();
+
+/// NUMA node of the CPU the calling thread is running on.
+uint32_t current_numa_node();
+
+/// Checks that `base` (with `available` readable bytes) starts with a region
+/// header this build understands.
+bool is_valid_region(const void* base, std::size_t available);
+
+/// Looks up an event in the table of the region whose header is `header`.
+bool lookup_event(const RegionHeader* header, uint32_t event_id,
+                  EventInfo& info);
+
+/// Formats a record as a single line
+/// ("<timestamp> <level> t<thread> file:line message") into `out`,
+/// substituting each "{}" in the event format with the next argument.
+/// `event` may be nullptr for records whose event is unknown. Returns the
+/// number of characters written, excluding the terminating NUL.
+std::size_t format_record(const EventInfo* event, const LogRecord& record,
+                          char* out, std::size_t out_size);
+
+const char* to_string(LogLevel level);
+
+}  // namespace aeva::safe::logger
+
+#endif  // LOGGER_LOG_REGION_H
@@ -0,0 +1,149 @@
+//
+// Created by coolk on 19-10-2026.
+//
+// Copyright Aeva 2026
+
+#include "log_sink.h"
+
+#include <cstring>
+
+namespace aeva::safe::logger {
+
+namespace {
+
+template <typename T>
+void append_bytes(std::vector<char>& out, const T& value) {
+  const auto* p = reinterpret_cast<const char*>(&value);
+  out.insert(out.end(), p, p + sizeof(T));
+}
+
+}  // namespace
+
+ConsoleSink::ConsoleSink(std::FILE* stream, LogLevel level,
+                         std::size_t batch_size)
+    : LogSink(level, batch_size), stream_(stream) {
+  buffer_.reserve(batch_size * 96U);
+}
+
+void ConsoleSink::write(const LogEntry& entry) {
+  buffer_.append(entry.text());
+  buffer_.push_back('\n');
+}
+
+void ConsoleSink::flush() {
+  std::fwrite(buffer_.data(), 1U, buffer_.size(), stream_);
+  std::fflush(stream_);
+  buffer_.clear();
+}
+
+BinaryFileSink::BinaryFileSink(const char* path, LogLevel level,
+                               std::size_t batch_size)
+    : LogSink(level, batch_size), file_(std::fopen(path, "wb")) {
+  buffer_.reserve(batch_size * kCompactMaxSize);
+  if (file_ == nullptr) {
+    std::fprintf(stderr, "logger: cannot open %s\n", path);
+    return;
+  }
+  std::fwrite(kBinaryMagic, 1U, sizeof(kBinaryMagic), file_);
+  std::fwrite(&kBinaryVersion, 1U, sizeof(kBinaryVersion), file_);
+}
+
+BinaryFileSink::~BinaryFileSink() {
+  if (file_ != nullptr) {
+    flush();
+    std::fclose(file_);
+  }
+}
+
+void BinaryFileSink::write(const LogEntry& entry) {
+  const LogRecord& record = entry.record();
+  const EventInfo* event = entry.event();
+  // Event ids are 4-byte aligned offsets into the event table.
+  const std::size_t index = record.event_id / 4U;
+  if (event != nullptr &&
+      (index >= defined_events_.size() || !defined_events_[index])) {
+    if (index >= defined_events_.size()) {
+      defined_events_.resize(index + 1U);
+    }
+    defined_events_[index] = true;
+    const auto file_size = static_cast<uint16_t>(std::strlen(event->file) + 1U);
+    const auto format_size =
+        static_cast<uint16_t>(std::strlen(event->format) + 1U);
+    buffer_.push_back(kBinaryEventTag);
+    append_bytes(buffer_, record.event_id);
+    append_bytes(buffer_, event->line);
+    append_bytes(buffer_, file_size);
+    append_bytes(buffer_, format_size);
+    buffer_.insert(buffer_.end(), event->file, event->file + file_size);
+    buffer_.insert(buffer_.end(), event->format, event->format + format_size);
+  }
+
+  buffer_.push_back(kBinaryRecordTag);
+  const std::size_t offset = buffer_.size();
+  buffer_.resize(offset + compact_size(record));
+  encode_compact(record, buffer_.data() + offset);
+}
+
+void BinaryFileSink::flush() {
+  if (file_ != nullptr && !buffer_.empty()) {
+    std::fwrite(buffer_.data(), 1U, buffer_.size(), file_);
+    std::fflush(file_);
+  }
+  buffer_.clear();
+}
+
+MemoryRingSink::MemoryRingSink(std::size_t capacity, LogLevel level,
+                               std::size_t batch_size)
+    : LogSink(level, batch_size),
+      lines_(capacity == 0U ? 1U : capacity),
+      staged_(batch_size == 0U ? 1U : batch_size) {}
+
+std::vector<std::string> MemoryRingSink::snapshot() const {
+  std::lock_guard<std::mutex> lk(m_);
+  std::vector<std::string> lines;
+  lines.reserve(size_);
+  const std::size_t first = (next_ + lines_.size() - size_) % lines_.size();
+  for (std::size_t i = 0; i < size_; ++i) {
+    lines.push_back(lines_[(first + i) % lines_.size()]);
+  }
+  return lines;
+}
+
+void MemoryRingSink::write(const LogEntry& entry) {
+  staged_[staged_count_++].assign(entry.text());
+}
+
+void MemoryRingSink::flush() {
+  // Readers only contend with the backend once per batch. Swapping keeps
+  // every string's capacity in circulation, so a warm ring never allocates.
+  std::lock_guard<std::mutex> lk(m_);
+  for (std::size_t i = 0; i < staged_count_; ++i) {
+    lines_[next_].swap(staged_[i]);
+    next_ = (next_ + 1U) % lines_.size();
+    if (size_ < lines_.size()) {
+      ++size_;
+    }
+  }
+  staged_count_ = 0U;
+}
+
+std::vector<TestSink::Captured> TestSink::captured() const {
+  std::lock_guard<std::mutex> lk(m_);
+  return captured_;
+}
+
+bool TestSink::wait_for(std::size_t count,
+                        std::chrono::milliseconds timeout) const {
+  std::unique_lock<std::mutex> lk(m_);
+  return cv_.wait_for(lk, timeout, [&] { return captured_.size() >= count; });
+}
+
+void TestSink::write(const LogEntry& entry) {
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    captured_.push_back({entry.record(), std::string(entry.text())});
+  }
+  cv_.notify_all();
+}
+
+}  // namespace aeva::safe::logger
@@ -0,0 +1,228 @@
+//
+// Created by coolk on 19-10-2026.
+//
+
+#ifndef LOGGER_LOG_SINK_H
+#define LOGGER_LOG_SINK_H
+
+// Copyright Aeva 2026
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "log_record.h"
+#include "log_region.h"
+
+namespace aeva::safe::logger {
+
+constexpr std::size_t kMaxLineSize = 512U;
+
+/// A record taken off the ring by the backend, decoded once and shared by
+/// every sink. The event lookup happens when the entry is filled; the text
+/// form is produced on the first text() call and reused by later sinks.
+class LogEntry {
+ public:
+  void reset(const RegionHeader* header, const LogRecord& record) {
+    record_ = record;
+    has_event_ = lookup_event(header, record.event_id, event_);
+    text_size_ = kNotFormatted;
+  }
+
+  const LogRecord& record() const { return record_; }
+  LogLevel level() const { return record_.level(); }
+  const EventInfo* event() const { return has_event_ ? &event_ : nullptr; }
+
+  std::string_view text() const {
+    if (text_size_ == kNotFormatted) {
+      text_size_ = format_record(event(), record_, text_, sizeof(text_));
+    }
+    return {text_, text_size_};
+  }
+
+ private:
+  static constexpr std::size_t kNotFormatted = static_cast<std::size_t>(-1);
+
+  LogRecord record_{};
+  EventInfo event_{};
+  bool has_event_ = false;
+  mutable std::size_t text_size_ = kNotFormatted;
+  mutable char text_[kMaxLineSize];
+};
+
+/// One output of the backend pipeline. Each sink has its own level filter
+/// and batch size: consume() hands it the records it accepts and flush() is
+/// called once `batch_size` records are pending, or whenever the backend
+/// runs out of work. Sinks are only ever called from the backend thread.
+class LogSink {
+ public:
+  explicit LogSink(LogLevel level = LogLevel::kLOG_LEVEL_INFO,
+                   std::size_t batch_size = 64U)
+      : level_(level), batch_size_(batch_size == 0U ? 1U : batch_size) {}
+
+  virtual ~LogSink() = default;
+
+  LogSink(const LogSink&) = delete;
+  LogSink& operator=(const LogSink&) = delete;
+
+  bool accepts(LogLevel level) const {
+    return static_cast<uint8_t>(level) >= static_cast<uint8_t>(level_);
+  }
+
+  void consume(const LogEntry* entries, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      if (accepts(entries[i].level())) {
+        write(entries[i]);
+        if (++pending_ >= batch_size_) {
+          flush_pending();
+        }
+      }
+    }
+  }
+
+  void flush_pending() {
+    if (pending_ != 0U) {
+      flush();
+      pending_ = 0U;
+    }
+  }
+
+ protected:
+  virtual void write(const LogEntry& entry) = 0;
+  virtual void flush() {}
+
+ private:
+  LogLevel level_;
+  std::size_t batch_size_;
+  std::size_t pending_ = 0U;
+};
+
+/// Human-readable lines on a stdio stream.
+class ConsoleSink : public LogSink {
+ public:
+  explicit ConsoleSink(std::FILE* stream = stdout,
+                       LogLevel level = LogLevel::kLOG_LEVEL_INFO,
+                       std::size_t batch_size = 64U);
+
+ protected:
+  void write(const LogEntry& entry) override;
+  void flush() override;
+
+ private:
+  std::FILE* stream_;
+  std::string buffer_;
+};
+
+/// Layout of a BinaryFileSink file, shared with log_extract which reads it
+/// back. The header is the magic and a 4-byte version. An entry is a tag
+/// byte, then for kBinaryEventTag: id(4), line(4), file size(2), format
+/// size(2) and both NUL-terminated strings; for kBinaryRecordTag: one record
+/// in compact form.
+constexpr char kBinaryMagic[8] = {'A', 'E', 'V', 'A', 'L', 'O', 'G', 'B'};
+constexpr uint32_t kBinaryVersion = 1U;
+constexpr std::size_t kBinaryHeaderSize =
+    sizeof(kBinaryMagic) + sizeof(kBinaryVersion);
+constexpr char kBinaryEventTag = 'E';
+constexpr char kBinaryRecordTag = 'R';
+constexpr std::size_t kBinaryEventHeaderSize = 12U;
+
+/// Binary log file: a "AEVALOGB" header, then a stream of tagged entries. An
+/// 'E' entry defines an event the first time a record refers to it, an 'R'
+/// entry holds one record in compact (variable-length) form. log_extract
+/// reads these files back.
+class BinaryFileSink : public LogSink {
+ public:
+  explicit BinaryFileSink(const char* path,
+                          LogLevel level = LogLevel::kLOG_LEVEL_INFO,
+                          std::size_t batch_size = 256U);
+  ~BinaryFileSink() override;
+
+  bool is_open() const { return file_ != nullptr; }
+
+ protected:
+  void write(const LogEntry& entry) override;
+  void flush() override;
+
+ private:
+  std::FILE* file_;
+  std::vector<char> buffer_;
+  std::vector<bool> defined_events_;
+};
+
+/// Keeps the last `capacity` formatted lines in memory so a debug endpoint
+/// can serve them. snapshot() may be called from any thread.
+class MemoryRingSink : public LogSink {
+ public:
+  explicit MemoryRingSink(std::size_t capacity,
+                          LogLevel level = LogLevel::kLOG_LEVEL_INFO,
+                          std::size_t batch_size = 64U);
+
+  /// Returns the retained lines, oldest first.
+  std::vector<std::string> snapshot() const;
+
+ protected:
+  void write(const LogEntry& entry) override;
+  void flush() override;
+
+ private:
+  mutable std::mutex m_;
+  std::vector<std::string> lines_;
+  std::vector<std::string> staged_;
+  std::size_t staged_count_ = 0U;
+  std::size_t next_ = 0U;
+  std::size_t size_ = 0U;
+};
+
+/// Discards everything; counts what it was given. Used to measure the
+/// pipeline itself.
+class NullSink : public LogSink {
+ public:
+  explicit NullSink(LogLevel level = LogLevel::kLOG_LEVEL_INFO,
+                    std::size_t batch_size = 256U)
+      : LogSink(level, batch_size) {}
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+ protected:
+  void write(const LogEntry&) override {
+    count_.store(count_.load(std::memory_order_relaxed) + 1U,
+                 std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> count_{0U};
+};
+
+/// Collects records and their text for tests.
+class TestSink : public LogSink {
+ public:
+  explicit TestSink(LogLevel level = LogLevel::kLOG_LEVEL_INFO)
+      : LogSink(level, 1U) {}
+
+  struct Captured {
+    LogRecord record;
+    std::string text;
+  };
+
+  std::vector<Captured> captured() const;
+
+  /// Waits until at least `count` records have been captured.
+  bool wait_for(std::size_t count, std::chrono::milliseconds timeout) const;
+
+ protected:
+  void write(const LogEntry& entry) override;
+
+ private:
+  mutable std::mutex m_;
+  mutable std::condition_variable cv_;
+  std::vector<Captured> captured_;
+};
+
+}  // namespace aeva::safe::logger
+
+#endif  // LOGGER_LOG_SINK_H
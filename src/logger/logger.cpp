@@ -5,23 +5,229 @@
 
 #include "logger.h"
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 namespace aeva::safe::logger {
 
-class LogQueue {};
+namespace {
+
+// Registration is rare (once per call site), so a single lock is enough.
+std::mutex& registry_mutex() {
+  static std::mutex m;
+  return m;
+}
+
+// Every event registered since the process started, in registration order.
+// Call sites cache their event id, which is the event's offset in the region's
+// table, for the life of the process. A region created by a later init() gets
+// the whole list replayed into it in the same order, so every event lands at
+// the offset its call sites cached.
+struct RegisteredEvent {
+  std::string file;
+  uint32_t line;
+  std::string format;
+};
+
+std::vector<RegisteredEvent>& registered_events() {
+  static std::vector<RegisteredEvent> events;
+  return events;
+}
+
+struct TextHash {
+  using is_transparent = void;
+  std::size_t operator()(std::string_view text) const {
+    return std::hash<std::string_view>{}(text);
+  }
+};
+
+using TextIds =
+    std::unordered_map<std::string, uint32_t, TextHash, std::equal_to<>>;
+
+// Events interned by the const char* convenience functions, keyed by their
+// text. Their ids survive re-init like every other event's.
+TextIds& interned_messages() {
+  static TextIds messages;
+  return messages;
+}
+
+constexpr auto kBackendIdleSleep = std::chrono::milliseconds(1);
+
+// Records taken off a ring per pass; every sink sees the whole batch.
+constexpr std::size_t kBackendBatch = 256U;
+
+// Applies BackendOptions to the calling thread.
+void configure_backend_thread(const BackendOptions& options) {
+#if defined(__linux__)
+  if (!options.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : options.cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    const int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+      std::fprintf(stderr, "logger: cannot pin backend thread: %s\n",
+                   std::strerror(err));
+    }
+  }
+  if (options.nice) {
+    const auto tid = static_cast<id_t>(::syscall(SYS_gettid));
+    if (::setpriority(PRIO_PROCESS, tid, *options.nice) != 0) {
+      std::fprintf(stderr, "logger: cannot set backend nice %d: %s\n",
+                   *options.nice, std::strerror(errno));
+    }
+  }
+  if (options.realtime_priority != 0) {
+    sched_param param{};
+    param.sched_priority = options.realtime_priority;
+    const int err = ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+      std::fprintf(stderr, "logger: cannot set backend SCHED_FIFO %d: %s\n",
+                   options.realtime_priority, std::strerror(err));
+    }
+  }
+#else
+  if (!options.cpus.empty() || options.nice || options.realtime_priority != 0) {
+    std::fprintf(stderr, "logger: backend scheduling options are ignored on "
+                         "this platform\n");
+  }
+#endif
+}
+
+}  // namespace
+
+std::unique_ptr<Logger> Logger::instance_;
 
 void Logger::init(const char *logger_name) noexcept {
-  instance_ = std::unique_ptr<Logger>(new Logger());
-  instance_->logger_name = logger_name;
+  init(logger_name, LoggerOptions{});
+}
+
+void Logger::init(const char *logger_name,
+                  const LoggerOptions &options) noexcept {
+  shutdown();
+
+  auto logger = std::unique_ptr<Logger>(new Logger());
+  logger->logger_name = logger_name;
+  logger->region_ = LogRegion::create(logger_name, options.region);
+  if (!logger->region_) {
+    // Keep logging even when the requested placement failed; the records are
+    // just not recoverable after a crash.
+    LogRegion::Options fallback = options.region;
+    fallback.kind = RegionKind::kAnonymous;
+    logger->region_ = LogRegion::create(logger_name, fallback);
+  }
+  if (!logger->region_) {
+    // The options themselves are unusable (say, a slot_count that is not a
+    // power of two); the defaults are not.
+    logger->region_ = LogRegion::create(logger_name, LogRegion::Options{});
+  }
+  if (!logger->region_) {
+    std::fprintf(stderr, "logger: no log region for %s; logging is "
+                         "disabled\n", logger_name);
+    logger->level_.store(kDisabled, std::memory_order_relaxed);
+    instance_ = std::move(logger);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lk(registry_mutex());
+    for (const RegisteredEvent& event : registered_events()) {
+      if (logger->region_->add_event(event.file.c_str(), event.line,
+                                     event.format.c_str()) == kUnknownEvent) {
+        // Later events would land at ids cached for others; register none.
+        std::fprintf(stderr, "logger: the event table of %s is too small for "
+                             "the events already registered\n", logger_name);
+        logger->events_full_ = true;
+        break;
+      }
+    }
+  }
+  logger->level_.store(options.level, std::memory_order_relaxed);
+  logger->overflow_ = options.overflow;
+  logger->sinks_ = options.sinks;
+  if (logger->sinks_.empty()) {
+    logger->sinks_.push_back(std::make_shared<ConsoleSink>());
+  }
+  logger->entries_.resize(kBackendBatch);
+  logger->running_.store(true, std::memory_order_release);
+  logger->backend_ =
+      std::thread(&Logger::run_backend, logger.get(), options.backend);
+  instance_ = std::move(logger);
 }
 
 Logger::Logger() = default;
 
-Logger::~Logger() {}
+Logger::~Logger() {
+  running_.store(false, std::memory_order_release);
+  if (backend_.joinable()) {
+    backend_.join();
+  }
+}
 
 Logger &Logger::instance() { return *instance_; }
 
+uint32_t Logger::register_event(const char *file, uint32_t line,
+                                const char *format) {
+  std::lock_guard<std::mutex> lk(registry_mutex());
+  return add_event_locked(file, line, format);
+}
+
+uint32_t Logger::add_event_locked(const char *file, uint32_t line,
+                                  const char *format) {
+  if (events_full_ || !region_) {
+    return kUnknownEvent;
+  }
+  const uint32_t id = region_->add_event(file, line, format);
+  if (id != kUnknownEvent) {
+    registered_events().push_back({file, line, format});
+  }
+  return id;
+}
+
 void Logger::log(LogLevel level, const char *message) {
-  // TODO: Implement the log function which pushes the message to queue.
+  if (!enabled(level)) {
+    return;
+  }
+  // This thread's copy of the interned ids, so a repeated text takes no lock.
+  thread_local TextIds seen;
+  const std::string_view text(message);
+  if (const auto it = seen.find(text); it != seen.end()) {
+    log(level, it->second);
+    return;
+  }
+  uint32_t event_id;
+  {
+    std::lock_guard<std::mutex> lk(registry_mutex());
+    auto it = interned_messages().find(text);
+    if (it == interned_messages().end()) {
+      event_id = add_event_locked("", 0U, message);
+      if (event_id == kUnknownEvent) {
+        log(level, event_id);  // The table is full; a later region may fit it.
+        return;
+      }
+      it = interned_messages().emplace(std::string(text), event_id).first;
+    }
+    event_id = it->second;
+  }
+  seen.emplace(std::string(text), event_id);
+  log(level, event_id);
 }
 
 void Logger::info(const char *message) {
@@ -40,9 +246,61 @@ void Logger::error(const char *message) {
   log(LogLevel::kLOG_LEVEL_ERROR, message);
 }
 
+// Moves up to one batch off `ring`, decoding each record exactly once, and
+// fans the batch out to every sink.
+std::size_t Logger::drain(LogRing &ring) {
+  std::size_t count = 0U;
+  while (count < entries_.size()) {
+    const LogRecord *record = ring.front();
+    if (record == nullptr) {
+      break;
+    }
+    entries_[count++].reset(region_->header(), *record);
+    ring.release();
+  }
+  if (count != 0U) {
+    for (auto &sink : sinks_) {
+      sink->consume(entries_.data(), count);
+    }
+  }
+  return count;
+}
+
+// One pass over the rings, node by node: each batch reads from a single
+// node's memory. Records of different nodes are therefore interleaved batch
+// by batch rather than in timestamp order.
+std::size_t Logger::drain_all() {
+  std::size_t count = 0U;
+  for (uint32_t r = 0; r < region_->ring_count(); ++r) {
+    count += drain(region_->ring(r));
+  }
+  return count;
+}
+
+void Logger::run_backend(BackendOptions options) {
+  configure_backend_thread(options);
+  while (running_.load(std::memory_order_acquire)) {
+    if (drain_all() == 0U) {
+      for (auto &sink : sinks_) {
+        sink->flush_pending();
+      }
+      std::this_thread::sleep_for(kBackendIdleSleep);
+    }
+  }
+  while (drain_all() != 0U) {
+  }
+  for (auto &sink : sinks_) {
+    sink->flush_pending();
+  }
+}
+
 void Logger::shutdown() {
-  // TODO: Cleanup, by flushing existing log messages,
-  // and then return.
+  if (!instance_) {
+    return;
+  }
+  // Stopping the backend flushes whatever is still queued. Registered events
+  // are kept for the next init().
+  instance_.reset();
 }
 
 } // namespace aeva::safe::logger
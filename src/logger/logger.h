@@ -6,114 +6,104 @@
 #define LOGGER_LOGGER_H
 
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <cstring>
+#include <optional>
+#include <thread>
+#include <vector>
 
+#include "log_record.h"
+#include "log_region.h"
+#include "log_sink.h"
 
 namespace aeva::safe::logger {
 
-enum class LogLevel : uint8_t {
-  kLOG_LEVEL_INFO = 0,
-  kLOG_LEVEL_WARN = 1,
-  kLOG_LEVEL_DEBUG = 2,
-  kLOG_LEVEL_ERROR = 3
+/// What a producer does when the ring is full.
+enum class OverflowPolicy : uint8_t {
+  kDropNewest = 0,  // Count the record as dropped and return immediately.
+  kBlock = 1,       // Spin (yielding) until the backend frees a slot.
 };
 
-class LogQueue;
-
-enum class ArgType : uint8_t {
-  U32,
-  I32,
-  F32,
+/// Scheduling of the backend thread, so that draining and formatting do not
+/// compete with latency-critical threads. Applied by the thread itself when
+/// it starts; a setting the process is not allowed to make is reported on
+/// stderr and skipped.
+struct BackendOptions {
+  /// CPUs the backend may run on. Empty leaves the inherited affinity.
+  std::vector<int> cpus;
+  /// Nice value of the backend thread alone (Linux threads have their own).
+  std::optional<int> nice;
+  /// When non-zero, run the backend under SCHED_FIFO at this priority.
+  int realtime_priority = 0;
 };
 
-union ArgValue {
-  uint32_t u32;
-  int32_t i32;
-  float f32;
-};
-struct LogArg {
-  ArgType type;
-  ArgValue value;
+struct LoggerOptions {
+  /// Ring placement. Use kSharedMemory or kFile to keep the records of a
+  /// crashed process around for log_extract.
+  LogRegion::Options region{};
+  OverflowPolicy overflow = OverflowPolicy::kDropNewest;
+  /// Records below this level are discarded at runtime.
+  LogLevel level = LogLevel::kLOG_LEVEL_INFO;
+  /// Outputs fed by the backend thread, in order. A ConsoleSink on stdout is
+  /// used when none is given.
+  std::vector<std::shared_ptr<LogSink>> sinks;
+  BackendOptions backend{};
 };
-template <std::size_t N>
-struct LogPayload {
-  LogArg args[N];
-  uint8_t count;
-};
-
-template <typename T>
-constexpr LogArg encode_one(T value) {
-  if constexpr (std::is_same_v<T, uint32_t>) {
-    return {ArgType::U32, {.u32 = value}};
-  } else if constexpr (std::is_same_v<T, int32_t>) {
-    return {ArgType::I32, {.i32 = value}};
-  } else if constexpr (std::is_same_v<T, float>) {
-    return {ArgType::F32, {.f32 = value}};
-  } else {
-    static_assert(sizeof(T) == 0, "Unsupported type");
-    return {ArgType::F32, {.f32 = value}};
-  }
-}
 
-template <typename... Args>
-constexpr auto make_payload(Args&&... args) {
-  constexpr std::size_t N = sizeof...(args);
+class Logger {
+ public:
+  static void init(const char* logger_name) noexcept;
+  static void init(const char* logger_name,
+                   const LoggerOptions& options) noexcept;
 
-  LogPayload<N> payload{};
-  payload.count = static_cast<uint8_t>(N);
+  static Logger& instance();
 
-  LogArg tmp[] = {encode_one(std::forward<Args>(args))...};
+  /// Registers a log statement once and returns the id its records carry.
+  /// The SAFE_LOG_* macros call this from a function-local static, so the
+  /// cost is paid once per call site. Ids stay valid across shutdown() and
+  /// init(): every new region is given the events registered so far, in the
+  /// order they were registered.
+  uint32_t register_event(const char* file, uint32_t line, const char* format);
 
-  for (std::size_t i = 0; i < N; ++i) {
-    payload.args[i] = tmp[i];
+  bool enabled(LogLevel level) const {
+    return static_cast<uint8_t>(level) >=
+           static_cast<uint8_t>(level_.load(std::memory_order_relaxed));
   }
 
-  return payload;
-}
-
-constexpr std::size_t MAX_ARGS = 8;
-
-struct LogRecord {
-  ArgType types[MAX_ARGS];
-  uint32_t data[MAX_ARGS];  // raw bits (floats included)
-  uint8_t count;
-};
+  /// Ignored by a disabled logger, which has no region to log into.
+  void set_level(LogLevel level) {
+    if (region_) {
+      level_.store(level, std::memory_order_relaxed);
+    }
+  }
 
-template <std::size_t N>
-LogRecord to_record(uint32_t event_id, const LogPayload<N>& p) {
-  static_assert(N <= MAX_ARGS, "A maximum of 8 arguments are supported");
-  LogRecord r{};
-  r.count = p.count;
-
-  for (std::size_t i = 0; i < p.count; ++i) {
-    r.types[i] = p.args[i].type;
-    switch (p.args[i].type) {
-      case ArgType::U32:
-        r.data[i] = p.args[i].value.u32;
-        break;
-      case ArgType::I32:
-        r.data[i] = p.args[i].value.i32;
-        break;
-      case ArgType::F32: {
-        uint32_t bits;
-        std::memcpy(&bits, &p.args[i].value.f32, sizeof(float));
-        r.data[i] = bits;
-        break;
+  /// Hot path: encodes the arguments and publishes the record into the ring
+  /// of the calling thread's NUMA node. No locks, no allocation and no
+  /// system calls, whatever the region kind.
+  template <typename... Args>
+  void log(LogLevel level, uint32_t event_id, Args... args) {
+    if (!enabled(level)) {
+      return;
+    }
+    LogRecord record = to_record(level, event_id, make_payload(args...));
+    record.timestamp = read_timestamp();
+    record.thread = thread_index();
+    LogRing& ring = region_->ring_for_node(thread_node());
+    while (!ring.try_push(record)) {
+      if (overflow_ == OverflowPolicy::kDropNewest) {
+        region_->header()->dropped.fetch_add(1U, std::memory_order_relaxed);
+        return;
       }
-      default: ;
+      std::this_thread::yield();
     }
   }
 
-  return r;
-}
-
-class Logger {
- public:
-  static void init(const char* logger_name) noexcept;
-
-  static Logger& instance();
-
+  /// Logs fixed text. Each distinct text becomes an event the first time it
+  /// is seen, so a reused buffer is logged with what it holds now; a thread
+  /// that logs a text again finds its id without taking a lock. Every distinct
+  /// text keeps a slot of the event table for good: put varying values in the
+  /// arguments of a SAFE_LOG_* statement rather than in the text.
   void log(LogLevel level, const char* message);
 
   void info(const char* message);
@@ -121,12 +111,47 @@ class Logger {
   void warn(const char* message);
   void error(const char* message);
 
-  static inline uint32_t read_timestamp() {
-    static std::atomic<uint32_t> counter{0};
+  /// Nanoseconds of the monotonic clock: what orders records across rings
+  /// (log_extract lists the rings one after the other). Stamps never go
+  /// backwards, but records close together may share one. Read through the
+  /// vDSO, so producers on different nodes share no cache line and make no
+  /// system call.
+  static inline uint64_t read_timestamp() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  /// Small dense index of the calling thread, assigned on its first record.
+  static uint32_t thread_index() {
+    static std::atomic<uint32_t> next{0};
+    static thread_local const uint32_t index =
+        next.fetch_add(1U, std::memory_order_relaxed);
+    return index;
+  }
 
-    return counter.fetch_add(1U);
+  /// NUMA node the calling thread was running on when it first logged. A
+  /// thread that migrates later keeps its ring; that costs remote writes,
+  /// never correctness.
+  static uint32_t thread_node() {
+    static thread_local const uint32_t node = current_numa_node();
+    return node;
   }
 
+  /// Number of records discarded because the ring was full.
+  uint64_t dropped() const {
+    return region_ ? region_->header()->dropped.load(std::memory_order_relaxed)
+                   : 0U;
+  }
+
+  /// False when init() could not create any region: nothing is enabled then,
+  /// and region() must not be called.
+  bool has_region() const { return region_ != nullptr; }
+
+  LogRegion& region() { return *region_; }
+  const LogRegion& region() const { return *region_; }
+
   static void shutdown();
 
   ~Logger();
@@ -134,7 +159,23 @@ class Logger {
  private:
   Logger();
 
-  std::unique_ptr<LogQueue> queue;
+  void run_backend(BackendOptions options);
+  std::size_t drain(LogRing& ring);
+  std::size_t drain_all();
+  uint32_t add_event_locked(const char* file, uint32_t line,
+                            const char* format);
+
+  // Above every level, so enabled() is false for all of them.
+  static constexpr LogLevel kDisabled = static_cast<LogLevel>(0xFFU);
+
+  std::unique_ptr<LogRegion> region_;
+  std::vector<std::shared_ptr<LogSink>> sinks_;
+  std::vector<LogEntry> entries_;
+  std::atomic<LogLevel> level_{LogLevel::kLOG_LEVEL_INFO};
+  OverflowPolicy overflow_ = OverflowPolicy::kDropNewest;
+  bool events_full_ = false;  // The replayed events did not all fit.
+  std::atomic<bool> running_{false};
+  std::thread backend_;
   static std::unique_ptr<Logger> instance_;
   const char* logger_name;
 };
@@ -143,4 +184,4 @@ class Logger {
 
 
 
-#endif //LOGGER_LOGGER_H
\ No newline at end of file
+#endif //LOGGER_LOGGER_H
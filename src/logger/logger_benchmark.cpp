@@ -0,0 +1,295 @@
+//
+// Created by coolk on 19-10-2026.
+//
+// Copyright Aeva 2026
+//
+// Logger benchmark harness. Build it optimised:
+//
+//   bazel run -c opt //:logger_benchmark -- [iterations per thread]
+//
+// Reports
+//   * the cost of a compiled-out statement and of a runtime-disabled one,
+//   * producer-side latency of Logger::log as a cycle-counter histogram, for
+//     1..64 producer threads and 0..8 arguments, under every OverflowPolicy,
+//   * end-to-end throughput into a NullSink and into a BinaryFileSink.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "log.h"
+#include "logger.h"
+
+using aeva::safe::logger::BinaryFileSink;
+using aeva::safe::logger::LogLevel;
+using aeva::safe::logger::Logger;
+using aeva::safe::logger::LoggerOptions;
+using aeva::safe::logger::NullSink;
+using aeva::safe::logger::OverflowPolicy;
+
+namespace {
+
+inline uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(
+      std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Cycles per nanosecond, measured against steady_clock.
+double calibrate_cycles_per_ns() {
+  const auto t0 = std::chrono::steady_clock::now();
+  const uint64_t c0 = read_cycles();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  const uint64_t c1 = read_cycles();
+  const auto t1 = std::chrono::steady_clock::now();
+  const auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+  return static_cast<double>(c1 - c0) / static_cast<double>(ns);
+}
+
+/// Log-linear histogram: 16 linear sub-buckets per power of two, so every
+/// bucket is within 1/16 of its value.
+class CycleHistogram {
+ public:
+  void record(uint64_t cycles) {
+    ++counts_[index_of(cycles)];
+    ++total_;
+    max_ = std::max(max_, cycles);
+  }
+
+  void merge(const CycleHistogram& other) {
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t percentile(double p) const {
+    const auto target = static_cast<uint64_t>(p * static_cast<double>(total_));
+    uint64_t seen = 0U;
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+      seen += counts_[i];
+      if (seen > target) {
+        return value_of(i);
+      }
+    }
+    return max_;
+  }
+
+  uint64_t max() const { return max_; }
+
+ private:
+  static constexpr unsigned kSubBits = 4U;
+  static constexpr uint64_t kSub = 1U << kSubBits;
+
+  static std::size_t index_of(uint64_t v) {
+    if (v < kSub) {
+      return static_cast<std::size_t>(v);
+    }
+    const unsigned exp = 63U - static_cast<unsigned>(std::countl_zero(v));
+    const uint64_t sub = (v >> (exp - kSubBits)) & (kSub - 1U);
+    return static_cast<std::size_t>((exp - kSubBits + 1U) * kSub + sub);
+  }
+
+  static uint64_t value_of(std::size_t index) {
+    if (index < kSub) {
+      return index;
+    }
+    const uint64_t exp = index / kSub + kSubBits - 1U;
+    const uint64_t sub = index % kSub;
+    return (uint64_t{1} << exp) | (sub << (exp - kSubBits));
+  }
+
+  std::array<uint64_t, 64U * kSub> counts_{};
+  uint64_t total_ = 0U;
+  uint64_t max_ = 0U;
+};
+
+template <std::size_t... I>
+inline void log_args(Logger& logger, uint32_t event,
+                     std::index_sequence<I...>) {
+  logger.log(LogLevel::kLOG_LEVEL_ERROR, event, static_cast<uint32_t>(I)...);
+}
+
+void start_logger(OverflowPolicy policy,
+                  std::vector<std::shared_ptr<aeva::safe::logger::LogSink>>
+                      sinks) {
+  LoggerOptions options;
+  options.overflow = policy;
+  options.sinks = std::move(sinks);
+  Logger::init("benchmark", options);
+}
+
+const char* to_string(OverflowPolicy policy) {
+  return policy == OverflowPolicy::kBlock ? "block" : "drop-newest";
+}
+
+// Runs `threads` producers, each timing `iterations` calls with `Args`
+// arguments, and prints one histogram row.
+template <std::size_t Args>
+void producer_latency(OverflowPolicy policy, unsigned threads,
+                      uint64_t iterations, double cycles_per_ns) {
+  start_logger(policy, {std::make_shared<NullSink>()});
+  Logger& logger = Logger::instance();
+  const uint32_t event =
+      logger.register_event(__FILE__, __LINE__, "benchmark record");
+
+  std::vector<CycleHistogram> histograms(threads);
+  std::atomic<unsigned> ready{0U};
+  std::vector<std::thread> producers;
+  for (unsigned t = 0; t < threads; ++t) {
+    producers.emplace_back([&, t] {
+      ready.fetch_add(1U);
+      while (ready.load() != threads) {
+      }
+      CycleHistogram& h = histograms[t];
+      for (uint64_t i = 0; i < iterations; ++i) {
+        const uint64_t start = read_cycles();
+        log_args(logger, event, std::make_index_sequence<Args>{});
+        h.record(read_cycles() - start);
+      }
+    });
+  }
+  for (auto& p : producers) {
+    p.join();
+  }
+  const uint64_t dropped = logger.dropped();
+  Logger::shutdown();
+
+  CycleHistogram all;
+  for (const auto& h : histograms) {
+    all.merge(h);
+  }
+  auto ns = [&](uint64_t cycles) {
+    return static_cast<double>(cycles) / cycles_per_ns;
+  };
+  std::printf("%-12s %7u %5zu %9.1f %9.1f %9.1f %9.1f %11.1f %10llu\n",
+              to_string(policy), threads, Args, ns(all.percentile(0.50)),
+              ns(all.percentile(0.90)), ns(all.percentile(0.99)),
+              ns(all.percentile(0.999)), ns(all.max()),
+              static_cast<unsigned long long>(dropped));
+}
+
+template <std::size_t... Args>
+void sweep_arguments(OverflowPolicy policy, uint64_t iterations,
+                     double cycles_per_ns, std::index_sequence<Args...>) {
+  (producer_latency<Args>(policy, 1U, iterations, cycles_per_ns), ...);
+}
+
+// Cost per statement of a loop of `iterations` calls of `body`.
+template <typename Body>
+double per_call_ns(uint64_t iterations, Body body) {
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    body(static_cast<uint32_t>(i));
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return static_cast<double>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                 .count()) /
+         static_cast<double>(iterations);
+}
+
+void disabled_calls(uint64_t iterations) {
+  start_logger(OverflowPolicy::kDropNewest, {std::make_shared<NullSink>()});
+  Logger::instance().set_level(LogLevel::kLOG_LEVEL_ERROR);
+
+  // kLOG_LEVEL_INFO is below the default build level, so this statement is
+  // removed by `if constexpr`.
+  const double compiled_out = per_call_ns(iterations, [](uint32_t i) {
+    SAFE_LOG_INFO("compiled out {}", i);
+    asm volatile("" ::: "memory");
+  });
+  // The expansion of a compiled-in statement, rejected by the runtime level.
+  const double runtime_disabled = per_call_ns(iterations, [](uint32_t i) {
+    SAFE_LOG_EMIT(aeva::safe::logger::LogLevel::kLOG_LEVEL_INFO,
+                  "runtime disabled {}", i)
+    asm volatile("" ::: "memory");
+  });
+  Logger::shutdown();
+
+  std::printf("compiled-out statement:     %6.2f ns\n", compiled_out);
+  std::printf("runtime-disabled statement: %6.2f ns\n\n", runtime_disabled);
+}
+
+void throughput(const char* name,
+                std::shared_ptr<aeva::safe::logger::LogSink> sink,
+                unsigned threads, uint64_t iterations) {
+  const auto start = std::chrono::steady_clock::now();
+  start_logger(OverflowPolicy::kBlock, {std::move(sink)});
+  Logger& logger = Logger::instance();
+  const uint32_t event =
+      logger.register_event(__FILE__, __LINE__, "record {} {} {}");
+
+  std::vector<std::thread> producers;
+  for (unsigned t = 0; t < threads; ++t) {
+    producers.emplace_back([&] {
+      for (uint64_t i = 0; i < iterations; ++i) {
+        logger.log(LogLevel::kLOG_LEVEL_ERROR, event,
+                   static_cast<uint32_t>(i), 1.5f, int32_t{-1});
+      }
+    });
+  }
+  for (auto& p : producers) {
+    p.join();
+  }
+  // Shutdown returns once the backend has drained and flushed everything.
+  Logger::shutdown();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  const double records = static_cast<double>(threads) *
+                         static_cast<double>(iterations);
+  std::printf("%-12s %7u %14.0f records/s\n", name, threads,
+              records / elapsed.count());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const uint64_t iterations =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000U;
+  const double cycles_per_ns = calibrate_cycles_per_ns();
+  std::printf("cycle counter: %.3f cycles/ns, %llu iterations per thread\n\n",
+              cycles_per_ns, static_cast<unsigned long long>(iterations));
+
+  disabled_calls(iterations * 10U);
+
+  std::printf("%-12s %7s %5s %9s %9s %9s %9s %11s %10s\n", "policy",
+              "threads", "args", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns",
+              "max ns", "dropped");
+  for (const auto policy : {OverflowPolicy::kDropNewest, OverflowPolicy::kBlock}) {
+    sweep_arguments(policy, iterations, cycles_per_ns,
+                    std::make_index_sequence<aeva::safe::logger::MAX_ARGS + 1U>{});
+    for (const unsigned threads : {2U, 4U, 8U, 16U, 32U, 64U}) {
+      producer_latency<3>(policy, threads, iterations, cycles_per_ns);
+    }
+  }
+
+  std::printf("\n%-12s %7s %14s\n", "sink", "threads", "throughput");
+  for (const unsigned threads : {1U, 4U}) {
+    throughput("null", std::make_shared<NullSink>(), threads, iterations);
+    throughput("binary-file",
+               std::make_shared<BinaryFileSink>("logger_benchmark.bin"),
+               threads, iterations);
+  }
+  std::remove("logger_benchmark.bin");
+  return 0;
+}
@@ -0,0 +1,533 @@
+//
+// Created by coolk on 19-10-2026.
+//
+// Copyright Aeva 2026
+//
+// Messaging benchmark harness. Build it optimised:
+//
+//   bazel run -c opt //:message_queue_benchmark -- [messages]
+//
+// Reports
+//   * the cost of receiving one message through receiver::wait() with a
+//     handler chain of 2, 8 and 32 message types, messages cycling over every
+//     type so that each position in the chain is hit equally often. The
+//     "with stats" column receives the same traffic with the mailbox's
+//     statistics enabled (receiver::enable_stats()). The "rtti chain" column pops the same traffic off a queue and matches it
+//     with the dynamic_cast walk the dispatcher used before type ids, and
+//     the "inline" column receives it through an inline_receiver, whose
+//     messages sit in variant slots of its ring instead of pooled nodes;
+//   * messages/s from one producer thread to one receiver thread, sending one
+//     message at a time and in batches of 64 with send_batch;
+//   * ns per round trip of a ping-pong between two receiver threads, with
+//     both receivers parking as soon as they are empty and with their
+//     adaptive spin-then-park wait;
+//   * ns per message delivered to 8 receiver threads, 16 and 4096 byte
+//     messages, published once on a bus or sent as a copy to each receiver;
+//   * messages/s of the ATM example's withdrawal session (PIN check, balance
+//     query, withdrawal) between an ATM, a bank and an interface thread, the
+//     ATM asking the bank with sender::ask;
+//   * messages/s of 100k ATM-like actors, each verifying a PIN with one of a
+//     few bank actors over and over, all on one scheduler's worker pool; once
+//     with a handler chain per message and once as coroutine machines.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "include/message_queue/actor.h"
+#include "include/message_queue/bus.h"
+#include "include/message_queue/coroutine.h"
+#include "include/message_queue/inline_receiver.h"
+#include "include/message_queue/receiver.h"
+#include "src/atm_example/messages.h"
+
+namespace {
+
+std::atomic<uint64_t> heap_allocations{0};
+
+}  // namespace
+
+// Counts every heap allocation in the process, so the benchmark can report
+// allocations per message. The aligned forms are replaced too: message pool
+// chunks come from them, and every delete must match the new it pairs with.
+void* operator new(std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    const auto align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants a size that is a multiple of the alignment.
+    const std::size_t rounded = (std::max<std::size_t>(size, 1) + align - 1) & ~(align - 1);
+    if (void* p = std::aligned_alloc(align, rounded)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace {
+
+template <int I>
+struct msg {
+    uint32_t value;
+};
+
+struct sink {
+    uint64_t sum = 0;
+};
+
+// Chains one handler per type in `I...` onto `d`; the last temporary runs
+// the wait when the innermost call returns.
+template <typename Dispatcher>
+void chain(Dispatcher&&, sink&) {}
+
+template <int First, int... Rest, typename Dispatcher>
+void chain(Dispatcher&& d, sink& s) {
+    chain<Rest...>(d.template handle<msg<First>>([&s](msg<First> const& m) { s.sum += m.value + First; }), s);
+}
+
+template <int... I>
+void receive_one(messaging::receiver& r, sink& s, std::integer_sequence<int, I...>) {
+    chain<I...>(r.wait(), s);
+}
+
+// The pre-type-id dispatch: the outermost handler is tried first, one
+// dynamic_cast per handler, then one more for close_queue.
+template <int... I>
+bool rtti_dispatch(messaging::message_base* m, sink& s, std::integer_sequence<int, I...>) {
+    constexpr int count = sizeof...(I);
+    auto try_one = [&](auto index) {
+        constexpr int J = count - 1 - decltype(index)::value;
+        if (auto* w = dynamic_cast<messaging::wrapped_message<msg<J>>*>(m)) {
+            s.sum += w->contents.value + J;
+            return true;
+        }
+        return false;
+    };
+    if ((try_one(std::integral_constant<int, I>{}) || ...)) {
+        return true;
+    }
+    if (dynamic_cast<messaging::wrapped_message<messaging::close_queue>*>(m)) {
+        std::abort();
+    }
+    return false;
+}
+
+template <int... I>
+void fill(messaging::sender out, uint64_t messages, std::integer_sequence<int, I...>) {
+    constexpr int count = sizeof...(I);
+    for (uint64_t n = 0; n < messages; ++n) {
+        const int type = static_cast<int>(n % count);
+        ((type == I ? out.send(msg<I>{static_cast<uint32_t>(n)}) : void()), ...);
+    }
+}
+
+double ns_per(std::chrono::steady_clock::duration elapsed, uint64_t count) {
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+           static_cast<double>(count);
+}
+
+// The same traffic through an inline_receiver, a ring's worth at a time;
+// only the receiving is timed.
+template <int... I>
+double inline_ns(uint64_t messages, sink& s, std::integer_sequence<int, I...>) {
+    constexpr int count = sizeof...(I);
+    messaging::inline_receiver<msg<I>...> r(4096);
+    messaging::inline_sender<msg<I>...> out = r;
+    auto handlers = [&s]<int J>(msg<J> const& m) { s.sum += m.value + J; };
+    std::chrono::steady_clock::duration elapsed{};
+    for (uint64_t n = 0; n < messages;) {
+        const uint64_t end = std::min<uint64_t>(messages, n + r.capacity());
+        for (uint64_t k = n; k < end; ++k) {
+            const int type = static_cast<int>(k % count);
+            ((type == I ? out.send(msg<I>{static_cast<uint32_t>(k)}) : void()), ...);
+        }
+        const auto start = std::chrono::steady_clock::now();
+        for (; n < end; ++n) {
+            r.wait(handlers);
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+    return ns_per(elapsed, messages);
+}
+
+template <int Handlers>
+void run(uint64_t messages) {
+    using types = std::make_integer_sequence<int, Handlers>;
+    sink s;
+
+    messaging::receiver r;
+    fill(r, messages, types{});
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t n = 0; n < messages; ++n) {
+        receive_one(r, s, types{});
+    }
+    const double receive_ns = ns_per(std::chrono::steady_clock::now() - start, messages);
+
+    // Again with the mailbox keeping statistics: time stamps on send, and
+    // sojourn, handler time and per-type counts on dispatch.
+    messaging::receiver counted;
+    counted.enable_stats();
+    fill(counted, messages, types{});
+    const auto counted_start = std::chrono::steady_clock::now();
+    for (uint64_t n = 0; n < messages; ++n) {
+        receive_one(counted, s, types{});
+    }
+    const double counted_ns = ns_per(std::chrono::steady_clock::now() - counted_start, messages);
+
+    // Same queue traffic, matched by the chain of dynamic_casts the jump
+    // table replaced.
+    messaging::queue q;
+    fill(messaging::sender(&q), messages, types{});
+    const auto rtti_start = std::chrono::steady_clock::now();
+    for (uint64_t n = 0; n < messages; ++n) {
+        rtti_dispatch(q.wait_and_pop().get(), s, types{});
+    }
+    const double rtti_ns = ns_per(std::chrono::steady_clock::now() - rtti_start, messages);
+
+    const double inline_receive_ns = inline_ns(messages, s, types{});
+
+    std::printf("%8d %14.1f %14.1f %14.1f %14.1f   (checksum %llu)\n", Handlers, receive_ns, counted_ns, rtti_ns,
+                inline_receive_ns, static_cast<unsigned long long>(s.sum));
+}
+
+void producer_consumer(uint64_t messages, std::size_t batch) {
+    messaging::receiver r;
+    messaging::sender out = r;
+    std::vector<msg<0>> chunk(batch);
+    const auto start = std::chrono::steady_clock::now();
+    std::thread producer([&] {
+        for (uint64_t n = 0; n < messages; n += batch) {
+            if (batch == 1) {
+                out.send(msg<0>{static_cast<uint32_t>(n)});
+            } else {
+                out.send_batch(chunk);
+            }
+        }
+    });
+    sink s;
+    for (uint64_t n = 0; n < messages; ++n) {
+        r.wait().handle<msg<0>>([&](msg<0> const& m) { s.sum += m.value; });
+    }
+    producer.join();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::printf("%8zu %14.0f\n", batch, static_cast<double>(messages) / elapsed.count());
+}
+
+// Two receivers bounce a message `rounds` times; returns ns per round trip.
+double ping_pong_ns(uint64_t rounds, messaging::wait_strategy strategy) {
+    messaging::receiver ping;
+    messaging::receiver pong;
+    ping.set_wait_strategy(strategy);
+    pong.set_wait_strategy(strategy);
+    std::thread responder([&] {
+        messaging::sender back = ping;
+        for (uint64_t n = 0; n < rounds; ++n) {
+            pong.wait().handle<msg<0>>([&](msg<0> const& m) { back.send(m); });
+        }
+    });
+    messaging::sender out = pong;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t n = 0; n < rounds; ++n) {
+        out.send(msg<0>{static_cast<uint32_t>(n)});
+        ping.wait().handle<msg<0>>([](msg<0> const&) {});
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    responder.join();
+    return ns_per(elapsed, rounds);
+}
+
+void ping_pong(uint64_t rounds) {
+    std::printf("%14.0f %14.0f\n", ping_pong_ns(rounds, messaging::wait_strategy::park),
+                ping_pong_ns(rounds, messaging::wait_strategy::adaptive));
+}
+
+void run_bank(messaging::receiver& incoming) {
+    unsigned balance = UINT_MAX;
+    incoming.run_until_closed([&] {
+        incoming.wait()
+            .handle<verify_pin>([&](verify_pin const& msg) {
+                if (msg.pin == "1937") {
+                    msg.reply(pin_verified());
+                } else {
+                    msg.reply(pin_incorrect());
+                }
+            })
+            .handle<withdraw>([&](withdraw const& msg) {
+                if (balance >= msg.amount) {
+                    msg.reply(withdraw_ok());
+                    balance -= msg.amount;
+                } else {
+                    msg.reply(withdraw_denied());
+                }
+            })
+            .handle<get_balance>([&](get_balance const& msg) { msg.reply(::balance(balance)); })
+            .handle<withdrawal_processed>([&](withdrawal_processed const&) {})
+            .handle<cancel_withdrawal>([&](cancel_withdrawal const&) {});
+    });
+}
+
+void run_interface(messaging::receiver& incoming, uint64_t& shown) {
+    incoming.run_until_closed([&] {
+        incoming.wait()
+            .handle<issue_money>([&](issue_money const&) { ++shown; })
+            .handle<display_enter_card>([&](display_enter_card const&) { ++shown; })
+            .handle<display_withdrawal_options>([&](display_withdrawal_options const&) { ++shown; })
+            .handle<display_balance>([&](display_balance const&) { ++shown; })
+            .handle<display_pin_incorrect_message>([&](display_pin_incorrect_message const&) { ++shown; })
+            .handle<display_insufficient_funds>([&](display_insufficient_funds const&) { ++shown; })
+            .handle<eject_card>([&](eject_card const&) { ++shown; });
+    });
+}
+
+// The messages atm.cpp exchanges for one card: 12 per session, 3 of them
+// answers to the ATM's asks.
+void atm_traffic(uint64_t sessions) {
+    messaging::receiver bank_rx;
+    messaging::receiver interface_rx;
+    messaging::sender bank = bank_rx;
+    messaging::sender interface_hardware = interface_rx;
+    uint64_t shown = 0;
+    std::thread bank_thread(run_bank, std::ref(bank_rx));
+    std::thread interface_thread(run_interface, std::ref(interface_rx), std::ref(shown));
+
+    const account_id account = "acc1234";
+    const uint64_t allocations = heap_allocations.load();
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t n = 0; n < sessions; ++n) {
+        interface_hardware.send(display_enter_card());
+        bank.ask<pin_reply>(verify_pin(account, "1937")).get();
+        interface_hardware.send(display_withdrawal_options());
+        if (std::optional<balance> b = bank.ask<balance>(get_balance(account)).get()) {
+            interface_hardware.send(display_balance(b->amount));
+        }
+        std::optional<withdraw_reply> w = bank.ask<withdraw_reply>(withdraw(account, 50)).get();
+        if (w && std::holds_alternative<withdraw_ok>(*w)) {
+            interface_hardware.send(issue_money(50));
+            bank.send(withdrawal_processed(account, 50));
+        }
+        interface_hardware.send(eject_card());
+    }
+    bank.send(messaging::close_queue());
+    interface_hardware.send(messaging::close_queue());
+    bank_thread.join();
+    interface_thread.join();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const double messages = static_cast<double>(sessions) * 12.0;
+    std::printf("\natm sessions: %llu in %.2f s, %.0f sessions/s, %.0f messages/s, "
+                "%.3f heap allocations/message (%llu displayed)\n",
+                static_cast<unsigned long long>(sessions), elapsed.count(),
+                static_cast<double>(sessions) / elapsed.count(), messages / elapsed.count(),
+                static_cast<double>(heap_allocations.load() - allocations) / messages,
+                static_cast<unsigned long long>(shown));
+}
+
+// An actor must not block a worker waiting for a future, so the actors answer
+// through the asker's mailbox instead: the PIN check carries the ATM's sender.
+struct check_pin {
+    pin_code pin;
+    mutable messaging::sender atm_queue;
+};
+
+class bank_actor : public messaging::actor {
+    void receive() override {
+        current().handle<check_pin>([](check_pin const& msg) {
+            if (msg.pin == "1937") {
+                msg.atm_queue.send(pin_verified());
+            } else {
+                msg.atm_queue.send(pin_incorrect());
+            }
+        });
+    }
+};
+
+// Inserts a card, then asks its bank to verify the PIN `rounds` times.
+class atm_actor : public messaging::actor {
+    messaging::sender bank;
+    uint64_t rounds;
+    std::atomic<uint64_t>& finished;
+
+    void verify() { bank.send(check_pin{"1937", *this}); }
+
+    void receive() override {
+        current()
+            .handle<card_inserted>([&](card_inserted const&) { verify(); })
+            .handle<pin_verified>([&](pin_verified const&) {
+                if (--rounds != 0) {
+                    verify();
+                } else {
+                    finished.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+    }
+
+public:
+    atm_actor(messaging::sender bank_, uint64_t rounds_, std::atomic<uint64_t>& finished_)
+        : bank(bank_), rounds(rounds_), finished(finished_) {}
+};
+
+// The same ATM as a coroutine machine: no handler chain per message.
+class atm_machine : public messaging::machine_actor {
+    messaging::sender bank;
+    uint64_t rounds;
+    std::atomic<uint64_t>& finished;
+
+    messaging::machine run() override {
+        co_await incoming.receive<card_inserted>();
+        for (uint64_t n = 0; n < rounds; ++n) {
+            bank.send(check_pin{"1937", *this});
+            co_await incoming.receive<pin_verified>();
+        }
+        finished.fetch_add(1, std::memory_order_relaxed);
+    }
+
+public:
+    atm_machine(messaging::sender bank_, uint64_t rounds_, std::atomic<uint64_t>& finished_)
+        : bank(bank_), rounds(rounds_), finished(finished_) {}
+};
+
+template <typename Atm>
+void actor_traffic(char const* what, std::size_t atms, uint64_t rounds) {
+    const std::size_t threads = std::max(1U, std::thread::hardware_concurrency());
+    std::vector<bank_actor> banks(threads);
+    std::atomic<uint64_t> finished{0};
+    std::vector<std::unique_ptr<Atm>> machines;
+    machines.reserve(atms);
+    for (std::size_t i = 0; i < atms; ++i) {
+        machines.push_back(std::make_unique<Atm>(banks[i % threads], rounds, finished));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        messaging::scheduler workers(threads);
+        for (auto& b : banks) {
+            workers.start(b);
+        }
+        for (auto& m : machines) {
+            workers.start(*m);
+            messaging::sender(*m).send(card_inserted("acc1234"));
+        }
+        while (finished.load(std::memory_order_relaxed) != atms) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const double messages = static_cast<double>(atms) * (1.0 + 2.0 * static_cast<double>(rounds));
+    std::printf("%s: %zu atms, %zu banks on %zu threads, %.0f messages in %.2f s, %.0f messages/s\n", what,
+                atms, banks.size(), threads, messages, elapsed.count(), messages / elapsed.count());
+}
+
+template <std::size_t Size>
+struct blob {
+    std::array<char, Size> bytes;
+};
+
+// Delivers `messages` blobs to each of `subscribers` receiver threads, either
+// published once on a bus or sent as one copy per receiver.
+template <std::size_t Size>
+double fan_out_ns(uint64_t messages, std::size_t subscribers, bool use_bus) {
+    messaging::bus events(1024);
+    std::deque<messaging::bus::subscription> subscriptions;     // Neither can move; a deque never moves them.
+    std::deque<messaging::receiver> receivers;
+    for (std::size_t i = 0; i < subscribers; ++i) {
+        if (use_bus) {
+            receivers.emplace_back(subscriptions.emplace_back(events));
+        } else {
+            receivers.emplace_back(1024);
+        }
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (auto& r : receivers) {
+        threads.emplace_back([&incoming = r] {
+            incoming.run_until_closed([&] {
+                incoming.wait().handle<blob<Size>>([](blob<Size> const& b) { (void)b.bytes[0]; });
+            });
+        });
+    }
+    blob<Size> b{};
+    for (uint64_t n = 0; n < messages; ++n) {
+        b.bytes[0] = static_cast<char>(n);
+        if (use_bus) {
+            events.publish(b);
+        } else {
+            for (auto& r : receivers) {
+                messaging::sender(r).send(b);
+            }
+        }
+    }
+    if (use_bus) {
+        events.publish(messaging::close_queue());
+    } else {
+        for (auto& r : receivers) {
+            messaging::sender(r).send(messaging::close_queue());
+        }
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return ns_per(std::chrono::steady_clock::now() - start, messages);
+}
+
+template <std::size_t Size>
+void fan_out(uint64_t messages, std::size_t subscribers) {
+    std::printf("%8zu %8zu %14.1f %14.1f\n", Size, subscribers, fan_out_ns<Size>(messages, subscribers, true),
+                fan_out_ns<Size>(messages, subscribers, false));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const uint64_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000U;
+    std::printf("%llu messages per row, ns per message\n\n", static_cast<unsigned long long>(messages));
+    std::printf("%8s %14s %14s %14s %14s\n", "handlers", "receive", "with stats", "rtti chain", "inline");
+    run<2>(messages);
+    run<8>(messages);
+    run<32>(messages);
+
+    std::printf("\n%8s %14s\n", "batch", "messages/s");
+    producer_consumer(messages / 64U * 64U, 1U);
+    producer_consumer(messages / 64U * 64U, 64U);
+
+    std::printf("\n%14s %14s   (ns per round trip)\n", "park", "adaptive");
+    ping_pong(messages / 10U);
+
+    std::printf("\n%8s %8s %14s %14s\n", "bytes", "readers", "bus publish", "send copies");
+    fan_out<16>(messages / 10U, 8U);
+    fan_out<4096>(messages / 10U, 8U);
+
+    atm_traffic(messages / 10U);
+    std::printf("\n");
+    actor_traffic<atm_actor>("actors", 100000U, messages / 100000U + 1U);
+    actor_traffic<atm_machine>("coroutine actors", 100000U, messages / 100000U + 1U);
+    return 0;
+}
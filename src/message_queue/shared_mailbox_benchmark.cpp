@@ -0,0 +1,246 @@
+//
+// Created by coolk on 19-10-2026.
+//
+// Copyright Aeva 2026
+//
+// Cross-process messaging benchmark. Build it optimised:
+//
+//   bazel run -c opt //:shared_mailbox_benchmark -- [messages]
+//
+// Forks a child process and reports, for 16, 64 and 192 byte messages,
+//   * messages/s from the child to the parent, one message per send, through
+//     a shared_mailbox and through a Unix domain socket (one write(2) per
+//     message, one read(2) per message on the other side);
+//   * the round trip time of a ping-pong between the two processes over two
+//     shared_mailboxes and over one socket pair.
+// Both sides of the socket baseline block in the kernel when they have to
+// wait, as the mailbox does on its futexes.
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "include/message_queue/receiver.h"
+#include "include/message_queue/shared_mailbox.h"
+
+namespace {
+
+template <std::size_t Size>
+struct payload {
+    uint64_t sequence;
+    char bytes[Size - sizeof(uint64_t)];
+};
+
+constexpr uint64_t last = UINT64_MAX;   // Sequence of the message that ends a socket run.
+
+std::string mailbox_name(char const* what) {
+    return std::string("/shared_mailbox_benchmark_") + what + "_" + std::to_string(::getpid());
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void reap(pid_t child) {
+    int status = 0;
+    ::waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::fprintf(stderr, "child failed\n");
+        std::exit(1);
+    }
+}
+
+bool write_all(int fd, void const* data, std::size_t size) {
+    auto const* p = static_cast<char const*>(data);
+    while (size != 0) {
+        const ssize_t n = ::write(fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, std::size_t size) {
+    auto* p = static_cast<char*>(data);
+    while (size != 0) {
+        const ssize_t n = ::read(fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+template <std::size_t Size>
+double mailbox_throughput(uint64_t messages) {
+    const std::string name = mailbox_name("throughput");
+    auto mailbox = messaging::shared_mailbox::create(name.c_str());
+    if (mailbox == nullptr) {
+        std::exit(1);
+    }
+    const pid_t child = ::fork();
+    if (child == 0) {
+        auto remote = messaging::shared_mailbox::open(name.c_str());
+        if (remote == nullptr) {
+            ::_exit(1);
+        }
+        messaging::remote_sender out(remote.get());
+        for (uint64_t i = 0; i < messages; ++i) {
+            out.send(payload<Size>{i, {}});
+        }
+        out.send(messaging::close_queue{});
+        ::_exit(0);
+    }
+
+    messaging::receiver incoming(*mailbox);
+    uint64_t sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    incoming.run_until_closed([&] {
+        incoming.wait().handle<payload<Size>>([&](payload<Size> const& msg) { sum += msg.sequence; });
+    });
+    const double elapsed = seconds_since(start);
+    reap(child);
+    if (sum != messages * (messages - 1U) / 2U) {
+        std::fprintf(stderr, "lost messages\n");
+        std::exit(1);
+    }
+    return static_cast<double>(messages) / elapsed;
+}
+
+template <std::size_t Size>
+double socket_throughput(uint64_t messages) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::exit(1);
+    }
+    const pid_t child = ::fork();
+    if (child == 0) {
+        ::close(fds[0]);
+        for (uint64_t i = 0; i <= messages; ++i) {
+            payload<Size> msg{i == messages ? last : i, {}};
+            if (!write_all(fds[1], &msg, sizeof(msg))) {
+                ::_exit(1);
+            }
+        }
+        ::_exit(0);
+    }
+
+    ::close(fds[1]);
+    uint64_t sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        payload<Size> msg;
+        if (!read_all(fds[0], &msg, sizeof(msg)) || msg.sequence == last) {
+            break;
+        }
+        sum += msg.sequence;
+    }
+    const double elapsed = seconds_since(start);
+    ::close(fds[0]);
+    reap(child);
+    if (sum != messages * (messages - 1U) / 2U) {
+        std::fprintf(stderr, "lost messages\n");
+        std::exit(1);
+    }
+    return static_cast<double>(messages) / elapsed;
+}
+
+// Both mailboxes are created before the fork: the child receives on `ping`, the parent on `pong`.
+template <std::size_t Size>
+double mailbox_round_trip_ns(uint64_t round_trips) {
+    const std::string ping_name = mailbox_name("ping");
+    const std::string pong_name = mailbox_name("pong");
+    auto ping = messaging::shared_mailbox::create(ping_name.c_str());
+    auto pong = messaging::shared_mailbox::create(pong_name.c_str());
+    if (ping == nullptr || pong == nullptr) {
+        std::exit(1);
+    }
+    const pid_t child = ::fork();
+    if (child == 0) {
+        messaging::receiver incoming(*ping);
+        messaging::remote_sender reply(pong.get());
+        incoming.run_until_closed([&] {
+            incoming.wait().handle<payload<Size>>([&](payload<Size> const& msg) { reply.send(msg); });
+        });
+        ::_exit(0);
+    }
+
+    messaging::receiver incoming(*pong);
+    messaging::remote_sender out(ping.get());
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < round_trips; ++i) {
+        out.send(payload<Size>{i, {}});
+        incoming.wait().handle<payload<Size>>([](payload<Size> const&) {});
+    }
+    const double elapsed = seconds_since(start);
+    out.send(messaging::close_queue{});
+    reap(child);
+    return elapsed * 1e9 / static_cast<double>(round_trips);
+}
+
+template <std::size_t Size>
+double socket_round_trip_ns(uint64_t round_trips) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::exit(1);
+    }
+    const pid_t child = ::fork();
+    if (child == 0) {
+        ::close(fds[0]);
+        payload<Size> msg;
+        while (read_all(fds[1], &msg, sizeof(msg)) && msg.sequence != last) {
+            if (!write_all(fds[1], &msg, sizeof(msg))) {
+                ::_exit(1);
+            }
+        }
+        ::_exit(0);
+    }
+
+    ::close(fds[1]);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < round_trips; ++i) {
+        payload<Size> msg{i, {}};
+        if (!write_all(fds[0], &msg, sizeof(msg)) || !read_all(fds[0], &msg, sizeof(msg))) {
+            std::exit(1);
+        }
+    }
+    const double elapsed = seconds_since(start);
+    payload<Size> stop{last, {}};
+    write_all(fds[0], &stop, sizeof(stop));
+    ::close(fds[0]);
+    reap(child);
+    return elapsed * 1e9 / static_cast<double>(round_trips);
+}
+
+template <std::size_t Size>
+void run(uint64_t messages) {
+    const uint64_t round_trips = messages / 10U + 1U;
+    std::printf("%6zu %16.0f %16.0f %14.0f %14.0f\n", Size, mailbox_throughput<Size>(messages),
+                socket_throughput<Size>(messages), mailbox_round_trip_ns<Size>(round_trips),
+                socket_round_trip_ns<Size>(round_trips));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const uint64_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000U;
+    std::printf("%llu messages per throughput run, a tenth as many round trips\n\n",
+                static_cast<unsigned long long>(messages));
+    std::printf("%6s %16s %16s %14s %14s\n", "bytes", "mailbox msg/s", "socket msg/s", "mailbox rtt ns",
+                "socket rtt ns");
+    run<16>(messages);
+    run<64>(messages);
+    run<192>(messages);
+    return 0;
+}
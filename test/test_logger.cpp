@@ -0,0 +1,394 @@
+///
+/// @file test_logger.cpp
+///
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "src/logger/log.h"
+#include "src/logger/log_region.h"
+#include "src/logger/log_sink.h"
+#include "src/logger/logger.h"
+
+namespace {
+
+using aeva::safe::logger::ArgType;
+using aeva::safe::logger::BinaryFileSink;
+using aeva::safe::logger::decode_compact;
+using aeva::safe::logger::encode_compact;
+using aeva::safe::logger::EventInfo;
+using aeva::safe::logger::format_record;
+using aeva::safe::logger::is_valid_region;
+using aeva::safe::logger::kBinaryEventHeaderSize;
+using aeva::safe::logger::kBinaryEventTag;
+using aeva::safe::logger::kBinaryHeaderSize;
+using aeva::safe::logger::kBinaryMagic;
+using aeva::safe::logger::kBinaryRecordTag;
+using aeva::safe::logger::kBinaryVersion;
+using aeva::safe::logger::kCompactHeaderSize;
+using aeva::safe::logger::kCompactMaxSize;
+using aeva::safe::logger::LogEntry;
+using aeva::safe::logger::LogLevel;
+using aeva::safe::logger::LogRecord;
+using aeva::safe::logger::LogRegion;
+using aeva::safe::logger::lookup_event;
+using aeva::safe::logger::make_payload;
+using aeva::safe::logger::RegionHeader;
+using aeva::safe::logger::RegionKind;
+using aeva::safe::logger::ring_header;
+using aeva::safe::logger::ring_slots;
+using aeva::safe::logger::to_record;
+
+template <typename... Args>
+LogRecord MakeRecord(LogLevel level, uint32_t event, uint64_t timestamp,
+                     Args... args) {
+  LogRecord record = to_record(level, event, make_payload(args...));
+  record.timestamp = timestamp;
+  return record;
+}
+
+std::unique_ptr<LogRegion> MakeRegion(uint32_t slot_count,
+                                      RegionKind kind = RegionKind::kAnonymous,
+                                      const char* name = nullptr,
+                                      uint32_t ring_count = 1U) {
+  LogRegion::Options options;
+  options.kind = kind;
+  options.name = name;
+  options.slot_count = slot_count;
+  options.ring_count = ring_count;
+  options.unlink_on_close = false;
+  return LogRegion::create("test", options);
+}
+
+TEST(LogRegionShould, PublishAndFormatRecords) {
+  auto region = MakeRegion(8U);
+  ASSERT_TRUE(region);
+
+  const uint32_t event = region->add_event("main.cpp", 12U, "x={} y={} z={}");
+  auto& ring = region->ring(0);
+  ASSERT_TRUE(ring.try_push(MakeRecord(LogLevel::kLOG_LEVEL_WARN, event, 7U,
+                                       uint32_t{3}, int32_t{-4}, 1.5f)));
+
+  const LogRecord* record = ring.front();
+  ASSERT_NE(record, nullptr);
+  EventInfo info{};
+  ASSERT_TRUE(lookup_event(region->header(), event, info));
+  char line[128];
+  format_record(&info, *record, line, sizeof(line));
+  EXPECT_STREQ(line, "7 WARN t0 main.cpp:12 x=3 y=-4 z=1.5");
+
+  ring.release();
+  EXPECT_EQ(ring.front(), nullptr);
+}
+
+TEST(LogRegionShould, RejectRecordsWhenFull) {
+  auto region = MakeRegion(4U);
+  ASSERT_TRUE(region);
+  auto& ring = region->ring(0);
+  const auto record = MakeRecord(LogLevel::kLOG_LEVEL_INFO, 0U, 0U);
+
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.try_push(record));
+  }
+  EXPECT_FALSE(ring.try_push(record));
+
+  ring.release();
+  EXPECT_TRUE(ring.try_push(record));
+}
+
+TEST(LogRegionShould, KeepEachRingInItsOwnPageAlignedSpan) {
+  auto region = MakeRegion(4U, RegionKind::kAnonymous, nullptr, 3U);
+  ASSERT_TRUE(region);
+  ASSERT_EQ(region->ring_count(), 3U);
+  const auto record = MakeRecord(LogLevel::kLOG_LEVEL_INFO, 0U, 0U);
+
+  for (uint32_t node = 0; node < 3U; ++node) {
+    const auto* ring = region->ring(node).header();
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ring) % 4096U, 0U);
+    EXPECT_EQ(&region->ring_for_node(node), &region->ring(node));
+  }
+  EXPECT_EQ(&region->ring_for_node(4U), &region->ring(1));
+
+  // Filling one ring leaves the others untouched.
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(region->ring(0).try_push(record));
+  }
+  EXPECT_FALSE(region->ring(0).try_push(record));
+  EXPECT_TRUE(region->ring(2).try_push(record));
+  EXPECT_EQ(region->written(), 5U);
+  EXPECT_TRUE(is_valid_region(region->header(), region->header()->region_size));
+}
+
+TEST(LogRegionShould, LeaveUnconsumedRecordsInTheBackingFile) {
+  const std::string path = ::testing::TempDir() + "logger_region_test";
+  {
+    auto region = MakeRegion(16U, RegionKind::kFile, path.c_str());
+    ASSERT_TRUE(region);
+    const uint32_t event = region->add_event("crash.cpp", 1U, "step {}");
+    for (uint32_t i = 0; i < 3U; ++i) {
+      region->ring(0).try_push(
+          MakeRecord(LogLevel::kLOG_LEVEL_ERROR, event, i, i));
+    }
+  }
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  struct stat st {};
+  ASSERT_EQ(::fstat(fd, &st), 0);
+  void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  ASSERT_NE(map, MAP_FAILED);
+
+  ASSERT_TRUE(is_valid_region(map, st.st_size));
+  const auto* header = static_cast<const RegionHeader*>(map);
+  const auto* ring = ring_header(header, 0U);
+  EXPECT_EQ(ring->write_index.load(), 3U);
+  EXPECT_EQ(ring->read_index.load(), 0U);
+  const LogRecord* slots = ring_slots(header, ring);
+  EventInfo info{};
+  ASSERT_TRUE(lookup_event(header, slots[2].event_id, info));
+  char line[128];
+  format_record(&info, slots[2], line, sizeof(line));
+  EXPECT_STREQ(line, "2 ERROR t0 crash.cpp:1 step 2");
+
+  ::munmap(map, st.st_size);
+  ::unlink(path.c_str());
+}
+
+TEST(LogRegionShould, RefuseToOverwriteTheRegionOfAnEarlierRun) {
+  const std::string path = ::testing::TempDir() + "logger_region_kept";
+  {
+    auto crashed = MakeRegion(16U, RegionKind::kFile, path.c_str());
+    ASSERT_TRUE(crashed);
+    const uint32_t event = crashed->add_event("crash.cpp", 2U, "last words");
+    crashed->ring(0).try_push(MakeRecord(LogLevel::kLOG_LEVEL_ERROR, event, 0U));
+  }
+  EXPECT_FALSE(MakeRegion(16U, RegionKind::kFile, path.c_str()));
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  struct stat st {};
+  ASSERT_EQ(::fstat(fd, &st), 0);
+  void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  ASSERT_NE(map, MAP_FAILED);
+  ASSERT_TRUE(is_valid_region(map, st.st_size));
+  EXPECT_EQ(ring_header(static_cast<const RegionHeader*>(map), 0U)
+                ->write_index.load(),
+            1U);
+  ::munmap(map, st.st_size);
+  ::unlink(path.c_str());
+}
+
+TEST(BinaryFileSinkShould, WriteTheLayoutLogExtractReads) {
+  const std::string path = ::testing::TempDir() + "logger_binary_sink";
+  auto region = MakeRegion(8U);
+  ASSERT_TRUE(region);
+  const uint32_t event = region->add_event("sink.cpp", 5U, "n={}");
+  LogEntry entry;
+  entry.reset(region->header(),
+              MakeRecord(LogLevel::kLOG_LEVEL_WARN, event, 1U, uint32_t{9}));
+  {
+    BinaryFileSink sink(path.c_str());
+    ASSERT_TRUE(sink.is_open());
+    sink.consume(&entry, 1U);
+    sink.flush_pending();
+  }
+
+  std::FILE* file = std::fopen(path.c_str(), "rb");
+  ASSERT_NE(file, nullptr);
+  std::vector<char> bytes(4096U);
+  bytes.resize(std::fread(bytes.data(), 1U, bytes.size(), file));
+  std::fclose(file);
+  ::unlink(path.c_str());
+
+  ASSERT_GT(bytes.size(), kBinaryHeaderSize + 1U + kBinaryEventHeaderSize);
+  EXPECT_EQ(std::memcmp(bytes.data(), kBinaryMagic, sizeof(kBinaryMagic)), 0);
+  uint32_t version = 0U;
+  std::memcpy(&version, bytes.data() + sizeof(kBinaryMagic), sizeof(version));
+  EXPECT_EQ(version, kBinaryVersion);
+  EXPECT_EQ(bytes[kBinaryHeaderSize], kBinaryEventTag);
+  const std::size_t strings = kBinaryHeaderSize + 1U + kBinaryEventHeaderSize;
+  EXPECT_STREQ(bytes.data() + strings, "sink.cpp");
+  EXPECT_STREQ(bytes.data() + strings + sizeof("sink.cpp"), "n={}");
+  EXPECT_EQ(bytes[strings + sizeof("sink.cpp") + sizeof("n={}")],
+            kBinaryRecordTag);
+}
+
+TEST(LogRecordShould, PackTypesCountAndLevelIntoTheHeaderWord) {
+  const auto record = MakeRecord(LogLevel::kLOG_LEVEL_DEBUG, 9U, 0U,
+                                 1.0f, uint32_t{2}, int32_t{3});
+
+  EXPECT_EQ(record.event_id, 9U);
+  EXPECT_EQ(record.count(), 3U);
+  EXPECT_EQ(record.level(), LogLevel::kLOG_LEVEL_DEBUG);
+  EXPECT_EQ(record.type(0), ArgType::F32);
+  EXPECT_EQ(record.type(1), ArgType::U32);
+  EXPECT_EQ(record.type(2), ArgType::I32);
+}
+
+TEST(LogRecordShould, EncodeOnlyTheUsedArgumentsInCompactForm) {
+  auto record = MakeRecord(LogLevel::kLOG_LEVEL_ERROR, 5U, 42U, uint32_t{7},
+                           int32_t{-1});
+  record.thread = 3U;
+  char buffer[kCompactMaxSize];
+
+  const std::size_t size = encode_compact(record, buffer);
+  EXPECT_EQ(size, kCompactHeaderSize + 2U * sizeof(uint32_t));
+
+  LogRecord decoded{};
+  EXPECT_EQ(decode_compact(buffer, size - 1U, decoded), 0U);
+  ASSERT_EQ(decode_compact(buffer, size, decoded), size);
+  EXPECT_EQ(decoded.timestamp, 42U);
+  EXPECT_EQ(decoded.event_id, 5U);
+  EXPECT_EQ(decoded.header, record.header);
+  EXPECT_EQ(decoded.thread, 3U);
+  EXPECT_EQ(decoded.data[0], 7U);
+  EXPECT_EQ(static_cast<int32_t>(decoded.data[1]), -1);
+}
+
+TEST(LoggerShould, DropRecordsBelowTheRuntimeLevel) {
+  aeva::safe::logger::LoggerOptions options;
+  options.level = LogLevel::kLOG_LEVEL_ERROR;
+  options.sinks.push_back(std::make_shared<aeva::safe::logger::TestSink>());
+  aeva::safe::logger::Logger::init("test", options);
+  auto& logger = aeva::safe::logger::Logger::instance();
+
+  logger.info("not recorded");
+  SAFE_LOG_ERROR("recorded {}", uint32_t{1});
+  EXPECT_EQ(logger.region().written(), 1U);
+
+  aeva::safe::logger::Logger::shutdown();
+}
+
+TEST(LoggerShould, FallBackToTheDefaultRegionWhenTheOptionsAreUnusable) {
+  aeva::safe::logger::LoggerOptions options;
+  options.region.slot_count = 3U;  // Not a power of two, whatever the kind.
+  options.level = LogLevel::kLOG_LEVEL_ERROR;
+  options.sinks.push_back(std::make_shared<aeva::safe::logger::TestSink>());
+  aeva::safe::logger::Logger::init("test", options);
+  auto& logger = aeva::safe::logger::Logger::instance();
+
+  ASSERT_TRUE(logger.has_region());
+  SAFE_LOG_ERROR("still recorded {}", uint32_t{1});
+  EXPECT_EQ(logger.region().written(), 1U);
+
+  aeva::safe::logger::Logger::shutdown();
+}
+
+TEST(LoggerShould, InternPlainMessagesByTheirText) {
+  using aeva::safe::logger::TestSink;
+
+  auto sink = std::make_shared<TestSink>();
+  aeva::safe::logger::LoggerOptions options;
+  options.sinks = {sink};
+  aeva::safe::logger::Logger::init("test", options);
+  auto& logger = aeva::safe::logger::Logger::instance();
+
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "first text");
+  logger.info(buffer);
+  std::snprintf(buffer, sizeof(buffer), "second text");
+  logger.info(buffer);
+  logger.info("first text");
+  ASSERT_TRUE(sink->wait_for(3U, std::chrono::seconds(5)));
+  aeva::safe::logger::Logger::shutdown();
+
+  const auto captured = sink->captured();
+  ASSERT_EQ(captured.size(), 3U);
+  EXPECT_NE(captured[0].text.find("first text"), std::string::npos);
+  EXPECT_NE(captured[1].text.find("second text"), std::string::npos);
+  EXPECT_EQ(captured[2].record.event_id, captured[0].record.event_id);
+}
+
+void LogFromSiteA(uint32_t value) { SAFE_LOG_ERROR("site A {}", value); }
+
+void LogFromSiteB(uint32_t value) { SAFE_LOG_ERROR("site B {}", value); }
+
+TEST(LoggerShould, KeepTheEventIdsOfCallSitesAcrossReinit) {
+  using aeva::safe::logger::TestSink;
+
+  auto first = std::make_shared<TestSink>();
+  aeva::safe::logger::LoggerOptions options;
+  options.sinks = {first};
+  aeva::safe::logger::Logger::init("test", options);
+  LogFromSiteA(1U);
+  aeva::safe::logger::Logger::shutdown();
+
+  // Site B registers first in the new region; site A keeps its cached id.
+  auto second = std::make_shared<TestSink>();
+  options.sinks = {second};
+  aeva::safe::logger::Logger::init("test", options);
+  LogFromSiteB(2U);
+  LogFromSiteA(3U);
+  aeva::safe::logger::Logger::shutdown();
+
+  const auto captured = second->captured();
+  ASSERT_EQ(captured.size(), 2U);
+  EXPECT_NE(captured[0].text.find("site B 2"), std::string::npos);
+  EXPECT_NE(captured[1].text.find("site A 3"), std::string::npos);
+}
+
+TEST(LoggerShould, FanOutEachRecordToEverySinkThatAcceptsItsLevel) {
+  using aeva::safe::logger::MemoryRingSink;
+  using aeva::safe::logger::TestSink;
+
+  auto all = std::make_shared<TestSink>();
+  auto errors_only = std::make_shared<TestSink>(LogLevel::kLOG_LEVEL_ERROR);
+  auto ring = std::make_shared<MemoryRingSink>(2U, LogLevel::kLOG_LEVEL_INFO, 1U);
+  aeva::safe::logger::LoggerOptions options;
+  options.sinks = {all, errors_only, ring};
+  aeva::safe::logger::Logger::init("test", options);
+  auto& logger = aeva::safe::logger::Logger::instance();
+
+  const uint32_t event = logger.register_event("sink.cpp", 3U, "value {}");
+  logger.log(LogLevel::kLOG_LEVEL_INFO, event, uint32_t{1});
+  logger.log(LogLevel::kLOG_LEVEL_ERROR, event, uint32_t{2});
+  logger.log(LogLevel::kLOG_LEVEL_WARN, event, uint32_t{3});
+  aeva::safe::logger::Logger::shutdown();
+
+  const auto captured = all->captured();
+  ASSERT_EQ(captured.size(), 3U);
+  EXPECT_NE(captured[0].text.find("sink.cpp:3 value 1"), std::string::npos);
+
+  const auto errors = errors_only->captured();
+  ASSERT_EQ(errors.size(), 1U);
+  EXPECT_EQ(errors[0].record.data[0], 2U);
+
+  const auto lines = ring->snapshot();
+  ASSERT_EQ(lines.size(), 2U);
+  EXPECT_EQ(lines[0], captured[1].text);
+  EXPECT_EQ(lines[1], captured[2].text);
+}
+
+TEST(LoggerShould, DrainEveryRingAndApplyBackendPlacement) {
+  using aeva::safe::logger::TestSink;
+
+  auto sink = std::make_shared<TestSink>();
+  aeva::safe::logger::LoggerOptions options;
+  options.region.ring_count = 2U;
+  options.backend.cpus = {0};
+  options.sinks = {sink};
+  aeva::safe::logger::Logger::init("test", options);
+  auto& logger = aeva::safe::logger::Logger::instance();
+
+  const uint32_t event = logger.register_event("numa.cpp", 1U, "from {}");
+  logger.log(LogLevel::kLOG_LEVEL_INFO, event, uint32_t{1});
+  // A thread on another node pushes into another ring; emulate one.
+  auto record = MakeRecord(LogLevel::kLOG_LEVEL_INFO, event, 0U, uint32_t{2});
+  logger.region().ring(1).try_push(record);
+  ASSERT_TRUE(sink->wait_for(2U, std::chrono::seconds(5)));
+  aeva::safe::logger::Logger::shutdown();
+
+  EXPECT_EQ(sink->captured().size(), 2U);
+}
+
+}  // namespace
@@ -0,0 +1,956 @@
+///
+/// @file test_message_queue.cpp
+///
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "include/message_queue/actor.h"
+#include "include/message_queue/bus.h"
+#include "include/message_queue/coroutine.h"
+#include "include/message_queue/inline_receiver.h"
+#include "include/message_queue/inline_string.h"
+#include "include/message_queue/receiver.h"
+
+namespace {
+
+template <int I>
+struct numbered {
+    int value;
+};
+
+struct unhandled {};
+
+struct stop_now {};
+
+struct tracked {
+    std::shared_ptr<int> life;
+    int value;
+};
+
+struct counted_copies {
+    int* copies;
+    int* moves;
+
+    counted_copies(int* copies_, int* moves_) : copies(copies_), moves(moves_) {}
+    counted_copies(counted_copies const& other) : copies(other.copies), moves(other.moves) { ++*copies; }
+    counted_copies(counted_copies&& other) noexcept : copies(other.copies), moves(other.moves) { ++*moves; }
+};
+
+struct question : messaging::request<int> {
+    int value;
+
+    explicit question(int value_) : value(value_) {}
+};
+
+struct counted_question : messaging::request<int> {
+    counted_copies tally;
+
+    counted_question(int* copies_, int* moves_) : tally(copies_, moves_) {}
+};
+
+}  // namespace
+
+template <>
+struct messaging::is_control_message<stop_now> : std::true_type {};
+
+namespace {
+
+TEST(MessageTypeIdShould, BeDistinctPerTypeAndIgnoreCv) {
+    EXPECT_NE(messaging::type_id_of<numbered<0>>, messaging::type_id_of<numbered<1>>);
+    EXPECT_NE(messaging::type_id_of<numbered<0>>, messaging::type_id_of<messaging::close_queue>);
+    EXPECT_EQ(messaging::type_id_of<numbered<0>>, messaging::type_id_of<const numbered<0>>);
+    static_assert(messaging::type_id_of<numbered<2>> != 0U);
+}
+
+TEST(DispatcherShould, CallTheHandlerRegisteredForEachMessageType) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    out.send(numbered<2>{20});
+    out.send(unhandled{});  // Dropped by the wait below, which keeps waiting.
+    out.send(numbered<0>{0});
+    out.send(numbered<1>{10});
+
+    std::vector<int> seen;
+    for (int i = 0; i < 3; ++i) {
+        incoming.wait()
+            .handle<numbered<0>>([&](numbered<0> const& msg) { seen.push_back(msg.value); })
+            .handle<numbered<1>>([&](numbered<1> const& msg) { seen.push_back(msg.value + 1); })
+            .handle<numbered<2>>([&](numbered<2> const& msg) { seen.push_back(msg.value + 2); });
+    }
+    EXPECT_EQ(seen, (std::vector<int>{22, 0, 11}));
+}
+
+TEST(DispatcherShould, PreferTheLastChainedHandlerOfARepeatedType) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    out.send(numbered<0>{1});
+
+    int handled_by = 0;
+    incoming.wait()
+        .handle<numbered<0>>([&](numbered<0> const&) { handled_by = 1; })
+        .handle<numbered<0>>([&](numbered<0> const&) { handled_by = 2; });
+    EXPECT_EQ(handled_by, 2);
+}
+
+TEST(DispatcherShould, ThrowCloseQueueWhenNoHandlerMatchesIt) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    out.send(messaging::close_queue{});
+
+    bool handled = false;
+    EXPECT_THROW(incoming.wait().handle<numbered<0>>([&](numbered<0> const&) { handled = true; }),
+                 messaging::close_queue);
+    EXPECT_FALSE(handled);
+}
+
+TEST(DispatcherShould, ReportHandledAndClosedThroughTheStatusWithoutThrowing) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    out.send(numbered<0>{1});
+
+    int seen = 0;
+    EXPECT_EQ(incoming.wait().handle<numbered<0>>([&](numbered<0> const& msg) { seen = msg.value; }).result(),
+              messaging::dispatch_status::handled);
+    EXPECT_EQ(seen, 1);
+    EXPECT_FALSE(incoming.closed());
+
+    out.send(unhandled{});
+    out.send(messaging::close_queue{});
+    EXPECT_EQ(incoming.wait().handle<numbered<0>>([&](numbered<0> const&) { seen = 2; }).result(),
+              messaging::dispatch_status::closed);
+    EXPECT_EQ(seen, 1);
+    EXPECT_TRUE(incoming.closed());
+}
+
+TEST(ReceiverShould, RunUntilClosedWithoutThrowing) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    for (int i = 0; i < 3; ++i) {
+        out.send(numbered<0>{i});
+    }
+
+    std::vector<int> seen;
+    incoming.run_until_closed([&] {
+        incoming.wait().handle<numbered<0>>([&](numbered<0> const& msg) {
+            seen.push_back(msg.value);
+            if (msg.value == 2) {
+                out.send(messaging::close_queue{});
+            }
+        });
+    });
+    EXPECT_EQ(seen, (std::vector<int>{0, 1, 2}));
+    EXPECT_TRUE(incoming.closed());
+}
+
+TEST(ReceiverShould, CallOnTimeoutWhenNothingIsHandledBeforeTheDeadline) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    out.send(unhandled{});  // Dropped, and doesn't restart the wait.
+
+    bool handled = false;
+    bool timed_out = false;
+    const auto start = std::chrono::steady_clock::now();
+    const auto status = incoming.wait_for(std::chrono::milliseconds(20))
+                            .handle<numbered<0>>([&](numbered<0> const&) { handled = true; })
+                            .on_timeout([&] { timed_out = true; })
+                            .result();
+    EXPECT_EQ(status, messaging::dispatch_status::timed_out);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+    EXPECT_TRUE(timed_out);
+    EXPECT_FALSE(handled);
+    EXPECT_EQ(incoming.depth(), 0U);
+}
+
+TEST(ReceiverShould, HandleAMessageThatArrivesBeforeTheDeadline) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    std::thread late([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        out.send(numbered<0>{7});
+    });
+
+    int seen = 0;
+    bool timed_out = false;
+    incoming.wait_until(std::chrono::steady_clock::now() + std::chrono::seconds(10))
+        .on_timeout([&] { timed_out = true; })
+        .handle<numbered<0>>([&](numbered<0> const& msg) { seen = msg.value; });
+    late.join();
+    EXPECT_EQ(seen, 7);
+    EXPECT_FALSE(timed_out);
+}
+
+TEST(ReceiverShould, AnswerPingPongAndStillTimeOutWithTheAdaptiveWait) {
+    messaging::receiver ping;
+    messaging::receiver pong;
+    ping.set_wait_strategy(messaging::wait_strategy::adaptive);
+    pong.set_wait_strategy(messaging::wait_strategy::adaptive);
+    constexpr int rounds = 1000;
+    std::thread responder([&] {
+        messaging::sender back = ping;
+        pong.run_until_closed([&] {
+            pong.wait().handle<numbered<0>>([&](numbered<0> const& msg) { back.send(numbered<1>{msg.value + 1}); });
+        });
+    });
+    messaging::sender out = pong;
+    int total = 0;
+    for (int i = 0; i < rounds; ++i) {
+        out.send(numbered<0>{i});
+        ping.wait().handle<numbered<1>>([&](numbered<1> const& msg) { total += msg.value - i; });
+    }
+    out.send(messaging::close_queue{});
+    responder.join();
+    EXPECT_EQ(total, rounds);
+
+    const auto start = std::chrono::steady_clock::now();
+    bool timed_out = false;
+    ping.wait_for(std::chrono::milliseconds(5))
+        .handle<numbered<1>>([](numbered<1> const&) {})
+        .on_timeout([&] { timed_out = true; });
+    EXPECT_TRUE(timed_out);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(5));
+}
+
+TEST(ReceiverShould, StashUnmatchedMessagesAndOfferThemToTheNextStateInOrder) {
+    messaging::receiver incoming;
+    incoming.stash_unmatched(true);
+    messaging::sender out = incoming;
+    out.send(numbered<1>{1});
+    out.send(numbered<2>{2});
+    out.send(numbered<1>{3});
+    out.send(numbered<0>{4});
+    out.send(numbered<2>{5});
+
+    std::vector<int> seen;
+    auto record = [&] { return [&](auto const& msg) { seen.push_back(msg.value); }; };
+    incoming.wait().handle<numbered<0>>(record());    // Stashes 1, 2 and 3 on the way to 4.
+    EXPECT_EQ(incoming.stashed(), 3U);
+    incoming.wait().handle<numbered<2>>(record());
+    incoming.wait().handle<numbered<1>>(record()).handle<numbered<2>>(record());
+    incoming.wait().handle<numbered<1>>(record()).handle<numbered<2>>(record());
+    incoming.wait().handle<numbered<2>>(record());    // Past the stash: 5 is still in the mailbox.
+    EXPECT_EQ(seen, (std::vector<int>{4, 2, 1, 3, 5}));
+    EXPECT_EQ(incoming.stashed(), 0U);
+
+    out.send(unhandled{});
+    out.send(messaging::close_queue{});
+    incoming.run_until_closed([&] { incoming.wait().handle<numbered<0>>(record()); });
+    EXPECT_EQ(incoming.stashed(), 0U);    // The close overtook it.
+}
+
+TEST(ReceiverShould, CountEveryOutcomeAndTimeEveryMessageInItsSnapshot) {
+    messaging::receiver incoming;
+    incoming.enable_stats();
+    messaging::sender out = incoming;
+    out.send(numbered<0>{0});
+    out.send(unhandled{});
+    out.send(numbered<0>{2});
+    out.send(numbered<1>{1});
+    EXPECT_EQ(incoming.snapshot().depth, 4U);
+
+    for (int i = 0; i < 2; ++i) {   // Drops the unhandled message on the way.
+        incoming.wait().handle<numbered<0>>([](numbered<0> const&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+    }
+    incoming.stash_unmatched(true);
+    incoming.wait_for(std::chrono::milliseconds(1)).handle<numbered<2>>([](numbered<2> const&) {}).on_timeout([] {});
+
+    const messaging::mailbox_snapshot stats = incoming.snapshot();
+    EXPECT_EQ(stats.depth, 0U);
+    EXPECT_EQ(stats.high_water_mark, 4U);
+    EXPECT_EQ(stats.stashed, 1U);
+    auto counts_of = [&](messaging::message_type_id id) {
+        for (auto const& c : stats.types) {
+            if (c.type_id == id) {
+                return c;
+            }
+        }
+        return messaging::message_type_counts{};
+    };
+    EXPECT_EQ(counts_of(messaging::type_id_of<numbered<0>>).handled, 2U);
+    EXPECT_EQ(counts_of(messaging::type_id_of<unhandled>).dropped, 1U);
+    EXPECT_EQ(counts_of(messaging::type_id_of<numbered<1>>).stashed, 1U);
+    EXPECT_EQ(stats.sojourn.count, 3U);     // The stashed message hasn't finished waiting yet.
+    EXPECT_EQ(stats.handler_time.count, 2U);
+    EXPECT_GE(stats.handler_time.max_ns, 1000000U);
+    EXPECT_GE(stats.handler_time.percentile_ns(0.5), 1000000U);
+}
+
+TEST(MessageQueueShould, RecycleMessageNodesAfterTheyArePopped) {
+    messaging::queue q;
+    q.push(numbered<0>{0});
+    q.wait_and_pop();
+    const std::size_t warm = q.node_pool().blocks_allocated();
+    EXPECT_GT(warm, 0U);
+
+    for (int i = 0; i < 10000; ++i) {
+        q.push(numbered<1>{i});
+        q.push(numbered<0>{i});
+        auto first = q.wait_and_pop();
+        ASSERT_EQ(first->type_id, messaging::type_id_of<numbered<1>>);
+        EXPECT_EQ(messaging::message_cast<numbered<1>>(*first).value, i);
+        q.wait_and_pop();
+    }
+    EXPECT_EQ(q.node_pool().blocks_allocated(), warm);
+}
+
+struct alignas(256) cache_pair {
+    int value;
+};
+
+TEST(MessageQueueShould, BuildOverAlignedMessagesAtTheirAlignment) {
+    messaging::queue q;
+    for (int i = 0; i < 8; ++i) {
+        q.push(cache_pair{i});
+    }
+    for (int i = 0; i < 8; ++i) {
+        auto msg = q.wait_and_pop();
+        cache_pair const& contents = messaging::message_cast<cache_pair>(*msg);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&contents) % alignof(cache_pair), 0U);
+        EXPECT_EQ(contents.value, i);
+    }
+    EXPECT_EQ(q.node_pool().blocks_allocated(), 0U);    // Too aligned for any pool class.
+}
+
+TEST(MessageQueueShould, DestroyMessagesStillQueuedWithTheQueue) {
+    auto payload = std::make_shared<int>(1);
+    {
+        messaging::queue q;
+        q.push(payload);
+        q.push(std::array<char, 1024>{});  // Larger than any pool class.
+        EXPECT_EQ(payload.use_count(), 2);
+    }
+    EXPECT_EQ(payload.use_count(), 1);
+}
+
+TEST(MessageQueueShould, KeepEachProducersOrderUnderConcurrentPushes) {
+    constexpr int producers = 4;
+    constexpr int per_producer = 50000;
+    messaging::queue q;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&q, p] {
+            for (int i = 0; i < per_producer; ++i) {
+                q.push(numbered<0>{p * per_producer + i});
+            }
+        });
+    }
+
+    std::vector<int> next(producers, 0);
+    for (int n = 0; n < producers * per_producer; ++n) {
+        auto msg = q.wait_and_pop();
+        const int value = messaging::message_cast<numbered<0>>(*msg).value;
+        const int p = value / per_producer;
+        ASSERT_EQ(value % per_producer, next[p]);
+        ++next[p];
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(q.try_pop(), nullptr);
+}
+
+TEST(SenderShould, FailFastOrTimeOutWhenABoundedMailboxIsFull) {
+    messaging::receiver incoming(2);
+    messaging::sender out = incoming;
+
+    EXPECT_TRUE(out.try_send(numbered<0>{1}));
+    EXPECT_TRUE(out.try_send(numbered<0>{2}));
+    EXPECT_FALSE(out.try_send(numbered<0>{3}));
+    EXPECT_FALSE(out.send_for(numbered<0>{3}, std::chrono::milliseconds(10)));
+    EXPECT_EQ(incoming.depth(), 2U);
+    EXPECT_EQ(incoming.high_water_mark(), 2U);
+
+    incoming.wait().handle<numbered<0>>([](numbered<0> const&) {});
+    EXPECT_TRUE(out.try_send(numbered<0>{3}));
+    EXPECT_EQ(incoming.high_water_mark(), 2U);
+}
+
+TEST(SenderShould, BlockUntilTheReceiverMakesRoom) {
+    messaging::receiver incoming(1);
+    messaging::sender out = incoming;
+    out.send(numbered<0>{1});
+
+    std::atomic<bool> sent{false};
+    std::thread blocked([&] {
+        out.send(numbered<0>{2});
+        sent = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(sent.load());
+
+    std::vector<int> seen;
+    for (int i = 0; i < 2; ++i) {
+        incoming.wait().handle<numbered<0>>([&](numbered<0> const& msg) { seen.push_back(msg.value); });
+    }
+    blocked.join();
+    EXPECT_TRUE(sent.load());
+    EXPECT_EQ(seen, (std::vector<int>{1, 2}));
+    EXPECT_EQ(incoming.high_water_mark(), 1U);
+}
+
+TEST(ReceiverShould, TimeOutOnABoundedMailboxWhileSendersWaitForRoom) {
+    messaging::receiver incoming(1);
+    messaging::sender out = incoming;
+    constexpr int per_sender = 5000;
+    auto send_all = [&] {
+        for (int i = 0; i < per_sender; ++i) {
+            out.send(numbered<0>{1});
+        }
+    };
+    std::thread first(send_all);
+    std::thread second(send_all);   // With room for one, a sender is nearly always waiting.
+
+    int received = 0;
+    int timeouts = 0;
+    while (received < 2 * per_sender) {
+        incoming.wait_for(std::chrono::microseconds(1))     // Times out around the senders' links.
+            .handle<numbered<0>>([&](numbered<0> const& msg) { received += msg.value; })
+            .on_timeout([&] { ++timeouts; });
+    }
+    first.join();
+    second.join();
+    EXPECT_EQ(received, 2 * per_sender);
+    EXPECT_EQ(incoming.depth(), 0U);
+}
+
+TEST(SenderShould, SendABatchInOrderThroughABoundedMailbox) {
+    messaging::receiver incoming(8);
+    messaging::sender out = incoming;
+    std::vector<numbered<0>> batch;
+    for (int i = 0; i < 100; ++i) {
+        batch.push_back({i});
+    }
+
+    std::thread producer([&] { out.send_batch(batch); });
+    std::vector<int> seen;
+    for (int i = 0; i < 100; ++i) {
+        incoming.wait().handle<numbered<0>>([&](numbered<0> const& msg) { seen.push_back(msg.value); });
+    }
+    producer.join();
+
+    ASSERT_EQ(seen.size(), 100U);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(seen[i], i);
+    }
+    EXPECT_LE(incoming.high_water_mark(), 8U);
+}
+
+TEST(SenderShould, ForwardMessagesIntoTheirNodesWithoutCopies) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    int copies = 0;
+    int moves = 0;
+    out.send(counted_copies(&copies, &moves));
+    EXPECT_EQ(copies, 0);
+    EXPECT_EQ(moves, 1);    // From the caller's temporary into the node.
+    out.emplace<counted_copies>(&copies, &moves);
+    EXPECT_EQ(moves, 1);
+    counted_copies named(&copies, &moves);
+    out.send(named);
+    EXPECT_EQ(copies, 1);
+
+    out.send(std::make_unique<int>(7));     // Move-only messages go through too.
+    int received = 0;
+    for (int i = 0; i < 3; ++i) {
+        incoming.wait().handle<counted_copies>([&](counted_copies const&) { ++received; });
+    }
+    incoming.wait().handle<std::unique_ptr<int>>([&](std::unique_ptr<int> const& msg) { received += *msg; });
+    EXPECT_EQ(received, 10);
+    EXPECT_EQ(copies, 1);
+    EXPECT_EQ(moves, 1);
+}
+
+TEST(SenderShould, ForwardRequestsIntoTheirNodesWithASingleMove) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    int copies = 0;
+    int moves = 0;
+    auto answer = out.ask<int>(counted_question(&copies, &moves));
+    EXPECT_EQ(copies, 0);
+    EXPECT_EQ(moves, 1);
+    incoming.wait().handle<counted_question>([](counted_question const& msg) { msg.reply(2); });
+    EXPECT_EQ(answer.get(), 2);
+    EXPECT_EQ(moves, 1);
+}
+
+TEST(InlineStringShould, HoldShortTextInPlaceAndCompareAsAView) {
+    using code = messaging::inline_string<7>;
+    static_assert(std::is_trivially_copyable_v<code>);
+    code pin = std::string("19");
+    pin.push_back('3');
+    pin.push_back('7');
+    EXPECT_EQ(pin, "1937");
+    EXPECT_EQ(pin.size(), 4U);
+    pin.pop_back();
+    EXPECT_EQ(std::string_view(pin), "193");
+    EXPECT_EQ(std::hash<code>{}(pin), std::hash<std::string_view>{}("193"));
+    pin.clear();
+    EXPECT_TRUE(pin.empty());
+}
+
+TEST(SenderShould, AskAndGetTheAnswerWithoutAMailboxOfItsOwn) {
+    messaging::receiver responder;
+    messaging::sender out = responder;
+    std::thread answering([&] {
+        for (int i = 0; i < 100; ++i) {
+            responder.wait().handle<question>([](question const& msg) { msg.reply(msg.value * 2); });
+        }
+    });
+    for (int i = 0; i < 99; ++i) {
+        EXPECT_EQ(out.ask<int>(question(i)).get(), std::optional<int>(i * 2));
+    }
+    out.send(question(99));     // Sent, not asked: the reply goes nowhere.
+    answering.join();
+}
+
+TEST(SenderShould, LeaveTheAnswerEmptyWhenTheRequestIsDroppedUnanswered) {
+    messaging::receiver responder;
+    messaging::sender out = responder;
+    messaging::reply_future<int> unanswered = out.ask<int>(question(1));
+    messaging::reply_future<int> ignored = out.ask<int>(question(2));
+    EXPECT_FALSE(unanswered.wait_for(std::chrono::milliseconds(10)));
+
+    responder.wait()
+        .handle<question>([](question const& msg) {
+            if (msg.value == 1) {
+                msg.reply(1);
+            }
+        });
+    EXPECT_TRUE(unanswered.ready());
+    EXPECT_EQ(unanswered.get(), std::optional<int>(1));
+    responder.wait().handle<question>([](question const&) {});
+    EXPECT_EQ(ignored.get(), std::nullopt);
+    EXPECT_EQ(messaging::sender().ask<int>(question(3)).get(), std::nullopt);
+}
+
+TEST(BusShould, ShareEachPublishedMessageAmongItsSubscribersUntilTheLastIsDone) {
+    messaging::bus events(8);
+    messaging::bus::subscription early(events);
+    messaging::receiver first(early);
+    auto life = std::make_shared<int>(0);
+    events.publish(tracked{life, 1});   // Only `early` was there for this one.
+
+    messaging::bus::subscription late(events);
+    messaging::receiver second(late);
+    EXPECT_EQ(events.subscribers(), 2U);
+    events.publish(tracked{life, 2});
+    EXPECT_EQ(life.use_count(), 3);     // One node each, however many subscribers.
+
+    std::vector<int> seen;
+    tracked const* first_copy = nullptr;
+    tracked const* second_copy = nullptr;
+    for (int i = 0; i < 2; ++i) {
+        first.wait().handle<tracked>([&](tracked const& msg) {
+            seen.push_back(msg.value);
+            first_copy = &msg;
+        });
+    }
+    EXPECT_EQ(life.use_count(), 2);     // The first message is gone; the second waits for `late`.
+    second.wait().handle<tracked>([&](tracked const& msg) {
+        seen.push_back(msg.value);
+        second_copy = &msg;
+    });
+    EXPECT_EQ(first_copy, second_copy);
+    EXPECT_EQ(life.use_count(), 1);
+    EXPECT_EQ(seen, (std::vector<int>{1, 2, 2}));
+}
+
+TEST(BusShould, HoldPublishersBackForTheSlowestSubscriberOnly) {
+    messaging::bus events(2);
+    EXPECT_TRUE(events.try_publish(numbered<0>{0}));    // Nobody listens: never full.
+    EXPECT_TRUE(events.try_publish(numbered<0>{1}));
+    EXPECT_TRUE(events.try_publish(numbered<0>{2}));
+
+    messaging::bus::subscription slow(events);
+    messaging::receiver incoming(slow);
+    EXPECT_TRUE(events.try_publish(numbered<0>{3}));
+    EXPECT_TRUE(events.try_publish(numbered<0>{4}));
+    EXPECT_FALSE(events.try_publish(numbered<0>{5}));
+
+    std::thread publisher([&] {
+        for (int i = 5; i < 100; ++i) {
+            events.publish(numbered<0>{i});
+        }
+        events.publish(messaging::close_queue{});
+    });
+    int expected = 3;
+    incoming.run_until_closed([&] {
+        incoming.wait().handle<numbered<0>>([&](numbered<0> const& msg) {
+            EXPECT_EQ(msg.value, expected);
+            ++expected;
+        });
+    });
+    publisher.join();
+    EXPECT_EQ(expected, 100);
+}
+
+TEST(BusShould, CloseOneSubscriberAheadOfTheBusWhenSentCloseQueue) {
+    messaging::bus events(4);
+    messaging::bus::subscription sub(events);
+    messaging::receiver incoming(sub);
+    events.publish(numbered<0>{1});
+    messaging::remote_sender(incoming).send(messaging::close_queue{});
+    EXPECT_FALSE(messaging::remote_sender(incoming).try_send(numbered<0>{2}));
+
+    int handled = 0;
+    const auto status = incoming.wait_for(std::chrono::seconds(1))
+        .handle<numbered<0>>([&](numbered<0> const&) { ++handled; })
+        .result();
+    EXPECT_EQ(status, messaging::dispatch_status::closed);
+    EXPECT_EQ(handled, 0);
+}
+
+struct scope_flag {
+    bool& flag;
+    ~scope_flag() { flag = true; }
+};
+
+messaging::machine collect(messaging::inbox& incoming, std::vector<int>& seen, bool& unwound, messaging::sender ack) {
+    scope_flag guard{unwound};
+    auto first = co_await incoming.receive<numbered<0>>();
+    seen.push_back(first.get().value);
+    auto second = co_await incoming.receive<numbered<1>>();    // Stashed before the machine got here.
+    seen.push_back(second.get().value);
+    for (; ;) {
+        auto next = co_await incoming.receive<numbered<0>, numbered<2>>();
+        next.visit([&](auto const& msg) { seen.push_back(msg.value); });
+        ack.send(unhandled{});
+    }
+}
+
+TEST(InboxShould, RunAStraightLineMachineAndDestroyItWhenClosed) {
+    messaging::receiver r;
+    messaging::sender out = r;
+    messaging::inbox incoming(r);
+    incoming.stash_unmatched(true);
+    out.send(numbered<1>{1});
+    out.send(numbered<0>{0});
+    out.send(unhandled{});
+    out.send(numbered<2>{2});
+    out.send(numbered<0>{3});
+
+    std::vector<int> seen;
+    bool unwound = false;
+    messaging::receiver acks;
+    std::thread machine_thread([&] { incoming.run(collect(incoming, seen, unwound, acks)); });
+    for (int i = 0; i < 2; ++i) {
+        acks.wait().handle<unhandled>([](unhandled const&) {});
+    }
+    out.send(messaging::close_queue{});     // A control message: sent any earlier, it would overtake the rest.
+    machine_thread.join();
+    EXPECT_EQ(seen, (std::vector<int>{0, 1, 2, 3}));
+    EXPECT_TRUE(incoming.closed());
+    EXPECT_TRUE(unwound);   // Destroyed where it was suspended.
+    EXPECT_EQ(r.stashed(), 1U);
+}
+
+class counting_machine : public messaging::machine_actor {
+    messaging::sender done;
+
+    messaging::machine run() override {
+        int total = 0;
+        for (; ;) {
+            auto msg = co_await incoming.receive<numbered<0>, numbered<1>>();
+            if (msg.is<numbered<1>>()) {
+                break;
+            }
+            total += msg.get<numbered<0>>().value;
+        }
+        done.send(numbered<2>{total});
+    }
+
+public:
+    explicit counting_machine(messaging::sender done_) : done(done_) {}
+};
+
+TEST(MachineActorShould, SuspendThousandsOfMachinesWithoutAThreadEach) {
+    constexpr int machines = 10000;
+    messaging::receiver results;
+    std::vector<std::unique_ptr<counting_machine>> actors;
+    for (int i = 0; i < machines; ++i) {
+        actors.push_back(std::make_unique<counting_machine>(results));
+    }
+    long long total = 0;
+    {
+        messaging::scheduler workers(2);
+        for (auto& a : actors) {
+            workers.start(*a);
+        }
+        for (int round = 1; round <= 3; ++round) {
+            for (auto& a : actors) {
+                messaging::sender(*a).send(numbered<0>{round});
+            }
+        }
+        for (auto& a : actors) {
+            messaging::sender(*a).send(numbered<1>{0});
+        }
+        for (int i = 0; i < machines; ++i) {
+            results.wait().handle<numbered<2>>([&](numbered<2> const& msg) { total += msg.value; });
+        }
+    }
+    EXPECT_EQ(total, 6LL * machines);
+    for (auto& a : actors) {
+        ASSERT_TRUE(a->machine_done());
+    }
+}
+
+TEST(InlineReceiverShould, DispatchMessagesInTheirSlotsAndDropTheOnesNotHandled) {
+    messaging::inline_receiver<numbered<0>, numbered<1>, tracked> incoming(4);
+    messaging::inline_sender<numbered<0>, numbered<1>, tracked> out = incoming;
+    auto life = std::make_shared<int>(0);
+    out.send(tracked{life, 7});
+    out.send(numbered<1>{1});   // Not taken by the handlers below: dropped.
+    out.send(numbered<0>{2});
+    EXPECT_EQ(life.use_count(), 2);     // Moved into its slot, not copied.
+
+    std::vector<int> seen;
+    auto handlers = messaging::overload{
+        [&](numbered<0> const& msg) { seen.push_back(msg.value); },
+        [&](tracked const& msg) { seen.push_back(msg.value); },
+    };
+    EXPECT_EQ(incoming.wait(handlers), messaging::dispatch_status::handled);
+    EXPECT_EQ(life.use_count(), 1);     // Destroyed in place once handled.
+    EXPECT_EQ(incoming.wait(handlers), messaging::dispatch_status::handled);
+    EXPECT_EQ(seen, (std::vector<int>{7, 2}));
+    EXPECT_EQ(incoming.try_dispatch(handlers), messaging::dispatch_status::timed_out);
+    EXPECT_EQ(incoming.wait_for(std::chrono::milliseconds(1), handlers), messaging::dispatch_status::timed_out);
+
+    out.send(messaging::close_queue{});
+    EXPECT_EQ(incoming.wait(handlers), messaging::dispatch_status::closed);
+    EXPECT_TRUE(incoming.closed());
+}
+
+TEST(InlineReceiverShould, KeepEachSendersOrderThroughAFullRing) {
+    messaging::inline_receiver<numbered<0>, numbered<1>> incoming(2);
+    messaging::inline_sender<numbered<0>, numbered<1>> out = incoming;
+    EXPECT_TRUE(out.try_send(numbered<0>{0}));
+    EXPECT_TRUE(out.try_send(numbered<0>{1}));
+    EXPECT_FALSE(out.try_send(numbered<0>{2}));
+    EXPECT_FALSE(out.send_for(numbered<0>{2}, std::chrono::milliseconds(1)));
+
+    constexpr int per_sender = 2000;
+    std::thread zeros([&] {
+        for (int i = 2; i < per_sender; ++i) {
+            out.send(numbered<0>{i});
+        }
+    });
+    std::thread ones([&] {
+        for (int i = 0; i < per_sender; ++i) {
+            out.send(numbered<1>{i});
+        }
+    });
+    int next_zero = 0;
+    int next_one = 0;
+    auto handlers = messaging::overload{
+        [&](numbered<0> const& msg) { EXPECT_EQ(msg.value, next_zero++); },
+        [&](numbered<1> const& msg) { EXPECT_EQ(msg.value, next_one++); },
+    };
+    for (int i = 0; i < 2 * per_sender; ++i) {
+        incoming.wait(handlers);
+    }
+    zeros.join();
+    ones.join();
+    EXPECT_EQ(next_zero, per_sender);
+    EXPECT_EQ(next_one, per_sender);
+}
+
+struct copy_refused {
+    int value;
+
+    explicit copy_refused(int value_) : value(value_) {}
+    copy_refused(copy_refused const&) { throw std::runtime_error("copy refused"); }
+    copy_refused(copy_refused&& other) noexcept(false) : value(other.value) {}  // So the slot is built in place.
+};
+
+TEST(InlineReceiverShould, SkipTheSlotOfASendThatThrew) {
+    messaging::inline_receiver<copy_refused, numbered<0>> incoming(4);
+    messaging::inline_sender<copy_refused, numbered<0>> out = incoming;
+    copy_refused named(1);
+    EXPECT_THROW(out.send(named), std::runtime_error);
+    out.send(copy_refused(2));
+    out.send(numbered<0>{3});
+
+    std::vector<int> seen;
+    auto handlers = messaging::overload{
+        [&](copy_refused const& msg) { seen.push_back(msg.value); },
+        [&](numbered<0> const& msg) { seen.push_back(msg.value); },
+    };
+    EXPECT_EQ(incoming.wait(handlers), messaging::dispatch_status::handled);
+    EXPECT_EQ(incoming.wait(handlers), messaging::dispatch_status::handled);
+    EXPECT_EQ(seen, (std::vector<int>{2, 3}));
+    EXPECT_EQ(incoming.try_dispatch(handlers), messaging::dispatch_status::timed_out);
+}
+
+TEST(MessageQueueShould, HoldNoMoreThanItsCapacityOfUndispatchedMessages) {
+    messaging::queue q(4);
+    std::vector<numbered<0>> batch{{1}, {2}, {3}, {4}};
+    q.push_batch(batch);
+    EXPECT_FALSE(q.try_push(numbered<0>{5}));
+
+    auto first = q.try_pop();   // Drains all four into the consumer's FIFO; only the one handed out has left.
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(q.size(), 3U);
+    EXPECT_TRUE(q.try_push(numbered<0>{5}));
+    EXPECT_FALSE(q.try_push(numbered<0>{6}));
+
+    std::vector<int> rest;
+    while (auto msg = q.try_pop()) {
+        rest.push_back(messaging::message_cast<numbered<0>>(*msg).value);
+    }
+    EXPECT_EQ(rest, (std::vector<int>{2, 3, 4, 5}));
+    EXPECT_EQ(q.size(), 0U);
+    EXPECT_EQ(q.high_water_mark(), 4U);
+}
+
+TEST(MessageQueueShould, ReleaseTheDepthOfAnUnboundedQueueADrainAtATime) {
+    messaging::queue q;
+    for (int i = 0; i < 4; ++i) {
+        q.push(numbered<0>{i});
+    }
+    auto first = q.try_pop();
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(q.size(), 0U);    // All four left the mailbox with one atomic.
+    EXPECT_EQ(q.high_water_mark(), 4U);
+}
+
+TEST(MessageQueueShould, HandControlMessagesOutAheadOfTheBacklog) {
+    messaging::queue q;
+    static_assert(messaging::lane_of<messaging::close_queue> == messaging::lane::control);
+    static_assert(messaging::lane_of<numbered<0>> == messaging::lane::data);
+    for (int i = 0; i < 1000; ++i) {
+        q.push(numbered<0>{i});
+    }
+    auto first = q.try_pop();   // Drains the first max_drain data messages into the consumer's FIFO.
+    ASSERT_NE(first, nullptr);
+    q.push(stop_now{});
+    q.push(numbered<0>{1000});
+
+    auto control = q.try_pop();
+    ASSERT_NE(control, nullptr);
+    EXPECT_EQ(control->type_id, messaging::type_id_of<stop_now>);
+
+    int expected = 1;
+    while (auto msg = q.try_pop()) {
+        ASSERT_EQ(msg->type_id, messaging::type_id_of<numbered<0>>);
+        EXPECT_EQ(messaging::message_cast<numbered<0>>(*msg).value, expected);
+        ++expected;
+    }
+    EXPECT_EQ(expected, 1001);
+}
+
+TEST(SenderShould, GetControlMessagesIntoAFullMailbox) {
+    messaging::receiver incoming(2);
+    messaging::sender out = incoming;
+    out.send(numbered<0>{1});
+    out.send(numbered<0>{2});
+    EXPECT_FALSE(out.try_send(numbered<0>{3}));
+    EXPECT_TRUE(out.try_send(messaging::close_queue{}));
+    EXPECT_EQ(incoming.depth(), 3U);
+
+    bool handled = false;
+    EXPECT_THROW(incoming.wait().handle<numbered<0>>([&](numbered<0> const&) { handled = true; }),
+                 messaging::close_queue);
+    EXPECT_FALSE(handled);
+}
+
+// Records the values it is sent, and checks they arrive in the order they were sent.
+class counting_actor : public messaging::actor {
+    void receive() override {
+        current().handle<numbered<0>>([&](numbered<0> const& msg) {
+            in_order = in_order && msg.value == received;
+            ++received;
+        });
+    }
+
+public:
+    int received = 0;
+    bool in_order = true;
+};
+
+TEST(SchedulerShould, RunManyActorsOnAFewThreads) {
+    constexpr int actors = 1000;
+    constexpr int per_actor = 100;
+    std::vector<counting_actor> counters(actors);
+    {
+        messaging::scheduler workers(4, 8);
+        for (auto& c : counters) {
+            workers.start(c);
+        }
+        std::vector<std::thread> producers;
+        for (int p = 0; p < 2; ++p) {
+            producers.emplace_back([&, p] {
+                for (int i = 0; i < per_actor; ++i) {
+                    for (int a = p; a < actors; a += 2) {
+                        messaging::sender(counters[a]).send(numbered<0>{i});
+                    }
+                }
+            });
+        }
+        for (auto& t : producers) {
+            t.join();
+        }
+    }   // Runs what is left and joins the workers.
+
+    for (auto const& c : counters) {
+        EXPECT_FALSE(c.is_closed());
+        EXPECT_TRUE(c.in_order);
+        EXPECT_EQ(c.received, per_actor);
+    }
+}
+
+// Waits for numbered<0>, then for numbered<1>, like a two-state ATM.
+class two_state_actor : public messaging::actor {
+    void (two_state_actor::*state)() = &two_state_actor::waiting_for_first;
+
+    void waiting_for_first() {
+        current().handle<numbered<0>>([&](numbered<0> const& msg) {
+            seen.push_back(msg.value);
+            state = &two_state_actor::waiting_for_second;
+        });
+    }
+
+    void waiting_for_second() {
+        current().handle<numbered<1>>([&](numbered<1> const& msg) {
+            seen.push_back(msg.value);
+            state = &two_state_actor::waiting_for_first;
+        });
+    }
+
+    void receive() override { (this->*state)(); }
+
+public:
+    std::vector<int> seen;
+};
+
+TEST(SchedulerShould, KeepHandlerChainsAndStateMachinesWorking) {
+    two_state_actor machine;
+    two_state_actor closing;
+    messaging::sender out = machine;
+    out.send(numbered<1>{1});   // Sent before start: runs once started. Dropped, nothing waits for it yet.
+    messaging::sender(closing).send(numbered<0>{5});
+    messaging::sender(closing).send(messaging::close_queue{});  // Overtakes numbered<0>{5}.
+    {
+        messaging::scheduler workers(2);
+        workers.start(machine);
+        workers.start(closing);
+        out.send(numbered<0>{2});
+        out.send(numbered<0>{3});   // Dropped: the actor now waits for numbered<1>.
+        out.send(numbered<1>{4});
+    }
+    EXPECT_EQ(machine.seen, (std::vector<int>{2, 4}));
+    EXPECT_FALSE(machine.is_closed());
+    EXPECT_TRUE(closing.seen.empty());
+    EXPECT_TRUE(closing.is_closed());
+}
+
+}  // namespace
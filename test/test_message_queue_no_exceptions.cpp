@@ -0,0 +1,82 @@
+///
+/// @file test_message_queue_no_exceptions.cpp
+///
+/// Built with -fno-exceptions: close_queue ends message loops through dispatch_status only.
+///
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "include/message_queue/actor.h"
+#include "include/message_queue/receiver.h"
+
+static_assert(!MESSAGING_HAS_EXCEPTIONS, "this test must be built with -fno-exceptions");
+
+namespace {
+
+struct value {
+    int v;
+};
+
+TEST(MessagingWithoutExceptionsShould, EndAPlainMessageLoopOnClose) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    out.send(value{1});
+
+    std::vector<int> seen;
+    while (!incoming.closed()) {
+        incoming.wait().handle<value>([&](value const& msg) {
+            seen.push_back(msg.v);
+            out.send(messaging::close_queue{});
+        });
+    }
+    EXPECT_EQ(seen, (std::vector<int>{1}));
+}
+
+TEST(MessagingWithoutExceptionsShould, RunUntilClosedAndReportTheStatus) {
+    messaging::receiver incoming;
+    messaging::sender out = incoming;
+    out.send(value{1});
+    EXPECT_EQ(incoming.wait().handle<value>([](value const&) {}).result(), messaging::dispatch_status::handled);
+
+    int handled = 0;
+    out.send(value{2});
+    incoming.run_until_closed([&] {
+        incoming.wait().handle<value>([&](value const&) {
+            ++handled;
+            out.send(messaging::close_queue{});
+        });
+    });
+    EXPECT_EQ(handled, 1);
+    EXPECT_TRUE(incoming.closed());
+}
+
+class closing_actor : public messaging::actor {
+    void receive() override {
+        current().handle<value>([&](value const& msg) { last = msg.v; });
+    }
+
+public:
+    int last = 0;
+};
+
+TEST(MessagingWithoutExceptionsShould, CloseAnActor) {
+    closing_actor a;
+    {
+        messaging::scheduler workers(1);
+        workers.start(a);
+        messaging::sender(a).send(value{7});
+    }
+    EXPECT_EQ(a.last, 7);
+    EXPECT_FALSE(a.is_closed());
+
+    closing_actor b;
+    messaging::sender(b).send(messaging::close_queue{});
+    {
+        messaging::scheduler workers(1);
+        workers.start(b);
+    }
+    EXPECT_TRUE(b.is_closed());
+}
+
+}  // namespace
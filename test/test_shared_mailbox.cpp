@@ -0,0 +1,132 @@
+///
+/// @file test_shared_mailbox.cpp
+///
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "include/message_queue/receiver.h"
+#include "include/message_queue/shared_mailbox.h"
+
+namespace {
+
+struct reading {
+    std::uint64_t sequence;
+    char label[16];
+};
+
+struct other {};
+
+std::string unique_name(char const* what) {
+    return std::string("/messaging_test_") + what + "_" + std::to_string(::getpid());
+}
+
+struct with_reply_address {
+    messaging::sender reply_to;
+    std::uint32_t amount;
+};
+
+struct price_query : messaging::request<std::uint32_t> {
+    std::uint32_t item;
+};
+
+TEST(RemoteSenderShould, OnlyAcceptMessagesThatMeanTheSameInAnotherProcess) {
+    static_assert(messaging::travels_between_processes<reading>);
+    static_assert(messaging::travels_between_processes<messaging::close_queue>);
+    static_assert(!messaging::travels_between_processes<std::string>);
+    static_assert(!messaging::travels_between_processes<reading*>);
+    static_assert(!messaging::travels_between_processes<with_reply_address>);  // Its sender points into this process.
+    static_assert(!messaging::travels_between_processes<messaging::remote_sender>);
+    static_assert(!messaging::travels_between_processes<price_query>);         // Nor can its reply find the way back.
+}
+
+TEST(SharedMailboxShould, DispatchMessagesInPlaceFromTheSegment) {
+    const std::string name = unique_name("in_place");
+    auto mailbox = messaging::shared_mailbox::create(name.c_str());
+    ASSERT_NE(mailbox, nullptr);
+    messaging::receiver incoming(*mailbox);
+    messaging::remote_sender out = incoming;
+    out.send(other{});
+    out.send(reading{7, "seven"});
+
+    bool in_place = false;
+    std::uint64_t seen = 0;
+    incoming.wait()
+        .handle<reading>([&](reading const& msg) {
+            seen = msg.sequence;
+            in_place = mailbox->contains(&msg);
+        });
+    EXPECT_EQ(seen, 7U);
+    EXPECT_TRUE(in_place);
+}
+
+TEST(SharedMailboxShould, CarryMessagesFromAnotherProcessInOrder) {
+    const std::string name = unique_name("fork");
+    auto mailbox = messaging::shared_mailbox::create(name.c_str(), {.slot_count = 64});
+    ASSERT_NE(mailbox, nullptr);
+    constexpr std::uint64_t count = 20000;     // Far more than fit, so both sides get to wait.
+
+    const pid_t child = ::fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        auto remote = messaging::shared_mailbox::open(name.c_str());
+        if (remote == nullptr) {
+            ::_exit(1);
+        }
+        messaging::remote_sender out(remote.get());
+        for (std::uint64_t i = 0; i < count; ++i) {
+            out.send(reading{i, "remote"});
+        }
+        out.send(messaging::close_queue{});
+        ::_exit(0);
+    }
+
+    messaging::receiver incoming(*mailbox);
+    std::uint64_t expected = 0;
+    bool in_order = true;
+    incoming.run_until_closed([&] {
+        incoming.wait().handle<reading>([&](reading const& msg) {
+            in_order = in_order && msg.sequence == expected && std::string(msg.label) == "remote";
+            ++expected;
+        });
+    });
+    int status = 0;
+    ASSERT_EQ(::waitpid(child, &status, 0), child);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    EXPECT_EQ(expected, count);
+    EXPECT_TRUE(in_order);
+}
+
+TEST(SharedMailboxShould, FailOrTimeOutWhenFullAndTimeOutWhenEmpty) {
+    const std::string name = unique_name("full");
+    auto mailbox = messaging::shared_mailbox::create(name.c_str(), {.slot_count = 2});
+    ASSERT_NE(mailbox, nullptr);
+    messaging::receiver incoming(*mailbox);
+    messaging::remote_sender out = incoming;
+    EXPECT_TRUE(out.try_send(reading{0, ""}));
+    EXPECT_TRUE(out.try_send(reading{1, ""}));
+    EXPECT_FALSE(out.try_send(reading{2, ""}));
+    EXPECT_FALSE(out.send_for(reading{2, ""}, std::chrono::milliseconds(10)));
+
+    std::vector<std::uint64_t> seen;
+    for (int i = 0; i < 3; ++i) {
+        incoming.wait_for(std::chrono::milliseconds(10))
+            .handle<reading>([&](reading const& msg) { seen.push_back(msg.sequence); })
+            .on_timeout([&] { seen.push_back(99); });
+    }
+    EXPECT_EQ(seen, (std::vector<std::uint64_t>{0, 1, 99}));
+    EXPECT_TRUE(out.try_send(reading{3, ""}));
+}
+
+TEST(SharedMailboxShould, RefuseToOpenWhatIsNotAMailbox) {
+    EXPECT_EQ(messaging::shared_mailbox::open(unique_name("missing").c_str()), nullptr);
+    EXPECT_EQ(messaging::shared_mailbox::create(unique_name("odd").c_str(), {.slot_count = 3}), nullptr);
+}
+
+}  // namespace